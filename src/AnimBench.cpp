@@ -0,0 +1,136 @@
+// Times the animation path of a frame: sampling a clip and computing the skinning palettes of many instances.
+// usage: levulkan-anim-bench [--instances N] [--bones N] [--frames N] [--max-error E]
+#include "AnimationCompression.hpp"
+#include "AnimationSampler.hpp"
+#include "Loaders.hpp"
+#include "Logging.hpp"
+#include "Skinning.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <cmath>
+#include <string>
+
+/// @brief A skeleton of @p numBones bones, three children per bone, each one unit above its parent.
+static Model::Skeleton makeSkeleton(unsigned numBones)
+{
+    Model::Skeleton skeleton;
+    skeleton.globalInverseTransform = glm::mat4(1.0f);
+    for(unsigned bone = 0; bone < numBones; ++bone)
+    {
+        glm::mat4 local(1.0f);
+        local[3] = glm::vec4(0.0f, bone ? 1.0f : 0.0f, 0.0f, 1.0f);
+        skeleton.nodeTransform.push_back(local);
+        skeleton.bindTransform.push_back(glm::mat4(1.0f));
+        skeleton.parents.push_back(bone ? static_cast<int>((bone - 1) / 3) : -1);
+        skeleton.boneMap.emplace("bone" + std::to_string(bone), bone);
+    }
+    return skeleton;
+}
+
+/// @brief A looping clip of @p seconds sampled at 30 keys per second, every bone swinging and bobbing at its own rate.
+/// Goes through compressAnimation like an imported clip, so the benchmark sees the key counts the renderer would.
+static Animation makeAnimation(Model::Skeleton const &skeleton, float seconds, AnimationCompressionOptions const &options)
+{
+    constexpr float TICKS_PER_SECOND = 30.0f;
+    Animation animation;
+    animation.name = "bench";
+    animation.ticksPerSecond = TICKS_PER_SECOND;
+    animation.durationTicks = seconds * TICKS_PER_SECOND;
+
+    std::vector<SourceKeyframes> bones(skeleton.parents.size());
+    for(size_t bone = 0; bone < bones.size(); ++bone)
+    {
+        float rate = 1.0f + static_cast<float>(bone % 7) * 0.25f;
+        glm::vec3 axis = glm::normalize(glm::vec3(static_cast<float>(bone % 3), 1.0f, static_cast<float>(bone % 5)));
+        for(float t = 0.0f; t <= animation.durationTicks; t += 1.0f)
+        {
+            float phase = t / TICKS_PER_SECOND * rate;
+            float angle = 0.5f * std::sin(phase);
+            glm::vec3 rest = glm::vec3(skeleton.nodeTransform[bone][3]);
+            bones[bone].positions.push_back({rest + glm::vec3(0.0f, 0.1f * std::sin(phase * 2.0f), 0.0f), t});
+            glm::vec3 v = axis * std::sin(angle * 0.5f);
+            bones[bone].orientations.push_back({glm::quat(std::cos(angle * 0.5f), v.x, v.y, v.z), t});
+        }
+        bones[bone].scales.push_back({glm::vec3(1.0f), 0.0f});
+    }
+    AnimationCompressionStats stats = compressAnimation(bones, skeleton, options, animation);
+    LOG_INFO("Clip of {} bones: kept {} of {} keys, max error {}", bones.size(), stats.keptKeys, stats.sourceKeys, stats.maxError);
+    return animation;
+}
+
+template<typename T>
+static bool parseArgument(std::string_view arg, T &value)
+{
+    auto result = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+    return result.ec == std::errc{} && result.ptr == arg.data() + arg.size();
+}
+
+int main(int argc, char **argv)
+{
+    sLogger = spdlog::stdout_color_mt("sLogger");
+    sLogger->set_level(spdlog::level::info);
+
+    unsigned numInstances = 4096, numBones = 64, numFrames = 240;
+    AnimationCompressionOptions compression{.statistics = false};
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        bool valid = i + 1 < argc;
+        if(valid && arg == "--instances")
+            valid = parseArgument(argv[++i], numInstances);
+        else if(valid && arg == "--bones")
+            valid = parseArgument(argv[++i], numBones);
+        else if(valid && arg == "--frames")
+            valid = parseArgument(argv[++i], numFrames);
+        else if(valid && arg == "--max-error")
+            valid = parseArgument(argv[++i], compression.maxError);
+        else
+            valid = false;
+        if(!valid)
+        {
+            LOG_ERROR("usage: {} [--instances N] [--bones N] [--frames N] [--max-error E]", argv[0]);
+            return 1;
+        }
+    }
+    numBones = std::max(numBones, 1u);
+
+    Model::Skeleton skeleton = makeSkeleton(numBones);
+    auto layout = SkeletonLayout::build(skeleton);
+    if(!layout)
+        return 1;
+    AnimationClip clip = AnimationClip::build(makeAnimation(skeleton, 4.0f, compression), skeleton);
+
+    // Laid out like the renderer's: every instance plays the clip from its own offset
+    std::vector<AnimationCursor> cursors(numInstances);
+    std::vector<BonePose> poses(size_t(numInstances) * numBones);
+    std::vector<glm::mat4> palettes(poses.size());
+
+    using Clock = std::chrono::steady_clock;
+    Clock::duration sampleTime{}, paletteTime{};
+    constexpr float FRAME_SECONDS = 1.0f / 60.0f;
+    for(unsigned frame = 0; frame < numFrames; ++frame)
+    {
+        auto start = Clock::now();
+        for(unsigned i = 0; i < numInstances; ++i)
+            clip.sample(clip.getTicks(frame * FRAME_SECONDS + i * 0.5f), cursors[i], std::span(poses).subspan(size_t(i) * numBones, numBones));
+        auto sampled = Clock::now();
+        computePalettes(*layout, poses, palettes);
+        auto end = Clock::now();
+        sampleTime += sampled - start;
+        paletteTime += end - sampled;
+    }
+
+    // Keeps the work from being optimized out
+    float checksum = 0.0f;
+    for(size_t i = 0; i < palettes.size(); i += numBones)
+        checksum += palettes[i][3][1];
+
+    auto perFrame = [&](Clock::duration time){ return std::chrono::duration<double, std::milli>(time).count() / std::max(numFrames, 1u); };
+    auto perBone = [&](Clock::duration time){ return std::chrono::duration<double, std::nano>(time).count() / std::max<double>(double(numFrames) * poses.size(), 1.0); };
+    LOG_INFO("{} instances of {} bones, {} frames, {} threads (checksum {})", numInstances, numBones, numFrames, ThreadPool::global().size(), checksum);
+    LOG_INFO("sample:          {:.3f} ms per frame, {:.2f} ns per bone", perFrame(sampleTime), perBone(sampleTime));
+    LOG_INFO("computePalettes: {:.3f} ms per frame, {:.2f} ns per bone", perFrame(paletteTime), perBone(paletteTime));
+    return 0;
+}
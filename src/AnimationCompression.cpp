@@ -0,0 +1,345 @@
+#include "AnimationCompression.hpp"
+#include "AnimationSampler.hpp"
+#include "Loaders.hpp"
+#include "Logging.hpp"
+#include "Skinning.hpp"
+#include "ThreadPool.hpp"
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+// The three smallest components of a unit quaternion are within +-1/sqrt(2), stored in 15 bits
+static constexpr float SMALLEST_THREE_RANGE = 0.70710678f;
+static constexpr float SMALLEST_THREE_STEPS = 32767.0f;
+// Leaf bones still move the skin around them, their error is measured this far out, relative to the skeleton size
+static constexpr float SHELL_DISTANCE = 0.05f;
+
+glm::u16vec3 packQuaternion(glm::quat q)
+{
+    glm::vec4 v{q.x, q.y, q.z, q.w};
+    float length = glm::length(v);
+    v = length > 0.0f ? v / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    unsigned largest = 0;
+    for(unsigned i = 1; i < 4; ++i)
+        if(std::abs(v[i]) > std::abs(v[largest]))
+            largest = i;
+    if(v[largest] < 0.0f)
+        v = -v;
+
+    glm::u16vec3 packed{0};
+    for(unsigned i = 0, j = 0; i < 4; ++i)
+    {
+        if(i == largest)
+            continue;
+        float unorm = std::clamp(v[i] / SMALLEST_THREE_RANGE * 0.5f + 0.5f, 0.0f, 1.0f);
+        packed[j++] = static_cast<uint16_t>(std::lround(unorm * SMALLEST_THREE_STEPS));
+    }
+    packed.x |= static_cast<uint16_t>((largest & 1) << 15);
+    packed.y |= static_cast<uint16_t>((largest >> 1) << 15);
+    return packed;
+}
+
+glm::quat unpackQuaternion(glm::u16vec3 packed)
+{
+    unsigned largest = (packed.x >> 15) | ((packed.y >> 15) << 1);
+    glm::vec4 v{0.0f};
+    float sum = 0.0f;
+    for(unsigned i = 0, j = 0; i < 4; ++i)
+    {
+        if(i == largest)
+            continue;
+        v[i] = ((packed[j++] & 0x7FFF) / SMALLEST_THREE_STEPS * 2.0f - 1.0f) * SMALLEST_THREE_RANGE;
+        sum += v[i] * v[i];
+    }
+    v[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+    v = glm::normalize(v);
+    return glm::quat(v.w, v.x, v.y, v.z);
+}
+
+glm::u16vec3 quantizeInRange(Animation::Range const &range, glm::vec3 value)
+{
+    glm::u16vec3 result{0};
+    for(int i = 0; i < 3; ++i)
+        if(range.extent[i] > 0.0f)
+            result[i] = static_cast<uint16_t>(std::lround(std::clamp((value[i] - range.min[i]) / range.extent[i], 0.0f, 1.0f) * 65535.0f));
+    return result;
+}
+
+static Animation::Range getRange(std::span<SourceKeyframes::Key<glm::vec3> const> keys)
+{
+    if(keys.empty())
+        return {};
+    glm::vec3 min = keys[0].value, max = keys[0].value;
+    for(auto const &key : keys)
+    {
+        min = glm::min(min, key.value);
+        max = glm::max(max, key.value);
+    }
+    return {.min = min, .extent = max - min};
+}
+
+/// @brief Normalized lerp along the shortest arc, what AnimationClip::sample interpolates orientations with.
+static glm::quat nlerp(glm::quat const &a, glm::quat b, float f)
+{
+    if(glm::dot(a, b) < 0.0f)
+        b = -b;
+    return glm::normalize(a * (1.0f - f) + b * f);
+}
+
+/// @brief The angle of the rotation from @p a to @p b. From the chord between them rather than their dot product,
+/// acos of a float near 1 can't tell apart angles below a milliradian.
+static float angleBetween(glm::quat const &a, glm::quat b)
+{
+    if(glm::dot(a, b) < 0.0f)
+        b = -b;
+    glm::vec4 chord{a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w};
+    return 4.0f * std::asin(std::min(1.0f, glm::length(chord) * 0.5f));
+}
+
+/// @brief The keys of a track to keep: the first, the last and every key that interpolating between the kept keys around
+/// it doesn't reproduce within @p tolerance. A track that stays within @p tolerance of its first key keeps only that one.
+/// @param decoded The values of the keys after quantization, what kept keys decode to.
+template<typename T, typename Mix, typename Error>
+static std::vector<uint32_t> reduceKeys(std::span<SourceKeyframes::Key<T> const> keys, std::vector<T> const &decoded, float tolerance, Mix mix, Error error)
+{
+    uint32_t count = static_cast<uint32_t>(keys.size());
+    std::vector<uint32_t> kept;
+    if(tolerance <= 0.0f || count <= 2)
+    {
+        for(uint32_t k = 0; k < count; ++k)
+            kept.push_back(k);
+        return kept;
+    }
+
+    bool constant = std::all_of(keys.begin(), keys.end(), [&](auto const &key){ return error(decoded[0], key.value) <= tolerance; });
+    kept.push_back(0);
+    if(constant)
+        return kept;
+
+    auto reproduces = [&](uint32_t first, uint32_t last){
+        float span = keys[last].timeTicks - keys[first].timeTicks;
+        for(uint32_t k = first + 1; k < last; ++k)
+        {
+            float f = span > 0.0f ? (keys[k].timeTicks - keys[first].timeTicks) / span : 0.0f;
+            if(error(mix(decoded[first], decoded[last], f), keys[k].value) > tolerance)
+                return false;
+        }
+        return true;
+    };
+    // Greedy: a segment grows until it misses a key, the key before that one ends it and starts the next
+    uint32_t anchor = 0;
+    for(uint32_t next = anchor + 2; next < count; ++next)
+    {
+        if(reproduces(anchor, next))
+            continue;
+        anchor = next - 1;
+        kept.push_back(anchor);
+    }
+    kept.push_back(count - 1);
+    return kept;
+}
+
+/// @brief How much an error in the local transform of a bone moves the skeleton in model space.
+struct BoneReach
+{
+    float parentScale = 1.0f; // local errors are scaled by the parent's transform
+    float extent = 0.0f; // distance to the farthest descendant, at least the shell distance
+    float tolerance = 0.0f; // the share of the error budget of every track of the bone
+};
+
+static glm::mat4 toMatrix(BonePose const &pose)
+{
+    glm::mat3 basis = glm::mat3_cast(pose.orientation);
+    return glm::mat4(glm::vec4(basis[0] * pose.scale.x, 0.0f), glm::vec4(basis[1] * pose.scale.y, 0.0f),
+                     glm::vec4(basis[2] * pose.scale.z, 0.0f), glm::vec4(pose.position, 1.0f));
+}
+
+/// @brief The model space transform of every bone, as the product of the local ones down from the roots.
+static void toModelSpace(SkeletonLayout const &layout, std::span<BonePose const> pose, std::vector<glm::mat4> &model)
+{
+    auto parents = layout.getParents();
+    model.resize(layout.getBoneCount());
+    for(uint32_t bone : layout.getOrder())
+        model[bone] = parents[bone] < 0 ? toMatrix(pose[bone]) : model[parents[bone]] * toMatrix(pose[bone]);
+}
+
+/// @brief The reach of every bone in the rest pose and the skeleton size.
+static std::vector<BoneReach> getReach(SkeletonLayout const &layout, std::span<BonePose const> restPose, float maxError, float &skeletonSize)
+{
+    size_t numBones = layout.getBoneCount();
+    auto parents = layout.getParents();
+    std::vector<glm::mat4> model;
+    toModelSpace(layout, restPose, model);
+
+    glm::vec3 center{0.0f};
+    for(auto const &transform : model)
+        center += glm::vec3(transform[3]) / static_cast<float>(numBones);
+    skeletonSize = 0.0f;
+    for(auto const &transform : model)
+        skeletonSize = std::max(skeletonSize, glm::distance(center, glm::vec3(transform[3])));
+    if(skeletonSize <= 0.0f)
+        skeletonSize = 1.0f;
+
+    // Errors of the bones on a chain add up, the chain shares the budget
+    std::vector<uint32_t> depth(numBones, 0), height(numBones, 0);
+    for(uint32_t bone : layout.getOrder())
+        if(parents[bone] >= 0)
+            depth[bone] = depth[parents[bone]] + 1;
+    auto order = layout.getOrder();
+    for(auto it = order.rbegin(); it != order.rend(); ++it)
+        if(parents[*it] >= 0)
+            height[parents[*it]] = std::max(height[parents[*it]], height[*it] + 1);
+
+    std::vector<BoneReach> reach(numBones);
+    for(size_t bone = 0; bone < numBones; ++bone)
+    {
+        reach[bone].extent = std::max(reach[bone].extent, SHELL_DISTANCE * skeletonSize);
+        for(int ancestor = parents[bone]; ancestor >= 0; ancestor = parents[ancestor])
+            reach[ancestor].extent = std::max(reach[ancestor].extent, glm::distance(glm::vec3(model[bone][3]), glm::vec3(model[ancestor][3])));
+        if(parents[bone] >= 0)
+        {
+            glm::mat4 const &parent = model[parents[bone]];
+            reach[bone].parentScale = std::max({glm::length(glm::vec3(parent[0])), glm::length(glm::vec3(parent[1])), glm::length(glm::vec3(parent[2]))});
+        }
+        reach[bone].tolerance = maxError * skeletonSize / static_cast<float>(depth[bone] + height[bone] + 1);
+    }
+    return reach;
+}
+
+/// @brief The value of a track at @p t the way AnimationClip::sample finds it, @p rest if the track has no keys.
+template<typename T, typename Mix>
+static T sampleTrack(std::vector<SourceKeyframes::Key<T>> const &keys, float t, T const &rest, Mix mix)
+{
+    if(keys.empty())
+        return rest;
+    auto next = std::upper_bound(keys.begin(), keys.end(), t, [](float t, auto const &key){ return t < key.timeTicks; });
+    if(next == keys.begin())
+        return keys.front().value;
+    if(next == keys.end())
+        return keys.back().value;
+    auto previous = next - 1;
+    float span = next->timeTicks - previous->timeTicks;
+    return mix(previous->value, next->value, span > 0.0f ? (t - previous->timeTicks) / span : 0.0f);
+}
+
+/// @brief The farthest any bone, or a point a shell distance away from it along one of its axes, is from where the
+/// source keys put it, over all the times of the source keys.
+static float measureError(std::span<SourceKeyframes const> bones, Animation const &animation, Model::Skeleton const &skeleton, SkeletonLayout const &layout, float shell)
+{
+    AnimationClip clip = AnimationClip::build(animation, skeleton);
+    auto restPose = clip.getRestPose();
+    std::vector<float> times;
+    for(auto const &bone : bones)
+    {
+        for(auto const &key : bone.positions) times.push_back(key.timeTicks);
+        for(auto const &key : bone.orientations) times.push_back(key.timeTicks);
+        for(auto const &key : bone.scales) times.push_back(key.timeTicks);
+    }
+    std::sort(times.begin(), times.end());
+    times.erase(std::unique(times.begin(), times.end()), times.end());
+
+    auto lerp = [](glm::vec3 const &a, glm::vec3 const &b, float f){ return glm::mix(a, b, f); };
+    AnimationCursor cursor;
+    std::vector<BonePose> sourcePose(restPose.begin(), restPose.end()), compressedPose(restPose.size());
+    std::vector<glm::mat4> sourceModel, compressedModel;
+    float maxError = 0.0f;
+    for(float t : times)
+    {
+        for(size_t bone = 0; bone < std::min(bones.size(), sourcePose.size()); ++bone)
+        {
+            sourcePose[bone].position = sampleTrack(bones[bone].positions, t, restPose[bone].position, lerp);
+            sourcePose[bone].orientation = sampleTrack(bones[bone].orientations, t, restPose[bone].orientation, nlerp);
+            sourcePose[bone].scale = sampleTrack(bones[bone].scales, t, restPose[bone].scale, lerp);
+        }
+        clip.sample(t, cursor, compressedPose);
+        toModelSpace(layout, sourcePose, sourceModel);
+        toModelSpace(layout, compressedPose, compressedModel);
+        for(size_t bone = 0; bone < sourceModel.size(); ++bone)
+        {
+            glm::mat4 const &a = sourceModel[bone], &b = compressedModel[bone];
+            maxError = std::max(maxError, glm::distance(glm::vec3(a[3]), glm::vec3(b[3])));
+            for(int axis = 0; axis < 3; ++axis)
+                maxError = std::max(maxError, glm::distance(glm::vec3(a[3] + a[axis] * shell), glm::vec3(b[3] + b[axis] * shell)));
+        }
+    }
+    return maxError;
+}
+
+AnimationCompressionStats compressAnimation(std::span<SourceKeyframes const> bones, Model::Skeleton const &skeleton, AnimationCompressionOptions const &options, Animation &animation)
+{
+    AnimationCompressionStats stats;
+    size_t numBones = skeleton.boneMap.size();
+    std::vector<BonePose> restPose(numBones);
+    for(size_t bone = 0; bone < std::min(numBones, skeleton.nodeTransform.size()); ++bone)
+        restPose[bone] = decomposeTransform(skeleton.nodeTransform[bone]);
+
+    // Without a hierarchy there is nothing to measure the error with, every key is kept
+    std::optional<SkeletonLayout> layout = SkeletonLayout::build(skeleton);
+    std::vector<BoneReach> reach(bones.size());
+    if(layout && bones.size() <= numBones)
+    {
+        std::vector<BoneReach> skeletonReach = getReach(*layout, restPose, options.maxError, stats.skeletonSize);
+        std::copy_n(skeletonReach.begin(), bones.size(), reach.begin());
+    }
+    else
+        LOG_WARN("Animation \"{}\" can't be measured against its skeleton, its keys are only quantized", animation.name);
+
+    animation.bones.assign(bones.size(), {});
+    ThreadPool::global().parallelFor(bones.size(), [&](size_t bone){
+        SourceKeyframes const &source = bones[bone];
+        Animation::Keyframes &keyframes = animation.bones[bone];
+        BoneReach const &r = reach[bone];
+        auto lerp = [](glm::vec3 const &a, glm::vec3 const &b, float f){ return glm::mix(a, b, f); };
+
+        keyframes.positionRange = getRange(source.positions);
+        std::vector<glm::u16vec3> packed(source.positions.size());
+        std::vector<glm::vec3> decoded(source.positions.size());
+        for(size_t k = 0; k < source.positions.size(); ++k)
+        {
+            packed[k] = quantizeInRange(keyframes.positionRange, source.positions[k].value);
+            decoded[k] = dequantizeInRange(keyframes.positionRange, packed[k]);
+        }
+        for(uint32_t k : reduceKeys<glm::vec3>(source.positions, decoded, r.tolerance, lerp,
+                [&](glm::vec3 const &a, glm::vec3 const &b){ return r.parentScale * glm::distance(a, b); }))
+            keyframes.positions.push_back({.value = packed[k], .timeTicks = source.positions[k].timeTicks});
+
+        keyframes.scaleRange = getRange(source.scales);
+        packed.resize(source.scales.size());
+        decoded.resize(source.scales.size());
+        for(size_t k = 0; k < source.scales.size(); ++k)
+        {
+            packed[k] = quantizeInRange(keyframes.scaleRange, source.scales[k].value);
+            decoded[k] = dequantizeInRange(keyframes.scaleRange, packed[k]);
+        }
+        for(uint32_t k : reduceKeys<glm::vec3>(source.scales, decoded, r.tolerance, lerp,
+                [&](glm::vec3 const &a, glm::vec3 const &b){ glm::vec3 d = glm::abs(a - b); return r.parentScale * r.extent * std::max({d.x, d.y, d.z}); }))
+            keyframes.scales.push_back({.value = packed[k], .timeTicks = source.scales[k].timeTicks});
+
+        packed.resize(source.orientations.size());
+        std::vector<glm::quat> decodedOrientations(source.orientations.size());
+        for(size_t k = 0; k < source.orientations.size(); ++k)
+        {
+            packed[k] = packQuaternion(source.orientations[k].value);
+            decodedOrientations[k] = unpackQuaternion(packed[k]);
+        }
+        for(uint32_t k : reduceKeys<glm::quat>(source.orientations, decodedOrientations, r.tolerance, nlerp,
+                [&](glm::quat const &a, glm::quat const &b){ return r.parentScale * r.extent * angleBetween(a, b); }))
+            keyframes.orientations.push_back({.value = packed[k], .timeTicks = source.orientations[k].timeTicks});
+    });
+
+    for(size_t bone = 0; bone < bones.size(); ++bone)
+    {
+        SourceKeyframes const &source = bones[bone];
+        Animation::Keyframes const &keyframes = animation.bones[bone];
+        stats.sourceKeys += source.positions.size() + source.orientations.size() + source.scales.size();
+        stats.keptKeys += keyframes.positions.size() + keyframes.orientations.size() + keyframes.scales.size();
+        stats.sourceBytes += (source.positions.size() + source.scales.size()) * sizeof(SourceKeyframes::Key<glm::vec3>)
+                           + source.orientations.size() * sizeof(SourceKeyframes::Key<glm::quat>);
+        stats.compressedBytes += keyframes.positions.size() * sizeof(Animation::PositionKey) + keyframes.orientations.size() * sizeof(Animation::OrientationKey)
+                               + keyframes.scales.size() * sizeof(Animation::ScaleKey) + 2 * sizeof(Animation::Range);
+    }
+    if(layout && bones.size() <= numBones)
+        stats.maxError = measureError(bones, animation, skeleton, *layout, SHELL_DISTANCE * stats.skeletonSize);
+    return stats;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "Model.hpp"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct AnimationCompressionOptions;
+
+/// @brief The keys of a bone as they are imported, before compression.
+struct SourceKeyframes
+{
+    template<typename T>
+    struct Key
+    {
+        T value;
+        float timeTicks;
+    };
+    std::vector<Key<glm::vec3>> positions;
+    std::vector<Key<glm::quat>> orientations;
+    std::vector<Key<glm::vec3>> scales;
+};
+
+struct AnimationCompressionStats
+{
+    size_t sourceKeys = 0;
+    size_t keptKeys = 0;
+    size_t sourceBytes = 0; // the keys as full floats
+    size_t compressedBytes = 0; // the kept keys and the ranges of their tracks
+    float maxError = 0; // the farthest a bone (or a point near it) moved from where the source puts it, in model units
+    float skeletonSize = 0; // what AnimationCompressionOptions::maxError is relative to
+};
+
+/// @brief Fill the tracks of @p animation from @p bones (sorted by time), one per bone of @p skeleton.
+/// Keys are quantized first: positions and scales to unorm16 within the range of their track, orientations with packQuaternion.
+/// Then every key that interpolating its kept neighbours reproduces within the tolerance is dropped. The tolerance is
+/// options.maxError of the skeleton size, split along each chain of bones and scaled by how far the bone reaches, so it
+/// holds for the bone positions in model space. The error of the result is measured at every source key time.
+AnimationCompressionStats compressAnimation(std::span<SourceKeyframes const> bones, Model::Skeleton const &skeleton, AnimationCompressionOptions const &options, Animation &animation);
+
+/// @brief Smallest three encoding of a rotation in 48 bits.
+/// The largest component is dropped (made positive, as q and -q are the same rotation) and the other three are stored
+/// in 15 bits each within [-1/sqrt(2), 1/sqrt(2)]. The index of the dropped component is in the top bits of x and y.
+glm::u16vec3 packQuaternion(glm::quat q);
+glm::quat unpackQuaternion(glm::u16vec3 packed);
+
+glm::u16vec3 quantizeInRange(Animation::Range const &range, glm::vec3 value);
+inline glm::vec3 dequantizeInRange(Animation::Range const &range, glm::u16vec3 value)
+{
+    return range.min + range.extent * (glm::vec3(value) / 65535.0f);
+}
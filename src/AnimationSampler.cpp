@@ -0,0 +1,168 @@
+#include "AnimationSampler.hpp"
+#include "AnimationCompression.hpp"
+#include "Logging.hpp"
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cassert>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ANIMATION_SAMPLER_X86
+#include <immintrin.h>
+#endif
+
+BonePose decomposeTransform(glm::mat4 const &m)
+{
+    BonePose pose;
+    pose.position = glm::vec3(m[3]);
+    glm::mat3 rotation{m};
+    for(int i = 0; i < 3; ++i)
+    {
+        pose.scale[i] = glm::length(rotation[i]);
+        if(pose.scale[i] > 0.0f)
+            rotation[i] /= pose.scale[i];
+    }
+    // A mirrored basis isn't a rotation, the mirror goes to the scale
+    if(glm::determinant(rotation) < 0.0f)
+    {
+        pose.scale.x = -pose.scale.x;
+        rotation[0] = -rotation[0];
+    }
+    pose.orientation = glm::normalize(glm::quat_cast(rotation));
+    return pose;
+}
+
+static glm::vec4 toVec4(glm::quat const &q)
+{
+    return {q.x, q.y, q.z, q.w};
+}
+
+AnimationClip AnimationClip::build(Animation const &animation, Model::Skeleton const &skeleton)
+{
+    AnimationClip clip;
+    clip.mName = animation.name;
+    clip.mDurationTicks = animation.durationTicks;
+    clip.mTicksPerSecond = animation.ticksPerSecond;
+
+    size_t numBones = skeleton.boneMap.size();
+    clip.mRestPose.resize(numBones);
+    for(size_t bone = 0; bone < std::min(numBones, skeleton.nodeTransform.size()); ++bone)
+        clip.mRestPose[bone] = decomposeTransform(skeleton.nodeTransform[bone]);
+    if(animation.bones.size() > numBones)
+        LOG_WARN("Animation \"{}\" has tracks for {} bones, the skeleton only {}", animation.name, animation.bones.size(), numBones);
+
+    // The keys are decoded once here, sampling reads floats
+    auto addTrack = [&clip](Track &track, auto const &keys, auto toValue){
+        track.offset = static_cast<uint32_t>(clip.mTimes.size());
+        track.count = static_cast<uint32_t>(keys.size());
+        for(auto const &key : keys)
+        {
+            clip.mTimes.push_back(key.timeTicks);
+            clip.mValues.push_back(toValue(key.value));
+        }
+        while(clip.mTimes.size() % KEY_ALIGNMENT != 0)
+        {
+            clip.mTimes.push_back(clip.mTimes.back());
+            clip.mValues.push_back(clip.mValues.back());
+        }
+    };
+    clip.mTracks.resize(numBones * NUM_CHANNELS);
+    for(size_t bone = 0; bone < std::min(numBones, animation.bones.size()); ++bone)
+    {
+        auto const &keyframes = animation.bones[bone];
+        Track *tracks = &clip.mTracks[bone * NUM_CHANNELS];
+        addTrack(tracks[position], keyframes.positions, [&](glm::u16vec3 v){ return glm::vec4(dequantizeInRange(keyframes.positionRange, v), 0.0f); });
+        addTrack(tracks[orientation], keyframes.orientations, [](glm::u16vec3 q){ return toVec4(unpackQuaternion(q)); });
+        addTrack(tracks[scale], keyframes.scales, [&](glm::u16vec3 v){ return glm::vec4(dequantizeInRange(keyframes.scaleRange, v), 0.0f); });
+    }
+    // Searches load KEY_ALIGNMENT times after any key, the last track reads these. No time is ever past them.
+    clip.mTimes.resize(clip.mTimes.size() + KEY_ALIGNMENT, std::numeric_limits<float>::max());
+    return clip;
+}
+
+/// @brief The key i of a track of @p count > 1 keys with times[i] <= t < times[i + 1], clamped to [0, count - 2].
+/// @param hint Where the previous search ended. Playback moving forward finds its key within a few of it, comparing
+/// four times at once. Anything else (a seek, a loop) falls back to a binary search.
+static uint32_t findKey(float const *times, uint32_t count, float t, uint32_t hint)
+{
+    uint32_t const last = count - 2;
+    hint = std::min(hint, last);
+    if(times[hint] <= t)
+    {
+#ifdef ANIMATION_SAMPLER_X86
+        __m128 tt = _mm_set1_ps(t);
+        for(unsigned step = 0; step < 2 && hint < last && times[hint + 1] <= t; ++step)
+        {
+            // The times passed in a row. Loads reaching into the next track can only add to a run that already
+            // passed the last key, which the clamp takes back.
+            unsigned passed = static_cast<unsigned>(_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(times + hint + 1), tt)));
+            hint = std::min(hint + std::countr_one(passed), last);
+        }
+#else
+        for(unsigned step = 0; step < 8 && hint < last && times[hint + 1] <= t; ++step)
+            ++hint;
+#endif
+        if(hint == last || t < times[hint + 1])
+            return hint;
+    }
+    auto next = std::upper_bound(times, times + count, t);
+    return static_cast<uint32_t>(std::clamp<ptrdiff_t>(next - times - 1, 0, last));
+}
+
+void AnimationClip::sample(float timeTicks, AnimationCursor &cursor, std::span<BonePose> pose) const
+{
+    assert(pose.size() >= mRestPose.size() && "a pose has a transform for every bone");
+    if(cursor.keys.size() != mTracks.size())
+        cursor.keys.assign(mTracks.size(), 0);
+
+    // Interpolate a track, false if it has no keys
+    auto interpolate = [&](Track const &track, uint32_t &key, bool rotation, glm::vec4 &out){
+        if(track.count == 0)
+            return false;
+        glm::vec4 const *values = mValues.data() + track.offset;
+        if(track.count == 1)
+        {
+            out = values[0];
+            return true;
+        }
+        float const *times = mTimes.data() + track.offset;
+        uint32_t i = key = findKey(times, track.count, timeTicks, key);
+        float span = times[i + 1] - times[i];
+        float f = span > 0.0f ? std::clamp((timeTicks - times[i]) / span, 0.0f, 1.0f) : 0.0f;
+        glm::vec4 a = values[i], b = values[i + 1];
+        if(!rotation)
+            out = glm::mix(a, b, f);
+        else
+            out = glm::normalize(glm::mix(a, glm::dot(a, b) < 0.0f ? -b : b, f));
+        return true;
+    };
+
+    for(size_t bone = 0; bone < mRestPose.size(); ++bone)
+    {
+        Track const *tracks = &mTracks[bone * NUM_CHANNELS];
+        uint32_t *keys = &cursor.keys[bone * NUM_CHANNELS];
+        BonePose &out = pose[bone];
+        out = mRestPose[bone];
+        glm::vec4 value;
+        if(interpolate(tracks[position], keys[position], false, value))
+            out.position = glm::vec3(value);
+        if(interpolate(tracks[orientation], keys[orientation], true, value))
+            out.orientation = glm::quat(value.w, value.x, value.y, value.z);
+        if(interpolate(tracks[scale], keys[scale], false, value))
+            out.scale = glm::vec3(value);
+    }
+}
+
+float AnimationClip::getTicks(float seconds, bool loop) const
+{
+    // Assimp leaves the rate 0 when the file doesn't have one, its documentation suggests 25
+    float ticks = seconds * (mTicksPerSecond > 0.0f ? mTicksPerSecond : 25.0f);
+    if(mDurationTicks <= 0.0f)
+        return 0.0f;
+    if(!loop)
+        return std::clamp(ticks, 0.0f, mDurationTicks);
+    ticks = std::fmod(ticks, mDurationTicks);
+    return ticks < 0.0f ? ticks + mDurationTicks : ticks;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "Model.hpp"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief Transform of a bone relative to its parent.
+struct BonePose
+{
+    glm::vec3 position{0.0f};
+    glm::quat orientation{1.0f, 0.0f, 0.0f, 0.0f};
+    glm::vec3 scale{1.0f};
+};
+
+/// @brief Split an affine transform into translation, rotation and scale. Shear is lost.
+BonePose decomposeTransform(glm::mat4 const &transform);
+
+/// @brief Where an instance is in a clip: the key every track was at when it was last sampled.
+/// Sequential playback finds the next keys a step or two from these instead of searching every track.
+/// One per playing instance, it is sized by the first sample.
+struct AnimationCursor
+{
+    std::vector<uint32_t> keys; // per track, relative to its first key
+};
+
+/// @brief An Animation laid out for sampling whole skeletons.
+/// The keys of all tracks are stored together with times and values in separate arrays: the times are searched
+/// without loading values, four at a time. Every track is padded to a multiple of KEY_ALIGNMENT keys by repeating its last one.
+/// Values are vec4s, xyz for positions and scales, a quaternion for orientations.
+class AnimationClip
+{
+public:
+    static constexpr uint32_t KEY_ALIGNMENT = 4;
+    enum Channel : uint32_t
+    {
+        position,
+        orientation,
+        scale,
+        NUM_CHANNELS
+    };
+    struct Track
+    {
+        uint32_t offset = 0; // first key in mTimes and mValues
+        uint32_t count = 0; // keys without padding, 0 if the bone keeps its rest pose
+    };
+private:
+    std::vector<float> mTimes; // ticks
+    std::vector<glm::vec4> mValues;
+    std::vector<Track> mTracks; // NUM_CHANNELS per bone
+    std::vector<BonePose> mRestPose;
+    std::string mName;
+    float mDurationTicks = 0;
+    float mTicksPerSecond = 0;
+public:
+    /// @brief Convert @p animation of a model with @p skeleton.
+    /// Bones the animation doesn't move keep their rest pose, the node transform of the skeleton.
+    static AnimationClip build(Animation const &animation, Model::Skeleton const &skeleton);
+
+    /// @brief The local pose of every bone at @p timeTicks, clamped to the first and last keys of each track.
+    /// Positions and scales are interpolated linearly, orientations with a normalized lerp along the shortest arc.
+    /// @param cursor Where the previous sample of this instance left the tracks, updated to where this one leaves them.
+    /// @param pose One per bone of the skeleton the clip was built for.
+    void sample(float timeTicks, AnimationCursor &cursor, std::span<BonePose> pose) const;
+
+    /// @brief @p seconds of playback in ticks, wrapped around the duration when @p loop is set and clamped to it otherwise.
+    float getTicks(float seconds, bool loop = true) const;
+
+    inline size_t getBoneCount() const { return mRestPose.size(); }
+    inline std::span<BonePose const> getRestPose() const { return mRestPose; }
+    inline std::string_view getName() const { return mName; }
+    inline float getDurationTicks() const { return mDurationTicks; }
+};
@@ -0,0 +1,137 @@
+#include "AssetCache.hpp"
+#include "Logging.hpp"
+#include <filesystem>
+
+AssetCache &AssetCache::of(ecs::registry &reg)
+{
+    for(ecs::entity e : reg.view<AssetCache>())
+        return reg.get<AssetCache>(e);
+    return reg.get<AssetCache>(reg.create(AssetCache{}));
+}
+
+std::string AssetCache::canonicalize(std::string_view path)
+{
+    std::filesystem::path p{path};
+    std::error_code ec;
+    if(std::filesystem::is_regular_file(p, ec))
+    {
+        auto canonical = std::filesystem::weakly_canonical(p, ec);
+        if(!ec)
+            return canonical.generic_string();
+    }
+    return p.lexically_normal().generic_string();
+}
+
+AssetCache::PathId AssetCache::intern(std::string_view path)
+{
+    std::string canonical = canonicalize(path);
+    if(auto it = mPathIds.find(canonical); it != mPathIds.end())
+        return it->second;
+    PathId id = static_cast<PathId>(mPaths.size());
+    mPaths.push_back(canonical);
+    mPathIds.emplace(std::move(canonical), id);
+    return id;
+}
+std::string_view AssetCache::getPath(PathId id) const
+{
+    return id < mPaths.size() ? std::string_view{mPaths[id]} : std::string_view{};
+}
+
+ecs::entity AssetCache::find(AssetKind kind, std::string_view path, uint64_t variant) const
+{
+    auto id = mPathIds.find(canonicalize(path));
+    if(id == mPathIds.end())
+        return INVALID_ENTITY;
+    auto const &byPath = mByPath[static_cast<size_t>(kind)];
+    auto it = byPath.find({id->second, variant});
+    return it == byPath.end() ? INVALID_ENTITY : it->second;
+}
+ecs::entity AssetCache::findByContent(AssetKind kind, uint64_t contentHash) const
+{
+    auto const &byContent = mByContent[static_cast<size_t>(kind)];
+    auto it = byContent.find(contentHash);
+    return it == byContent.end() ? INVALID_ENTITY : it->second;
+}
+ecs::entity AssetCache::acquire(AssetKind kind, std::string_view path, uint64_t variant)
+{
+    ecs::entity e = find(kind, path, variant);
+    if(e)
+    {
+        ++mEntries.at(e).refCount;
+        ++mStatistics[static_cast<size_t>(kind)].pathHits;
+    }
+    return e;
+}
+ecs::entity AssetCache::acquireByContent(AssetKind kind, uint64_t contentHash, std::string_view path, uint64_t variant)
+{
+    ecs::entity e = contentHash ? findByContent(kind, contentHash) : INVALID_ENTITY;
+    if(!e)
+        return INVALID_ENTITY;
+    ++mEntries.at(e).refCount;
+    ++mStatistics[static_cast<size_t>(kind)].contentHits;
+    // The asset keeps the path it was loaded from, this one only leads to it
+    if(!path.empty())
+        mByPath[static_cast<size_t>(kind)].try_emplace(PathKey{intern(path), variant}, e);
+    return e;
+}
+
+void AssetCache::insert(AssetKind kind, std::string_view path, ecs::entity entity, uint64_t contentHash, uint64_t variant)
+{
+    if(!entity)
+        return;
+    if(mEntries.contains(entity))
+    {
+        LOG_WARN("Asset e{} (\"{}\") is already cached", entity, path);
+        return;
+    }
+    PathId id = path.empty() ? INVALID_PATH : intern(path);
+    mEntries.emplace(entity, Entry{.kind = kind, .path = id, .variant = variant, .contentHash = contentHash, .refCount = 1});
+    ++mStatistics[static_cast<size_t>(kind)].loads;
+    // A newer asset with the same path or contents shadows the older one
+    if(id != INVALID_PATH)
+        mByPath[static_cast<size_t>(kind)][{id, variant}] = entity;
+    if(contentHash)
+        mByContent[static_cast<size_t>(kind)][contentHash] = entity;
+}
+
+uint32_t AssetCache::release(ecs::entity entity)
+{
+    auto it = mEntries.find(entity);
+    if(it == mEntries.end() || it->second.refCount == 0)
+    {
+        LOG_WARN("Releasing asset e{} that isn't referenced", entity);
+        return 0;
+    }
+    return --it->second.refCount;
+}
+
+AssetCache::Entry const *AssetCache::getEntry(ecs::entity entity) const
+{
+    auto it = mEntries.find(entity);
+    return it == mEntries.end() ? nullptr : &it->second;
+}
+
+bool AssetCache::evict(ecs::entity entity)
+{
+    auto it = mEntries.find(entity);
+    if(it == mEntries.end())
+        return false;
+    Entry const &entry = it->second;
+    // Besides its own path, paths of the same contents may lead to it
+    std::erase_if(mByPath[static_cast<size_t>(entry.kind)], [entity](auto const &path){ return path.second == entity; });
+    auto &byContent = mByContent[static_cast<size_t>(entry.kind)];
+    if(auto content = byContent.find(entry.contentHash); entry.contentHash && content != byContent.end() && content->second == entity)
+        byContent.erase(content);
+    mEntries.erase(it);
+    return true;
+}
+std::vector<ecs::entity> AssetCache::evictUnused()
+{
+    std::vector<ecs::entity> unused;
+    for(auto const &[entity, entry] : mEntries)
+        if(entry.refCount == 0)
+            unused.push_back(entity);
+    for(ecs::entity entity : unused)
+        evict(entity);
+    return unused;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "nicecs/ecs.hpp"
+#include "Model.hpp"
+#include <array>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class AssetKind : uint8_t
+{
+    texture,
+    model,
+};
+
+/// @brief Index of the assets loaded into a registry, by path and optionally by content hash.
+/// Paths are canonicalized and interned once, lookups are hash map finds instead of scans over every entity.
+/// A registry has one cache shared by all the loaders working on it, see of().
+/// The same path can be loaded in several variants (a texture with other load options for example), each is its own asset.
+/// Entries are reference counted: every load that returns an asset holds a reference until release().
+/// Evicting only forgets an asset, destroying its entity is up to the caller.
+class AssetCache
+{
+public:
+    using PathId = uint32_t;
+    static constexpr PathId INVALID_PATH = UINT32_MAX;
+
+    struct Entry
+    {
+        AssetKind kind;
+        PathId path = INVALID_PATH;
+        uint64_t variant = 0; // of the path, see insert()
+        uint64_t contentHash = 0; // 0 if not known
+        uint32_t refCount = 0;
+    };
+    /// @brief What the cache saved, counted since it was created.
+    struct Statistics
+    {
+        uint32_t loads = 0; // assets inserted, loaded for real
+        uint32_t pathHits = 0; // loads served by an asset of the same path
+        uint32_t contentHits = 0; // loads served by an asset with the same contents under another path
+    };
+private:
+    struct StringHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+    };
+    // A path and the variant of it that was loaded
+    using PathKey = std::pair<PathId, uint64_t>;
+    struct PathKeyHash
+    {
+        size_t operator()(PathKey const &key) const { return std::hash<uint64_t>{}(key.second ^ (uint64_t(key.first) * 0x9e3779b97f4a7c15ull)); }
+    };
+    static constexpr size_t NUM_KINDS = 2;
+
+    std::vector<std::string> mPaths; // indexed by PathId
+    std::unordered_map<std::string, PathId, StringHash, std::equal_to<>> mPathIds;
+    std::unordered_map<ecs::entity, Entry> mEntries;
+    std::array<std::unordered_map<PathKey, ecs::entity, PathKeyHash>, NUM_KINDS> mByPath;
+    std::array<std::unordered_map<uint64_t, ecs::entity>, NUM_KINDS> mByContent;
+    std::array<Statistics, NUM_KINDS> mStatistics;
+public:
+    /// @brief The cache of @p reg, created on first use.
+    static AssetCache &of(ecs::registry &reg);
+
+    /// @brief Absolute, normalized, with symlinks resolved and forward slashes.
+    /// Paths that don't name a file (like "default/white") are only normalized.
+    static std::string canonicalize(std::string_view path);
+
+    /// @brief Canonicalize @p path and intern it.
+    PathId intern(std::string_view path);
+    std::string_view getPath(PathId id) const;
+
+    /// @brief The asset loaded from @p path as @p variant, INVALID_ENTITY if there is none. Doesn't add a reference.
+    ecs::entity find(AssetKind kind, std::string_view path, uint64_t variant = 0) const;
+    /// @brief The asset whose contents hash to @p contentHash, INVALID_ENTITY if there is none. Doesn't add a reference.
+    ecs::entity findByContent(AssetKind kind, uint64_t contentHash) const;
+    /// @brief find() and add a reference to the asset if there is one.
+    ecs::entity acquire(AssetKind kind, std::string_view path, uint64_t variant = 0);
+    /// @brief findByContent() and add a reference to the asset if there is one.
+    /// @param path Where the contents were loaded from, indexed as another path of the asset so the next load of it is a path hit.
+    /// Empty for contents that don't come from a file.
+    ecs::entity acquireByContent(AssetKind kind, uint64_t contentHash, std::string_view path = {}, uint64_t variant = 0);
+
+    /// @brief Index a freshly loaded asset, holding one reference for whoever asked for the load.
+    /// @param path Empty for assets that don't come from a file, they can only be found by content.
+    /// @param contentHash Hash of the contents, 0 if not known.
+    /// @param variant Tells apart assets loaded differently from the same path, like a hash of the load options. 0 for the plain asset.
+    void insert(AssetKind kind, std::string_view path, ecs::entity entity, uint64_t contentHash = 0, uint64_t variant = 0);
+
+    /// @brief Drop a reference to @p entity.
+    /// @return The references left.
+    uint32_t release(ecs::entity entity);
+
+    /// @brief The entry of @p entity, nullptr if it isn't cached.
+    Entry const *getEntry(ecs::entity entity) const;
+
+    /// @brief Forget @p entity. Its path stays interned.
+    /// @return false if it wasn't cached.
+    bool evict(ecs::entity entity);
+    /// @brief Forget every asset nothing references.
+    /// @return Their entities, for the caller to destroy.
+    std::vector<ecs::entity> evictUnused();
+
+    inline size_t size() const { return mEntries.size(); }
+    inline Statistics const &getStatistics(AssetKind kind) const { return mStatistics[static_cast<size_t>(kind)]; }
+};
@@ -0,0 +1,350 @@
+#include "Ktx.hpp"
+#include "Logging.hpp"
+#include "Serialization.hpp"
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+static constexpr std::array<unsigned char, 12> KTX2_IDENTIFIER = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+static constexpr size_t KTX2_HEADER_SIZE = 80; // identifier, header and index
+static constexpr size_t KTX2_LEVEL_INDEX_ENTRY_SIZE = 24;
+
+/// @brief A VkFormat the container may hold, the loaders don't depend on Vulkan so the values are spelled out.
+struct KtxFormat
+{
+    uint32_t vkFormat;
+    TextureFormat format;
+    unsigned numComponents; // of uncompressed formats
+    bool srgb;
+};
+static constexpr KtxFormat KTX_FORMATS[] = {
+    {9,   TextureFormat::uncompressed, 1, false}, // VK_FORMAT_R8_UNORM
+    {15,  TextureFormat::uncompressed, 1, true }, // VK_FORMAT_R8_SRGB
+    {16,  TextureFormat::uncompressed, 2, false}, // VK_FORMAT_R8G8_UNORM
+    {22,  TextureFormat::uncompressed, 2, true }, // VK_FORMAT_R8G8_SRGB
+    {23,  TextureFormat::uncompressed, 3, false}, // VK_FORMAT_R8G8B8_UNORM
+    {29,  TextureFormat::uncompressed, 3, true }, // VK_FORMAT_R8G8B8_SRGB
+    {37,  TextureFormat::uncompressed, 4, false}, // VK_FORMAT_R8G8B8A8_UNORM
+    {43,  TextureFormat::uncompressed, 4, true }, // VK_FORMAT_R8G8B8A8_SRGB
+    {133, TextureFormat::bc1, 0, false}, // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+    {134, TextureFormat::bc1, 0, true }, // VK_FORMAT_BC1_RGBA_SRGB_BLOCK
+    {131, TextureFormat::bc1, 0, false}, // VK_FORMAT_BC1_RGB_UNORM_BLOCK, read only
+    {132, TextureFormat::bc1, 0, true }, // VK_FORMAT_BC1_RGB_SRGB_BLOCK, read only
+    {137, TextureFormat::bc3, 0, false}, // VK_FORMAT_BC3_UNORM_BLOCK
+    {138, TextureFormat::bc3, 0, true }, // VK_FORMAT_BC3_SRGB_BLOCK
+    {139, TextureFormat::bc4, 0, false}, // VK_FORMAT_BC4_UNORM_BLOCK
+    {141, TextureFormat::bc5, 0, false}, // VK_FORMAT_BC5_UNORM_BLOCK
+    {145, TextureFormat::bc7, 0, false}, // VK_FORMAT_BC7_UNORM_BLOCK
+    {146, TextureFormat::bc7, 0, true }, // VK_FORMAT_BC7_SRGB_BLOCK
+};
+
+static KtxFormat const *findFormat(uint32_t vkFormat)
+{
+    for(auto const &format : KTX_FORMATS)
+        if(format.vkFormat == vkFormat)
+            return &format;
+    return nullptr;
+}
+static KtxFormat const *findFormat(TextureFormat textureFormat, unsigned numComponents, bool srgb)
+{
+    for(auto const &format : KTX_FORMATS)
+        if(format.format == textureFormat && format.srgb == srgb && (textureFormat != TextureFormat::uncompressed || format.numComponents == numComponents))
+            return &format;
+    // Formats without an sRGB variant
+    for(auto const &format : KTX_FORMATS)
+        if(format.format == textureFormat && textureFormat != TextureFormat::uncompressed)
+            return &format;
+    return nullptr;
+}
+
+/// @brief Bytes of one texel block: a pixel, or 4x4 pixels of compressed formats.
+static unsigned getTexelBlockSize(KtxFormat const &format)
+{
+    return format.format == TextureFormat::uncompressed ? format.numComponents : getBlockSize(format.format);
+}
+static size_t getLevelByteLength(KtxFormat const &format, glm::uvec2 size)
+{
+    if(format.format == TextureFormat::uncompressed)
+        return size_t(size.x) * size.y * format.numComponents;
+    return size_t((size.x + 3) / 4) * ((size.y + 3) / 4) * getBlockSize(format.format);
+}
+
+bool isKtx2(std::span<unsigned char const> data)
+{
+    return data.size() >= KTX2_IDENTIFIER.size() && std::equal(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), data.begin());
+}
+
+/// @brief The Basic Data Format Descriptor of @p format, the KHR Data Format spec describes the fields.
+static void writeDfd(BinaryWriter &writer, KtxFormat const &format)
+{
+    struct Sample
+    {
+        uint16_t bitOffset;
+        uint8_t bitLength;
+        uint8_t channel;
+    };
+    constexpr uint8_t CHANNEL_ALPHA = 15, QUALIFIER_LINEAR = 1 << 4;
+    std::vector<Sample> samples;
+    uint8_t colorModel = 1; // RGBSDA
+    uint8_t blockDimension = 0;
+    uint32_t upper = 255;
+    switch(format.format)
+    {
+    case TextureFormat::uncompressed:
+        for(unsigned c = 0; c < format.numComponents; ++c)
+            samples.push_back({uint16_t(c * 8), 8, uint8_t(c == 3 ? CHANNEL_ALPHA : c)});
+        break;
+    case TextureFormat::bc1: colorModel = 128; samples = {{0, 64, 0}}; break;
+    case TextureFormat::bc3: colorModel = 130; samples = {{0, 64, CHANNEL_ALPHA}, {64, 64, 0}}; break;
+    case TextureFormat::bc4: colorModel = 131; samples = {{0, 64, 0}}; break;
+    case TextureFormat::bc5: colorModel = 132; samples = {{0, 64, 0}, {64, 64, 1}}; break;
+    case TextureFormat::bc7: colorModel = 134; samples = {{0, 128, 0}}; break;
+    }
+    if(format.format != TextureFormat::uncompressed)
+    {
+        blockDimension = 3; // 4x4, stored minus one
+        upper = UINT32_MAX;
+    }
+
+    uint16_t blockSize = 24 + 16 * samples.size();
+    writer.write<uint32_t>(4 + blockSize); // dfdTotalSize
+    writer.write<uint32_t>(0); // vendorId and descriptorType: Khronos, basic
+    writer.write<uint16_t>(2); // versionNumber
+    writer.write<uint16_t>(blockSize);
+    writer.write<uint8_t>(colorModel);
+    writer.write<uint8_t>(1); // colorPrimaries: BT.709
+    writer.write<uint8_t>(format.srgb ? 2 : 1); // transferFunction: sRGB or linear
+    writer.write<uint8_t>(0); // flags: straight alpha
+    writer.write(std::array<uint8_t, 4>{blockDimension, blockDimension, 0, 0});
+    writer.write(std::array<uint8_t, 8>{uint8_t(getTexelBlockSize(format))});
+    for(auto const &sample : samples)
+    {
+        bool linear = format.srgb && sample.channel == CHANNEL_ALPHA;
+        writer.write<uint16_t>(sample.bitOffset);
+        writer.write<uint8_t>(sample.bitLength - 1);
+        writer.write<uint8_t>(sample.channel | (linear ? QUALIFIER_LINEAR : 0));
+        writer.write<uint32_t>(0); // samplePosition
+        writer.write<uint32_t>(0); // sampleLower
+        writer.write<uint32_t>(upper);
+    }
+}
+
+static void writeKeyValue(BinaryWriter &writer, std::string_view key, std::string_view value)
+{
+    writer.write<uint32_t>(key.size() + value.size() + 2);
+    writer.buffer.insert(writer.buffer.end(), key.begin(), key.end());
+    writer.write<char>(0);
+    writer.buffer.insert(writer.buffer.end(), value.begin(), value.end());
+    writer.write<char>(0);
+    writer.align(4);
+}
+
+bool writeKtx2(std::string_view path, Texture const &texture, bool flipped)
+{
+    bool compressed = texture.format != TextureFormat::uncompressed;
+    KtxFormat const *format = findFormat(texture.format, texture.bitmap.numComponents, texture.srgb);
+    if(!format || (!compressed && texture.bitmap.pixels.empty()))
+    {
+        LOG_ERROR("can't write texture \"{}\" as KTX2: unsupported format", texture.path);
+        return false;
+    }
+    // Without CPU levels the mips are left to whoever loads the file, level count 0 says so
+    unsigned numLevels = texture.getLevelCount();
+    uint32_t levelCount = !compressed && texture.levels.empty() && texture.numMipLevels > 1 ? 0 : numLevels;
+
+    BinaryWriter dfd;
+    writeDfd(dfd, *format);
+    BinaryWriter kvd;
+    writeKeyValue(kvd, "KTXorientation", flipped ? "ru" : "rd");
+    writeKeyValue(kvd, "KTXwriter", "levulkan");
+
+    size_t dfdOffset = KTX2_HEADER_SIZE + numLevels * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+    size_t kvdOffset = dfdOffset + dfd.buffer.size();
+    size_t alignment = std::lcm<size_t>(getTexelBlockSize(*format), 4);
+    // The levels are stored smallest first
+    std::vector<std::span<unsigned char const>> levels(numLevels);
+    std::vector<size_t> levelOffsets(numLevels);
+    size_t offset = kvdOffset + kvd.buffer.size();
+    for(unsigned level = numLevels; level-- > 0;)
+    {
+        levels[level] = compressed ? texture.getCompressedLevel(level) : texture.getLevel(level);
+        if(levels[level].size() != getLevelByteLength(*format, texture.getLevelSize(level)))
+        {
+            LOG_ERROR("can't write texture \"{}\" as KTX2: level {} has {} bytes", texture.path, level, levels[level].size());
+            return false;
+        }
+        offset = (offset + alignment - 1) / alignment * alignment;
+        levelOffsets[level] = offset;
+        offset += levels[level].size();
+    }
+
+    BinaryWriter writer;
+    writer.write(KTX2_IDENTIFIER);
+    writer.write<uint32_t>(format->vkFormat);
+    writer.write<uint32_t>(1); // typeSize
+    writer.write<uint32_t>(texture.bitmap.size.x);
+    writer.write<uint32_t>(texture.bitmap.size.y);
+    writer.write<uint32_t>(0); // pixelDepth
+    writer.write<uint32_t>(0); // layerCount
+    writer.write<uint32_t>(1); // faceCount
+    writer.write<uint32_t>(levelCount);
+    writer.write<uint32_t>(0); // supercompressionScheme
+    writer.write<uint32_t>(dfdOffset);
+    writer.write<uint32_t>(dfd.buffer.size());
+    writer.write<uint32_t>(kvdOffset);
+    writer.write<uint32_t>(kvd.buffer.size());
+    writer.write<uint64_t>(0); // sgdByteOffset
+    writer.write<uint64_t>(0); // sgdByteLength
+    for(unsigned level = 0; level < numLevels; ++level)
+    {
+        writer.write<uint64_t>(levelOffsets[level]);
+        writer.write<uint64_t>(levels[level].size());
+        writer.write<uint64_t>(levels[level].size()); // uncompressedByteLength
+    }
+    writer.buffer.insert(writer.buffer.end(), dfd.buffer.begin(), dfd.buffer.end());
+    writer.buffer.insert(writer.buffer.end(), kvd.buffer.begin(), kvd.buffer.end());
+    for(unsigned level = numLevels; level-- > 0;)
+    {
+        writer.buffer.resize(levelOffsets[level], 0);
+        writer.buffer.insert(writer.buffer.end(), levels[level].begin(), levels[level].end());
+    }
+
+    std::ofstream file(std::string{path}, std::ios::binary | std::ios::trunc);
+    if(!file.is_open())
+    {
+        LOG_ERROR("can't open \"{}\" for writing", path);
+        return false;
+    }
+    file.write(writer.buffer.data(), writer.buffer.size());
+    return static_cast<bool>(file);
+}
+
+/// @brief Whether the KTXorientation entry of the key/value data says the rows go up.
+static bool isBottomUp(std::span<char const> kvd)
+{
+    BinaryReader reader(kvd);
+    while(reader.ok && reader.offset() < kvd.size())
+    {
+        uint32_t length = reader.read<uint32_t>();
+        size_t start = reader.offset();
+        if(!reader.ok || length > kvd.size() - start)
+            break;
+        std::string_view entry{kvd.data() + start, length};
+        constexpr std::string_view KEY{"KTXorientation\0", 15};
+        if(entry.starts_with(KEY) && entry.size() > KEY.size() + 1)
+            return entry[KEY.size() + 1] == 'u';
+        reader.seek((start + length + 3) / 4 * 4);
+    }
+    return false;
+}
+
+std::optional<glm::uvec2> getKtx2Size(std::span<unsigned char const> data)
+{
+    if(!isKtx2(data) || data.size() < KTX2_HEADER_SIZE)
+        return std::nullopt;
+    BinaryReader reader({reinterpret_cast<char const *>(data.data()), data.size()});
+    reader.seek(KTX2_IDENTIFIER.size() + 2 * sizeof(uint32_t)); // vkFormat, typeSize
+    return reader.read<glm::uvec2>();
+}
+
+std::optional<Texture> readKtx2(std::span<unsigned char const> data, bool flip, unsigned skipLevels)
+{
+    if(!isKtx2(data) || data.size() < KTX2_HEADER_SIZE)
+    {
+        LOG_ERROR("not a KTX2 file");
+        return std::nullopt;
+    }
+    std::span<char const> bytes{reinterpret_cast<char const *>(data.data()), data.size()};
+    BinaryReader reader(bytes);
+    reader.seek(KTX2_IDENTIFIER.size());
+    uint32_t vkFormat = reader.read<uint32_t>();
+    reader.read<uint32_t>(); // typeSize
+    glm::uvec2 size = reader.read<glm::uvec2>();
+    uint32_t pixelDepth = reader.read<uint32_t>();
+    uint32_t layerCount = reader.read<uint32_t>();
+    uint32_t faceCount = reader.read<uint32_t>();
+    uint32_t levelCount = reader.read<uint32_t>();
+    uint32_t supercompression = reader.read<uint32_t>();
+    reader.read<uint32_t>(); // dfdByteOffset
+    reader.read<uint32_t>(); // dfdByteLength
+    uint32_t kvdOffset = reader.read<uint32_t>();
+    uint32_t kvdLength = reader.read<uint32_t>();
+
+    KtxFormat const *format = findFormat(vkFormat);
+    if(!format)
+    {
+        LOG_ERROR("unsupported KTX2 format: VkFormat {}", vkFormat);
+        return std::nullopt;
+    }
+    if(size.x == 0 || size.y == 0 || pixelDepth != 0 || layerCount > 1 || faceCount != 1 || supercompression != 0)
+    {
+        LOG_ERROR("unsupported KTX2 file: only 2D textures without supercompression are read");
+        return std::nullopt;
+    }
+    unsigned numLevels = std::max(levelCount, 1u);
+    if(numLevels > getMipLevelCount(size))
+    {
+        LOG_ERROR("invalid KTX2 file: {} levels for {}x{}", numLevels, size.x, size.y);
+        return std::nullopt;
+    }
+
+    // The levels are read from the first one kept, the ones before it stay in the file
+    skipLevels = std::min(skipLevels, numLevels - 1);
+    glm::uvec2 baseSize = glm::max(glm::uvec2(size.x >> skipLevels, size.y >> skipLevels), glm::uvec2(1));
+    Texture texture;
+    texture.srgb = format->srgb;
+    texture.format = format->format;
+    texture.bitmap.numComponents = format->numComponents;
+    texture.bitmap.size = baseSize;
+    texture.numMipLevels = levelCount == 0 ? getMipLevelCount(baseSize) : numLevels - skipLevels;
+    texture.skippedLevels = skipLevels;
+
+    // Validate every level before allocating, the levels are then copied straight into place
+    struct LevelSource{ uint64_t offset, length; };
+    std::vector<LevelSource> sources;
+    size_t total = 0;
+    reader.seek(KTX2_HEADER_SIZE);
+    for(unsigned level = 0; level < numLevels; ++level)
+    {
+        uint64_t offset = reader.read<uint64_t>();
+        uint64_t length = reader.read<uint64_t>();
+        reader.read<uint64_t>(); // uncompressedByteLength
+        glm::uvec2 levelSize = glm::max(glm::uvec2(size.x >> level, size.y >> level), glm::uvec2(1));
+        if(!reader.ok || length != getLevelByteLength(*format, levelSize) || offset > data.size() || length > data.size() - offset)
+        {
+            LOG_ERROR("invalid KTX2 file: level {} is out of bounds", level);
+            return std::nullopt;
+        }
+        if(level < skipLevels)
+            continue;
+        if(numLevels - skipLevels > 1)
+            texture.levels.push_back({format->format == TextureFormat::uncompressed ? total : 0, levelSize});
+        sources.push_back({offset, length});
+        total += length;
+    }
+    auto &out = format->format == TextureFormat::uncompressed ? texture.bitmap.pixels : texture.blocks;
+    out = PixelBuffer<unsigned char>(total);
+    size_t written = 0;
+    for(LevelSource const &source : sources)
+    {
+        std::memcpy(out.data() + written, data.data() + source.offset, source.length);
+        written += source.length;
+    }
+
+    if(kvdOffset <= data.size() && kvdLength <= data.size() - kvdOffset && isBottomUp(bytes.subspan(kvdOffset, kvdLength)) != flip)
+    {
+        if(format->format != TextureFormat::uncompressed)
+            LOG_WARN("KTX2 texture is stored {}, compressed rows can't be flipped", flip ? "top down" : "bottom up");
+        else
+            for(unsigned level = 0; level < texture.getLevelCount(); ++level)
+            {
+                glm::uvec2 levelSize = texture.getLevelSize(level);
+                size_t rowSize = size_t(levelSize.x) * format->numComponents;
+                unsigned char *pixels = out.data() + (texture.levels.empty() ? 0 : texture.levels[level].offset);
+                for(unsigned y = 0; y < levelSize.y / 2; ++y)
+                    std::swap_ranges(pixels + y * rowSize, pixels + (y + 1) * rowSize, pixels + (levelSize.y - 1 - y) * rowSize);
+            }
+    }
+    return texture;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "Model.hpp"
+#include <optional>
+#include <span>
+#include <string_view>
+
+// KTX2 containers (registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html) holding cooked textures:
+// 2D, no supercompression, the levels exactly as they are uploaded.
+// Supported formats are the 8-bit UNORM/sRGB ones with 1 to 4 components and those of TextureFormat.
+
+/// @brief Whether @p data starts with the KTX2 identifier.
+bool isKtx2(std::span<unsigned char const> data);
+
+/// @brief The size of the base level of a KTX2 file, from its header alone. std::nullopt if @p data isn't one.
+std::optional<glm::uvec2> getKtx2Size(std::span<unsigned char const> data);
+
+/// @brief Parse a KTX2 file.
+/// Block-compressed files carry no pixels: the bitmap has a size but no components, the levels are only in Texture::blocks.
+/// A level count of 0 leaves the mips to the GPU, like decoded images.
+/// @param flip The rows are wanted bottom up. Uncompressed files stored the other way are flipped, compressed ones can't be.
+/// @param skipLevels Largest levels to leave out, they aren't read at all. At most the levels the file has besides its last.
+/// @return std::nullopt if the file is malformed or its format isn't supported.
+std::optional<Texture> readKtx2(std::span<unsigned char const> data, bool flip, unsigned skipLevels = 0);
+
+/// @brief Write @p texture with all its CPU levels: its blocks if it is compressed, otherwise its pixels.
+/// @param flipped The rows of @p texture are bottom up, recorded as the KTXorientation of the file.
+/// @return false if the file couldn't be written.
+bool writeKtx2(std::string_view path, Texture const &texture, bool flipped);
@@ -0,0 +1,97 @@
+// Converts the images of an asset directory to KTX2 files, mirroring the directory structure.
+// usage: levulkan-ktx <input directory> <output directory> [--compress fast|normal|best] [--mips] [--psnr]
+#include "Ktx.hpp"
+#include "Loaders.hpp"
+#include "Logging.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+
+/// @brief Guess what an image holds from the usual naming conventions, it picks the color space and the compression format.
+static TextureUsage guessUsage(std::string name)
+{
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return std::tolower(c); });
+    for(std::string_view hint : {"normal", "nrm", "_n."})
+        if(name.find(hint) != std::string::npos)
+            return TextureUsage::normal;
+    for(std::string_view hint : {"rough", "metal", "occlusion", "_ao", "height", "disp", "spec", "mask"})
+        if(name.find(hint) != std::string::npos)
+            return TextureUsage::mask;
+    return TextureUsage::color;
+}
+
+int main(int argc, char **argv)
+{
+    sLogger = spdlog::stdout_color_mt("sLogger");
+    sLogger->set_level(spdlog::level::info);
+
+    if(argc < 3)
+    {
+        LOG_ERROR("usage: {} <input directory> <output directory> [--compress fast|normal|best] [--mips] [--psnr]", argv[0]);
+        return 1;
+    }
+    std::filesystem::path input = argv[1], output = argv[2];
+    TextureCompressionOptions compression;
+    bool mips = false;
+    for(int i = 3; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if(arg == "--compress" && i + 1 < argc)
+        {
+            compression.enabled = true;
+            std::string_view quality = argv[++i];
+            if(quality == "fast")
+                compression.quality = TextureCompressionOptions::Quality::fast;
+            else if(quality == "best")
+                compression.quality = TextureCompressionOptions::Quality::best;
+        }
+        else if(arg == "--mips")
+            mips = true;
+        else if(arg == "--psnr")
+            compression.reportPsnr = true;
+        else
+            LOG_WARN("Unknown argument \"{}\"", arg);
+    }
+
+    constexpr std::array<std::string_view, 7> EXTENSIONS = {".png", ".jpg", ".jpeg", ".tga", ".bmp", ".psd", ".gif"};
+    std::vector<std::filesystem::path> images;
+    std::error_code ec;
+    for(auto const &entry : std::filesystem::recursive_directory_iterator(input, ec))
+    {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c){ return std::tolower(c); });
+        if(entry.is_regular_file() && std::find(EXTENSIONS.begin(), EXTENSIONS.end(), extension) != EXTENSIONS.end())
+            images.push_back(entry.path());
+    }
+    if(ec)
+        LOG_ERROR("Can't read \"{}\": {}", input.string(), ec.message());
+
+    // Images are decoded and written in parallel, no registry is needed to convert them
+    std::atomic<unsigned> converted = 0, failed = 0;
+    ThreadPool::global().parallelFor(images.size(), [&](size_t i){
+        TextureUsage usage = guessUsage(images[i].filename().string());
+        TextureLoaderOptions options{
+            .srgb = usage == TextureUsage::color,
+            .generateMips = mips,
+            .usage = usage,
+            .compression = compression,
+        };
+        auto texture = TextureLoader::decode(TextureLoadRequest{.path = images[i].string(), .options = options});
+        auto outPath = output / std::filesystem::relative(images[i], input).replace_extension(".ktx2");
+        std::error_code createError;
+        std::filesystem::create_directories(outPath.parent_path(), createError);
+        if(!texture || !writeKtx2(outPath.string(), *texture, options.flip))
+        {
+            ++failed;
+            return;
+        }
+        LOG_INFO("{} -> {}", images[i].string(), outPath.string());
+        ++converted;
+    });
+
+    LOG_INFO("Converted {} images, {} failed", converted.load(), failed.load());
+    return failed.load() || ec ? 1 : 0;
+}
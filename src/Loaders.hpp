@@ -2,16 +2,102 @@
 #pragma once
 #include "nicecs/ecs.hpp"
 #include "Model.hpp"
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
 
+/// @brief What a texture holds, picks its block compression format.
+enum class TextureUsage
+{
+    color, // BC7, or BC1/BC3 with TextureCompressionOptions::Quality::fast
+    normal, // BC5, the x and y of tangent space normals
+    mask, // BC4, single channel maps like roughness or occlusion
+};
+struct TextureCompressionOptions
+{
+    enum class Quality
+    {
+        fast, // bounding box endpoints, BC1/BC3 for colors
+        normal, // endpoints along the principal axis of every block
+        best, // principal axis endpoints refined with least squares
+    };
+    bool enabled = false; /// Encode the texture and its mips (made on the CPU) into BCn blocks, Texture::blocks.
+    Quality quality = Quality::normal; /// Quality against encoding speed.
+    bool reportPsnr = false; /// Log the PSNR over all levels and the time it took to encode.
+    bool keepBitmap = false; /// Keep the uncompressed bitmap next to the blocks, it is freed after encoding otherwise.
+};
 struct TextureLoaderOptions
 {
     bool flip = true; /// Flip the image vertically, so the first pixel in the output array is the bottom left.
+    bool srgb = false; /// The color channels are sRGB encoded. Sets Texture::srgb, mips are filtered in linear space.
+    bool generateMips = false; /// Build the mip chain on the CPU (Texture::levels) instead of leaving it to the GPU.
+    bool premultiplyAlpha = false; /// Multiply the color channels by alpha before the mips are made, for premultiplied blending.
+    unsigned maxDimension = 0; /// Larger textures are downscaled on load by whole levels until both dimensions fit, 0 for no limit.
+    size_t maxBytes = 0; /// Same for the bytes of the base level as RGBA8, 0 for no limit. See Texture::skippedLevels.
+    TextureUsage usage = TextureUsage::color; /// What the texture holds.
+    TextureCompressionOptions compression; /// Block compression after loading.
+};
+/// @brief The texture slots of Material::Textures, in their declaration order.
+enum class MaterialTextureSlot : uint8_t
+{
+    albedo,
+    metallic,
+    roughness,
+    ambient,
+    normal,
+    displacement,
+    orm,
+};
+/// @brief The options the texture of @p slot is loaded with, from the texture options of the model.
+/// Occlusion, roughness and metallic maps only feed the packed ORM texture, they get no mips or blocks of their own.
+TextureLoaderOptions getMaterialTextureOptions(TextureLoaderOptions options, MaterialTextureSlot slot);
+/// @brief One texture of a batch, see TextureLoader::loadBatch.
+struct TextureLoadRequest
+{
+    std::string path; /// The file to load, or only the name of the texture if data is set.
+    std::span<unsigned char const> data{}; /// Encoded bytes to decode instead of reading path. Must outlive the load.
+    TextureLoaderOptions options;
+};
+struct MeshOptimizationOptions
+{
+    bool vertexCache = true; /// Reorder triangles for the post-transform vertex cache.
+    bool overdraw = true; /// Reorder triangles to reduce overdraw. Only done together with vertexCache.
+    float overdrawThreshold = 1.05f; /// How much worse the vertex cache efficiency may get to reduce overdraw, 1.05 means 5%.
+    bool vertexFetch = true; /// Reorder vertices in the order the triangles use them.
+    bool statistics = true; /// Trace vertex cache (ACMR/ATVR) and vertex fetch statistics before and after optimizing.
+    bool splitFor16BitIndices = true; /// Split meshes with more than 65536 vertices so each part can use 16-bit indices.
+};
+struct LodOptions
+{
+    unsigned maxLevels = 4; /// Number of levels including the full detail one, 1 disables LOD generation.
+    float reduction = 0.5f; /// Index count of every level relative to the previous one.
+    float maxError = 0.05f; /// Largest error of a level relative to the mesh size.
+    unsigned minTriangles = 32; /// Don't make levels smaller than this.
+    bool sloppy = true; /// Use meshopt_simplifySloppy when the topology preserving simplifier can't reach the target.
+};
+struct MeshletOptions
+{
+    bool enabled = true; /// Split the full detail level of every mesh into meshlets.
+    unsigned maxVertices = 64; /// At most 256.
+    unsigned maxTriangles = 124; /// At most 512, must be divisible by 4.
+    float coneWeight = 0.25f; /// How much to favor tight normal cones over tight bounding spheres, between 0 and 1.
+};
+struct AnimationCompressionOptions
+{
+    float maxError = 0.001f; /// Largest distance a bone may move from where the imported keys put it, relative to the skeleton size. 0 keeps every key.
+    bool statistics = true; /// Trace the compression ratio and the largest error measured over the clip.
 };
 struct ModelLoaderOptions
 {
     bool flipWindingOrder = false; /// Flip the winding model of the triangles.
     bool flipUVs = false; /// Flip the texture coordinates vertically.
     TextureLoaderOptions textureOptions; /// Options for texture loading.
+    MeshOptimizationOptions optimization; /// Options for the mesh optimization stage.
+    LodOptions lods; /// Options for level of detail generation.
+    MeshletOptions meshlets; /// Options for meshlet generation.
+    AnimationCompressionOptions animations; /// Options for the animation compression stage.
+    std::string cacheDirectory = "cache/models"; /// Where cooked models are stored, empty to always import with assimp.
 };
 
 class ModelLoader
@@ -36,6 +122,11 @@ public:
     /// @param options The options for loading the model.
     ecs::entity loadFromMemory(void const *data, size_t size, ModelLoaderOptions options = {});
 
+    /// @brief Drop the reference to a model that a load returned.
+    /// With the last one the model drops its references to its textures as well,
+    /// unused assets stay cached until AssetCache::evictUnused().
+    void release(ecs::entity model);
+
     /// @brief Get the default material.
     /// This material may be (partially) applied to meshes without some parameters or textures.
     /// Is guaranteed to have all the parameters and textures set.
@@ -63,4 +154,28 @@ public:
     /// @param size The size of @p data.
     /// @param options The options for loading the texture.
     ecs::entity loadFromMemory(void const *data, size_t size, TextureLoaderOptions options = {});
+
+    /// @brief Load many textures, decoding them in parallel on the worker pool.
+    /// Files already loaded are taken from the asset cache and a file requested twice is decoded once.
+    /// The entities are created on the calling thread after every texture is decoded.
+    /// @param requests The textures to load.
+    /// @return The entity of every request, in order. INVALID_ENTITY for the ones that failed.
+    std::vector<ecs::entity> loadBatch(std::span<TextureLoadRequest const> requests);
+
+    /// @brief Bytes that the textures loaded from now on may take together, their base levels as RGBA8, across all loaders.
+    /// Textures that would go over it are downscaled further on load, though none below BUDGET_MIN_DIMENSION.
+    /// Cooked textures are already sized as they were cooked and only count against it. 0 (the default) is no budget.
+    static void setGlobalBudget(size_t bytes);
+    /// @brief Bytes counted against the global budget so far.
+    static size_t getGlobalBudgetUsage();
+    static constexpr unsigned BUDGET_MIN_DIMENSION = 64;
+
+    /// @brief Decode one request without touching a registry, safe to call from any thread.
+    /// For loads that overlap other work, e.g. ThreadPool::global().submit([request]{ return TextureLoader::decode(request); }).
+    /// @return The texture, std::nullopt if it can't be read or decoded.
+    static std::optional<Texture> decode(TextureLoadRequest const &request);
+
+    /// @brief Hash of the options that change the loaded texture, the same pixels loaded differently are different textures.
+    /// Cache keys of textures made from pixels outside a loader mix it in as well, so equal options match.
+    static uint64_t hashOptions(TextureLoaderOptions const &options, uint64_t seed);
 };
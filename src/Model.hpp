@@ -3,27 +3,184 @@
 #include "nicecs/ecs.hpp"
 #include "glm/glm.hpp"
 #include "glm/gtc/quaternion.hpp"
+#include "glm/ext/vector_uint3_sized.hpp"
+#include "glm/ext/vector_uint4_sized.hpp"
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <bit>
+#include <initializer_list>
+#include <span>
+#include <type_traits>
+#include <utility>
 
 constexpr ecs::entity INVALID_ENTITY = 0;
 
+/// @brief Owning pixel memory that is left uninitialized when allocated.
+/// Can adopt a buffer from another allocator (a decoder for example) together with the function that frees it, so it needs no copy.
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+class PixelBuffer
+{
+public:
+    using Deleter = void (*)(void *);
+private:
+    T *mData = nullptr;
+    size_t mSize = 0;
+    Deleter mDeleter = nullptr; // nullptr for memory from new[]
+
+    void free()
+    {
+        if(mDeleter)
+            mDeleter(mData);
+        else
+            delete[] mData;
+        mData = nullptr;
+        mSize = 0;
+        mDeleter = nullptr;
+    }
+public:
+    PixelBuffer() = default;
+    /// @brief Allocate @p size uninitialized elements.
+    explicit PixelBuffer(size_t size) : mData(size ? new T[size] : nullptr), mSize(size) {}
+    PixelBuffer(std::initializer_list<T> values) : PixelBuffer(values.size()) { std::copy(values.begin(), values.end(), mData); }
+    PixelBuffer(PixelBuffer const &other) : PixelBuffer(other.mSize) { std::copy(other.begin(), other.end(), mData); }
+    PixelBuffer(PixelBuffer &&other) noexcept
+        : mData(std::exchange(other.mData, nullptr)), mSize(std::exchange(other.mSize, 0)), mDeleter(std::exchange(other.mDeleter, nullptr)) {}
+    PixelBuffer &operator=(PixelBuffer other) noexcept
+    {
+        std::swap(mData, other.mData);
+        std::swap(mSize, other.mSize);
+        std::swap(mDeleter, other.mDeleter);
+        return *this;
+    }
+    ~PixelBuffer() { free(); }
+
+    /// @brief Take ownership of @p data, freed with @p deleter.
+    static PixelBuffer adopt(T *data, size_t size, Deleter deleter)
+    {
+        PixelBuffer buffer;
+        buffer.mData = data;
+        buffer.mSize = data ? size : 0;
+        buffer.mDeleter = deleter;
+        return buffer;
+    }
+    static PixelBuffer copyOf(std::span<T const> values)
+    {
+        PixelBuffer buffer(values.size());
+        std::copy(values.begin(), values.end(), buffer.mData);
+        return buffer;
+    }
+
+    /// @brief Change the size, keeping the elements that fit. New elements are uninitialized.
+    void resize(size_t size)
+    {
+        if(size == mSize)
+            return;
+        PixelBuffer resized(size);
+        std::copy(begin(), begin() + std::min(size, mSize), resized.mData);
+        *this = std::move(resized);
+    }
+
+    inline size_t size() const { return mSize; }
+    inline bool empty() const { return mSize == 0; }
+    inline T *data() { return mData; }
+    inline T const *data() const { return mData; }
+    inline T *begin() { return mData; }
+    inline T *end() { return mData + mSize; }
+    inline T const *begin() const { return mData; }
+    inline T const *end() const { return mData + mSize; }
+    inline T &operator[](size_t i) { return mData[i]; }
+    inline T const &operator[](size_t i) const { return mData[i]; }
+    inline operator std::span<T const>() const { return {mData, mSize}; }
+};
+
 template<typename T>
 struct Bitmap
 {
-    std::vector<T> pixels;
+    PixelBuffer<T> pixels;
     unsigned numComponents;
     glm::uvec2 size;
 
     inline std::size_t getOffsetOf(glm::uvec2 pos) const { return numComponents * (pos.y * size.x + pos.x); }
 };
 
+/// @brief The number of levels in a full mip chain, down to 1x1.
+inline unsigned getMipLevelCount(glm::uvec2 size) { return std::bit_width(std::max({size.x, size.y, 1u})); }
+
+/// @brief Encoding of the data the GPU samples, see Texture::blocks.
+enum class TextureFormat : uint8_t
+{
+    uncompressed, // bitmap is uploaded as is
+    bc1, // RGB, 8 bytes per 4x4 block
+    bc3, // RGBA, BC1 color and BC4 alpha, 16 bytes per block
+    bc4, // R, 8 bytes per block
+    bc5, // RG, two BC4 blocks, z of normals is reconstructed when sampling
+    bc7, // RGBA, 16 bytes per block
+};
+
+/// @brief Bytes per 4x4 block, 0 for uncompressed.
+inline unsigned getBlockSize(TextureFormat format)
+{
+    switch(format)
+    {
+    case TextureFormat::bc1:
+    case TextureFormat::bc4:
+        return 8;
+    case TextureFormat::bc3:
+    case TextureFormat::bc5:
+    case TextureFormat::bc7:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
 struct Texture
 {
     Bitmap<unsigned char> bitmap;
     bool srgb = false;
     unsigned numMipLevels = 1;
     std::string path;
+
+    struct Level
+    {
+        size_t offset; // into bitmap.pixels
+        glm::uvec2 size;
+    };
+    // Mip levels made on the CPU, stored in bitmap.pixels after the base level. Empty if the GPU makes them.
+    std::vector<Level> levels{};
+    // Largest levels of the source left out on load to fit a budget, see TextureLoaderOptions::maxDimension.
+    // They are still in the file at path, to be streamed in later.
+    unsigned skippedLevels = 0;
+    // Block-compressed copy of every level, back to back. Empty if format is uncompressed.
+    // Compressed textures usually have no bitmap.pixels left, levels still describes the level sizes.
+    TextureFormat format = TextureFormat::uncompressed;
+    PixelBuffer<unsigned char> blocks{};
+
+    inline unsigned getLevelCount() const { return levels.empty() ? 1 : static_cast<unsigned>(levels.size()); }
+    inline glm::uvec2 getLevelSize(unsigned level) const { return levels.empty() ? bitmap.size : levels.at(level).size; }
+
+    inline std::span<unsigned char const> getLevel(unsigned level) const
+    {
+        if(bitmap.pixels.empty())
+            return {};
+        if(levels.empty())
+            return {bitmap.pixels.data(), static_cast<size_t>(bitmap.size.x) * bitmap.size.y * bitmap.numComponents};
+        Level const &l = levels.at(level);
+        return {bitmap.pixels.data() + l.offset, static_cast<size_t>(l.size.x) * l.size.y * bitmap.numComponents};
+    }
+    inline std::span<unsigned char const> getCompressedLevel(unsigned level) const
+    {
+        size_t offset = 0, size = 0;
+        for(unsigned i = 0; i <= level; ++i)
+        {
+            offset += size;
+            glm::uvec2 levelSize = getLevelSize(i);
+            size = static_cast<size_t>((levelSize.x + 3) / 4) * ((levelSize.y + 3) / 4) * getBlockSize(format);
+        }
+        return {blocks.data() + offset, size};
+    }
 };
 
 struct Material
@@ -37,6 +194,8 @@ struct Material
         ecs::entity ambient = INVALID_ENTITY;
         ecs::entity normal = INVALID_ENTITY;
         ecs::entity displacement = INVALID_ENTITY;
+        // ambient (R), roughness (G) and metallic (B) packed into one texture, what renderers sample instead of the three
+        ecs::entity orm = INVALID_ENTITY;
     } textures;
     struct Properties
     {
@@ -50,28 +209,37 @@ struct Material
         float ior;
     } properties;
 };
+// Keys are compressed on load, see AnimationCompression.hpp for decoding them
 struct Animation
 {
     struct PositionKey
     {
-        glm::vec3 value;
+        glm::u16vec3 value; // unorm16 within Keyframes::positionRange
         float timeTicks;
     };
     struct OrientationKey
     {
-        glm::quat value;
+        glm::u16vec3 value; // smallest three, see packQuaternion
         float timeTicks;
     };
     struct ScaleKey
     {
-        glm::vec3 value;
+        glm::u16vec3 value; // unorm16 within Keyframes::scaleRange
         float timeTicks;
     };
+    // the values of a track span [min, min + extent]
+    struct Range
+    {
+        glm::vec3 min{0};
+        glm::vec3 extent{0};
+    };
     struct Keyframes
     {
         std::vector<PositionKey   > positions;
         std::vector<OrientationKey> orientations;
         std::vector<ScaleKey      > scales;
+        Range positionRange;
+        Range scaleRange;
     };
 
     std::vector<Keyframes> bones;
@@ -91,12 +259,50 @@ struct Mesh
         std::vector<unsigned> indices;
 
         // optional
-        // hope 4 bones per vertex would be enough
-        std::vector<glm::vec4> boneIDs;
-        std::vector<glm::vec4> weights;
+        // the 4 strongest bone influences per vertex, see quantizeBoneWeights
+        std::vector<glm::u16vec4> boneIDs;
+        std::vector<glm::u8vec4> weights; // unorm8, summing to exactly 255
+
+        // derived
+        unsigned indexSize = sizeof(unsigned); // bytes per index on the GPU, 2 when every vertex is reachable with 16 bits
+        unsigned boneIndexSize = 0; // bytes per bone index on the GPU and in the cache, 1 when every bone of the mesh fits in 8 bits, 0 without bones
+        struct Lod
+        {
+            unsigned indexOffset;
+            unsigned indexCount;
+            float error; // how far the simplified surface may be from the full detail one, in mesh units
+        };
+        // lods[0] is the full detail mesh, coarser levels follow it in indices
+        std::vector<Lod> lods;
+        struct Meshlet
+        {
+            unsigned vertexOffset;   // into meshletVertices
+            unsigned triangleOffset; // into meshletTriangles
+            unsigned vertexCount;
+            unsigned triangleCount;
+            unsigned indexOffset;    // the same triangles in indices, triangleCount * 3 indices long
+
+            // culling bounds
+            glm::vec3 center;
+            float radius;
+            glm::vec3 coneApex;
+            float coneCutoff; // backfacing from everywhere the view direction is within acos(coneCutoff) of coneAxis
+            glm::vec3 coneAxis;
+        };
+        // optional, clusters of the full detail level
+        // the full detail indices are ordered by meshlet, so a meshlet can also be drawn as an index range
+        std::vector<Meshlet> meshlets;
+        std::vector<unsigned> meshletVertices;
+        std::vector<unsigned char> meshletTriangles; // 3 local vertex indices per triangle
+        struct Bounds
+        {
+            glm::vec3 center{0};
+            float radius = 0;
+        } bounds;
     } geometry;
     
     Material material;
+    unsigned materialId = 0; // meshes of a model with the same id have identical materials and can be drawn together
 };
 struct Model
 {
@@ -105,6 +311,8 @@ struct Model
     std::string path;
 
     std::vector<ecs::entity> lights;
+    // The texture references the model holds in the AssetCache, one per acquire. Dropped by ModelLoader::release.
+    std::vector<ecs::entity> textureReferences;
 
     struct Skeleton
     {
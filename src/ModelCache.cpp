@@ -0,0 +1,434 @@
+#include "ModelCache.hpp"
+#include "AssetCache.hpp"
+#include "Loaders.hpp"
+#include "Logging.hpp"
+#include "Serialization.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+constexpr char COOKED_MAGIC[8] = {'L', 'V', 'K', 'M', 'O', 'D', 'E', 'L'};
+constexpr uint32_t MAX_COOKED_COUNT = 1 << 20;
+
+struct CookedHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t sourceHash;
+    uint64_t optionsHash;
+};
+enum class CookedTextureKind : uint8_t
+{
+    file,     // loaded from the path again
+    builtin,  // one of the "default/*" textures
+    embedded, // pixels stored in the cooked file
+};
+struct CookedTexture
+{
+    CookedTextureKind kind;
+    MaterialTextureSlot slot; // the first material slot using the texture
+    Texture texture;
+};
+
+struct SourceStamp
+{
+    uint64_t size = 0;
+    int64_t time = 0;
+};
+static std::optional<SourceStamp> getSourceStamp(std::string_view path)
+{
+    std::error_code ec;
+    auto size = std::filesystem::file_size(std::filesystem::path{path}, ec);
+    if(ec)
+        return std::nullopt;
+    auto time = std::filesystem::last_write_time(std::filesystem::path{path}, ec);
+    if(ec)
+        return std::nullopt;
+    return SourceStamp{static_cast<uint64_t>(size), static_cast<int64_t>(time.time_since_epoch().count())};
+}
+static std::optional<uint64_t> hashFile(std::string_view path)
+{
+    MappedFile file;
+    if(!file.open(path))
+        return std::nullopt;
+    return hashBytes(file.bytes().data(), file.bytes().size());
+}
+
+// A corrupt count shouldn't allocate gigabytes before the reader notices.
+static uint32_t readCount(BinaryReader &reader)
+{
+    uint32_t count = reader.read<uint32_t>();
+    if(!reader.ok || count > MAX_COOKED_COUNT)
+    {
+        reader.ok = false;
+        return 0;
+    }
+    return count;
+}
+
+template<typename Textures, typename F>
+static void forEachTextureSlot(Textures &textures, F &&f)
+{
+    f(textures.albedo);
+    f(textures.metallic);
+    f(textures.roughness);
+    f(textures.ambient);
+    f(textures.normal);
+    f(textures.displacement);
+    f(textures.orm);
+}
+
+static void writeGeometry(BinaryWriter &writer, Mesh::Geometry const &geometry)
+{
+    writer.writeVector(geometry.positions);
+    writer.writeVector(geometry.texCoords);
+    writer.writeVector(geometry.normals);
+    writer.writeVector(geometry.tangents);
+    writer.writeVector(geometry.indices);
+    // Bone indices are stored as narrow as the GPU reads them
+    writer.write(geometry.boneIndexSize);
+    if(geometry.boneIndexSize == sizeof(uint8_t))
+        writer.writeVector(std::vector<glm::u8vec4>(geometry.boneIDs.begin(), geometry.boneIDs.end()));
+    else
+        writer.writeVector(geometry.boneIDs);
+    writer.writeVector(geometry.weights);
+    writer.write(geometry.indexSize);
+    writer.writeVector(geometry.lods);
+    writer.write(geometry.bounds);
+    writer.writeVector(geometry.meshlets);
+    writer.writeVector(geometry.meshletVertices);
+    writer.writeVector(geometry.meshletTriangles);
+}
+static void readGeometry(BinaryReader &reader, Mesh::Geometry &geometry)
+{
+    reader.readVector(geometry.positions);
+    reader.readVector(geometry.texCoords);
+    reader.readVector(geometry.normals);
+    reader.readVector(geometry.tangents);
+    reader.readVector(geometry.indices);
+    geometry.boneIndexSize = reader.read<unsigned>();
+    if(geometry.boneIndexSize == sizeof(uint8_t))
+    {
+        std::vector<glm::u8vec4> boneIDs;
+        reader.readVector(boneIDs);
+        geometry.boneIDs = std::vector<glm::u16vec4>(boneIDs.begin(), boneIDs.end());
+    } else {
+        reader.readVector(geometry.boneIDs);
+    }
+    reader.readVector(geometry.weights);
+    geometry.indexSize = reader.read<unsigned>();
+    reader.readVector(geometry.lods);
+    geometry.bounds = reader.read<Mesh::Geometry::Bounds>();
+    reader.readVector(geometry.meshlets);
+    reader.readVector(geometry.meshletVertices);
+    reader.readVector(geometry.meshletTriangles);
+}
+static void writeSkeleton(BinaryWriter &writer, Model::Skeleton const &skeleton)
+{
+    writer.write(skeleton.globalInverseTransform);
+    writer.writeVector(skeleton.bindTransform);
+    writer.writeVector(skeleton.nodeTransform);
+    writer.writeVector(skeleton.parents);
+    writer.write<uint32_t>(skeleton.boneMap.size());
+    for(auto const &[name, id] : skeleton.boneMap)
+    {
+        writer.writeString(name);
+        writer.write<uint32_t>(id);
+    }
+}
+static void readSkeleton(BinaryReader &reader, Model::Skeleton &skeleton)
+{
+    skeleton.globalInverseTransform = reader.read<glm::mat4>();
+    reader.readVector(skeleton.bindTransform);
+    reader.readVector(skeleton.nodeTransform);
+    reader.readVector(skeleton.parents);
+    uint32_t numBones = readCount(reader);
+    for(uint32_t i = 0; i < numBones && reader.ok; ++i)
+    {
+        std::string name = reader.readString();
+        skeleton.boneMap.try_emplace(std::move(name), reader.read<uint32_t>());
+    }
+}
+static void writeAnimation(BinaryWriter &writer, Animation const &animation)
+{
+    writer.writeString(animation.name);
+    writer.write(animation.durationTicks);
+    writer.write(animation.ticksPerSecond);
+    writer.write<uint32_t>(animation.bones.size());
+    for(auto const &keyframes : animation.bones)
+    {
+        writer.writeVector(keyframes.positions);
+        writer.writeVector(keyframes.orientations);
+        writer.writeVector(keyframes.scales);
+        writer.write(keyframes.positionRange);
+        writer.write(keyframes.scaleRange);
+    }
+}
+static void readAnimation(BinaryReader &reader, Animation &animation)
+{
+    animation.name = reader.readString();
+    animation.durationTicks = reader.read<float>();
+    animation.ticksPerSecond = reader.read<float>();
+    animation.bones.resize(readCount(reader));
+    for(auto &keyframes : animation.bones)
+    {
+        reader.readVector(keyframes.positions);
+        reader.readVector(keyframes.orientations);
+        reader.readVector(keyframes.scales);
+        keyframes.positionRange = reader.read<Animation::Range>();
+        keyframes.scaleRange = reader.read<Animation::Range>();
+    }
+}
+
+ModelCache::ModelCache(std::string_view directory) : mDirectory(directory) {}
+
+std::string ModelCache::getCookedPath(std::string_view sourcePath) const
+{
+    std::filesystem::path source{sourcePath};
+    std::error_code ec;
+    auto canonical = std::filesystem::weakly_canonical(source, ec);
+    std::string key = (ec ? source : canonical).generic_string();
+    auto name = fmt::format("{}-{:016x}.lvkmodel", source.stem().string(), hashBytes(key.data(), key.size()));
+    return (std::filesystem::path{mDirectory} / name).string();
+}
+
+bool ModelCache::store(std::string_view sourcePath, uint64_t optionsHash, Model const &model, ecs::registry const &reg) const
+{
+    if(!enabled())
+        return false;
+
+    auto stamp = getSourceStamp(sourcePath);
+    auto sourceHash = hashFile(sourcePath);
+    if(!stamp || !sourceHash)
+        return false;
+
+    BinaryWriter writer;
+    CookedHeader header{
+        .magic = {},
+        .version = VERSION,
+        .reserved = 0,
+        .sourceSize = stamp->size,
+        .sourceTime = stamp->time,
+        .sourceHash = *sourceHash,
+        .optionsHash = optionsHash,
+    };
+    std::memcpy(header.magic, COOKED_MAGIC, sizeof(COOKED_MAGIC));
+    writer.write(header);
+
+    // Textures are shared between meshes, store each once and refer to it by index.
+    // The slot of each is kept as well, a file texture is loaded again with the options of its slot.
+    std::vector<ecs::entity> textures;
+    std::vector<MaterialTextureSlot> slots;
+    for(auto const &mesh : model.meshes)
+    {
+        uint8_t slot = 0;
+        forEachTextureSlot(mesh.material.textures, [&](ecs::entity e){
+            if(e && reg.valid(e) && std::find(textures.begin(), textures.end(), e) == textures.end())
+            {
+                textures.push_back(e);
+                slots.push_back(static_cast<MaterialTextureSlot>(slot));
+            }
+            ++slot;
+        });
+    }
+    auto textureIndex = [&](ecs::entity e) -> int32_t {
+        auto it = std::find(textures.begin(), textures.end(), e);
+        return it == textures.end() ? -1 : static_cast<int32_t>(it - textures.begin());
+    };
+
+    writer.write<uint32_t>(textures.size());
+    for(size_t i = 0; i < textures.size(); ++i)
+    {
+        auto const &texture = reg.get<Texture>(textures[i]);
+        auto kind = CookedTextureKind::embedded;
+        if(texture.path.starts_with("default/"))
+            kind = CookedTextureKind::builtin;
+        else if(std::error_code ec; (texture.format == TextureFormat::uncompressed || texture.path.ends_with(".ktx2")) && std::filesystem::is_regular_file(texture.path, ec))
+            kind = CookedTextureKind::file; // textures compressed on load are stored, that's the expensive part to redo
+
+        writer.write(kind);
+        writer.writeString(texture.path);
+        writer.write<uint8_t>(texture.srgb);
+        writer.write(slots[i]);
+        if(kind == CookedTextureKind::embedded)
+        {
+            writer.write<uint32_t>(texture.bitmap.numComponents);
+            writer.write(texture.bitmap.size);
+            writer.write<uint32_t>(texture.numMipLevels);
+            writer.write<uint32_t>(texture.skippedLevels);
+            writer.writeVector(texture.levels);
+            writer.writeArray(std::span<unsigned char const>{texture.bitmap.pixels});
+            writer.write(texture.format);
+            writer.writeArray(std::span<unsigned char const>{texture.blocks});
+        }
+    }
+
+    writer.write<uint32_t>(model.meshes.size());
+    for(auto const &mesh : model.meshes)
+    {
+        writeGeometry(writer, mesh.geometry);
+        forEachTextureSlot(mesh.material.textures, [&](ecs::entity e){ writer.write<int32_t>(textureIndex(e)); });
+        writer.write(mesh.material.properties);
+        writer.write<uint32_t>(mesh.materialId);
+    }
+
+    writeSkeleton(writer, model.skeleton);
+
+    writer.write<uint32_t>(model.animations.size());
+    for(auto const &animation : model.animations)
+        writeAnimation(writer, animation);
+
+    // Write to a temporary file first so a concurrent reader never sees a partial file.
+    std::string cookedPath = getCookedPath(sourcePath);
+    std::string tempPath = cookedPath + ".tmp";
+    std::error_code ec;
+    std::filesystem::create_directories(mDirectory, ec);
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if(!file.is_open())
+            return false;
+        file.write(writer.buffer.data(), writer.buffer.size());
+        if(!file)
+            return false;
+    }
+    std::filesystem::rename(tempPath, cookedPath, ec);
+    return !ec;
+}
+
+std::optional<Model> ModelCache::load(std::string_view sourcePath, uint64_t optionsHash, ecs::registry &reg, TextureLoader &textureLoader, TextureLoaderOptions const &textureOptions) const
+{
+    if(!enabled())
+        return std::nullopt;
+
+    std::string cookedPath = getCookedPath(sourcePath);
+    MappedFile file;
+    if(!file.open(cookedPath))
+        return std::nullopt;
+
+    BinaryReader reader{file.bytes()};
+    auto header = reader.read<CookedHeader>();
+    if(!reader.ok || std::memcmp(header.magic, COOKED_MAGIC, sizeof(COOKED_MAGIC)) != 0 || header.version != VERSION)
+    {
+        LOG_WARN("Ignoring cooked model \"{}\" of an unsupported version", cookedPath);
+        return std::nullopt;
+    }
+    if(header.optionsHash != optionsHash)
+        return std::nullopt;
+
+    // The modification time is checked first so the source isn't read on every load.
+    auto stamp = getSourceStamp(sourcePath);
+    if(stamp && (stamp->size != header.sourceSize || stamp->time != header.sourceTime))
+    {
+        auto sourceHash = hashFile(sourcePath);
+        if(!sourceHash || *sourceHash != header.sourceHash)
+            return std::nullopt;
+    }
+
+    std::vector<CookedTexture> textures(readCount(reader));
+    for(auto &cooked : textures)
+    {
+        cooked.kind = reader.read<CookedTextureKind>();
+        cooked.texture.path = reader.readString();
+        cooked.texture.srgb = reader.read<uint8_t>();
+        cooked.slot = reader.read<MaterialTextureSlot>();
+        if(cooked.kind == CookedTextureKind::embedded)
+        {
+            cooked.texture.bitmap.numComponents = reader.read<uint32_t>();
+            cooked.texture.bitmap.size = reader.read<glm::uvec2>();
+            cooked.texture.numMipLevels = reader.read<uint32_t>();
+            cooked.texture.skippedLevels = reader.read<uint32_t>();
+            reader.readVector(cooked.texture.levels);
+            cooked.texture.bitmap.pixels = PixelBuffer<unsigned char>::copyOf(reader.readArray<unsigned char>());
+            cooked.texture.format = reader.read<TextureFormat>();
+            cooked.texture.blocks = PixelBuffer<unsigned char>::copyOf(reader.readArray<unsigned char>());
+        }
+    }
+
+    Model model;
+    model.path = sourcePath;
+
+    std::vector<std::array<int32_t, 7>> textureIndices;
+    model.meshes.resize(readCount(reader));
+    for(auto &mesh : model.meshes)
+    {
+        readGeometry(reader, mesh.geometry);
+        auto &indices = textureIndices.emplace_back();
+        for(auto &index : indices)
+            index = reader.read<int32_t>();
+        mesh.material.properties = reader.read<Material::Properties>();
+        mesh.materialId = reader.read<uint32_t>();
+    }
+
+    readSkeleton(reader, model.skeleton);
+
+    model.animations.resize(readCount(reader));
+    for(auto &animation : model.animations)
+        readAnimation(reader, animation);
+
+    if(!reader.ok)
+    {
+        LOG_WARN("Cooked model \"{}\" is corrupt", cookedPath);
+        return std::nullopt;
+    }
+
+    // Everything is parsed, only now create the texture entities. Files are decoded as one parallel batch.
+    // Every texture is acquired or inserted once for the model, see Model::textureReferences.
+    AssetCache &cache = AssetCache::of(reg);
+    auto getOptions = [&](CookedTexture const &cooked){
+        TextureLoaderOptions options = getMaterialTextureOptions(textureOptions, cooked.slot);
+        options.srgb = cooked.texture.srgb;
+        return options;
+    };
+    std::vector<ecs::entity> entities(textures.size(), INVALID_ENTITY);
+    std::vector<TextureLoadRequest> requests;
+    std::vector<size_t> requested;
+    for(size_t i = 0; i < textures.size(); ++i)
+    {
+        auto &cooked = textures[i];
+        switch(cooked.kind)
+        {
+        case CookedTextureKind::builtin:
+            entities[i] = cache.acquire(AssetKind::texture, cooked.texture.path);
+            break;
+        case CookedTextureKind::file:
+            requests.push_back({.path = cooked.texture.path, .options = getOptions(cooked)});
+            requested.push_back(i);
+            break;
+        case CookedTextureKind::embedded:
+        {
+            // Textures compressed on load still stand for their file, as loaded with the options of their slot
+            std::string path = cooked.texture.path;
+            std::error_code ec;
+            bool file = std::filesystem::is_regular_file(path, ec);
+            uint64_t variant = TextureLoader::hashOptions(getOptions(cooked), 0);
+            if(file && (entities[i] = cache.acquire(AssetKind::texture, path, variant)))
+                break;
+            entities[i] = reg.create(std::move(cooked.texture));
+            cache.insert(AssetKind::texture, file ? std::string_view{path} : std::string_view{}, entities[i], 0, variant);
+            break;
+        }
+        }
+        if(entities[i])
+            model.textureReferences.push_back(entities[i]);
+    }
+    std::vector<ecs::entity> loaded = textureLoader.loadBatch(requests);
+    for(size_t i = 0; i < loaded.size(); ++i)
+    {
+        entities[requested[i]] = loaded[i];
+        if(loaded[i])
+            model.textureReferences.push_back(loaded[i]);
+    }
+    for(size_t i = 0; i < model.meshes.size(); ++i)
+    {
+        size_t slot = 0;
+        forEachTextureSlot(model.meshes[i].material.textures, [&](ecs::entity &e){
+            int32_t index = textureIndices[i][slot++];
+            e = index >= 0 && static_cast<size_t>(index) < entities.size() ? entities[index] : INVALID_ENTITY;
+        });
+    }
+
+    return model;
+}
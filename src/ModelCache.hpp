@@ -0,0 +1,39 @@
+#pragma once
+#include "nicecs/ecs.hpp"
+#include "Model.hpp"
+#include <optional>
+
+class TextureLoader;
+struct TextureLoaderOptions;
+
+/// @brief On-disk cache of imported models ("cooked" models).
+/// A cooked model is written after the first import of a file and read back with no assimp involvement.
+/// It is invalidated when the source file or the loading options change.
+class ModelCache
+{
+private:
+    std::string mDirectory;
+public:
+    static constexpr uint32_t VERSION = 12;
+
+    /// @brief Construct a disabled cache.
+    ModelCache() = default;
+
+    /// @param directory The directory the cooked files are stored in. Created on the first store.
+    explicit ModelCache(std::string_view directory);
+
+    inline bool enabled() const { return !mDirectory.empty(); }
+
+    /// @brief Get the path of the cooked file for a source model.
+    std::string getCookedPath(std::string_view sourcePath) const;
+
+    /// @brief Write the cooked model.
+    /// @param optionsHash Hash of the options the model was loaded with.
+    /// @return false if the file couldn't be written.
+    bool store(std::string_view sourcePath, uint64_t optionsHash, Model const &model, ecs::registry const &reg) const;
+
+    /// @brief Read an up-to-date cooked model.
+    /// Textures referenced by the model are loaded with @p textureLoader or created from the embedded data.
+    /// @return std::nullopt if there is no cooked file, or if it is stale or corrupt.
+    std::optional<Model> load(std::string_view sourcePath, uint64_t optionsHash, ecs::registry &reg, TextureLoader &textureLoader, TextureLoaderOptions const &textureOptions) const;
+};
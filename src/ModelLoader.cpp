@@ -1,7 +1,15 @@
 // Source: github.com/nikitawew/breakout
 #include "Model.hpp" 
 #include "Loaders.hpp"
+#include "AnimationCompression.hpp"
+#include "AssetCache.hpp"
 #include "Logging.hpp"
+#include "ModelCache.hpp"
+#include "PixelFormat.hpp"
+#include "Serialization.hpp"
+#include "TextureProcessing.hpp"
+#include "ThreadPool.hpp"
+#include "VertexFormat.hpp"
 #include <filesystem>
 #include <fmt/chrono.h>
 #include <glm/ext/quaternion_geometric.hpp>
@@ -83,6 +91,7 @@ static void setMissingTextures(Material::Textures &material, Material::Textures
     if(!material.ambient     ) material.ambient      = defaultMaterial.ambient;
     if(!material.normal      ) material.normal       = defaultMaterial.normal;
     if(!material.displacement) material.displacement = defaultMaterial.displacement;
+    if(!material.orm         ) material.orm          = defaultMaterial.orm;
 }
 static aiNodeAnim const *findNodeAnim(aiAnimation const *animation, std::string_view nodeName)
 {
@@ -170,43 +179,268 @@ static void calculateMissingPrimitives(Mesh &mesh)
         }
     }
 }
-static void optimizeMesh(Mesh &mesh)
+template<typename T>
+static void remapStream(std::vector<T> &stream, std::vector<unsigned> const &remap, size_t newVertexCount)
 {
-    Mesh oldMesh = mesh;
-    bool indexed = !oldMesh.geometry.indices.empty();
+    if(stream.empty())
+        return;
+    std::vector<T> result(newVertexCount);
+    meshopt_remapVertexBuffer(result.data(), stream.data(), stream.size(), sizeof(T), remap.data());
+    stream = std::move(result);
+}
+static void remapStreams(Mesh::Geometry &geometry, std::vector<unsigned> const &remap, size_t newVertexCount)
+{
+    remapStream(geometry.positions, remap, newVertexCount);
+    remapStream(geometry.texCoords, remap, newVertexCount);
+    remapStream(geometry.normals,   remap, newVertexCount);
+    remapStream(geometry.tangents,  remap, newVertexCount);
+    remapStream(geometry.boneIDs,   remap, newVertexCount);
+    remapStream(geometry.weights,   remap, newVertexCount);
+}
+static size_t getVertexSize(Mesh::Geometry const &geometry)
+{
+    return sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3) + sizeof(glm::vec3) + 
+        (geometry.boneIDs.empty() ? 0 : sizeof(glm::u16vec4) + sizeof(glm::u8vec4));
+}
+static void optimizeMesh(Mesh &mesh, MeshOptimizationOptions const &options)
+{
+    auto &geometry = mesh.geometry;
+    bool indexed = !geometry.indices.empty();
+    size_t oldIndexCount = geometry.indices.size();
+    size_t oldVertexCount = geometry.positions.size();
 
-    size_t index_count = indexed ? oldMesh.geometry.indices.size() : oldMesh.geometry.positions.size();
-    size_t vertex_count = indexed ? oldMesh.geometry.positions.size() : index_count;
+    size_t index_count = indexed ? geometry.indices.size() : geometry.positions.size();
+    size_t vertex_count = geometry.positions.size();
     std::vector<meshopt_Stream> streams = {
-        meshopt_Stream{oldMesh.geometry.positions.data(), sizeof(glm::vec3), sizeof(glm::vec3)},
-        meshopt_Stream{oldMesh.geometry.texCoords.data(), sizeof(glm::vec2), sizeof(glm::vec2)},
-        meshopt_Stream{oldMesh.geometry.normals  .data(), sizeof(glm::vec3), sizeof(glm::vec3)},
-        meshopt_Stream{oldMesh.geometry.tangents .data(), sizeof(glm::vec3), sizeof(glm::vec3)}
+        meshopt_Stream{geometry.positions.data(), sizeof(glm::vec3), sizeof(glm::vec3)},
+        meshopt_Stream{geometry.texCoords.data(), sizeof(glm::vec2), sizeof(glm::vec2)},
+        meshopt_Stream{geometry.normals  .data(), sizeof(glm::vec3), sizeof(glm::vec3)},
+        meshopt_Stream{geometry.tangents .data(), sizeof(glm::vec3), sizeof(glm::vec3)}
     };
 
-    if(!oldMesh.geometry.boneIDs.empty())
+    if(!geometry.boneIDs.empty())
     {
-        streams.emplace_back(meshopt_Stream{oldMesh.geometry.boneIDs.data(), sizeof(glm::ivec4), sizeof(glm::ivec4)});
-        streams.emplace_back(meshopt_Stream{oldMesh.geometry.weights.data(), sizeof(glm::vec4),  sizeof(glm::vec4)});
+        streams.emplace_back(meshopt_Stream{geometry.boneIDs.data(), sizeof(glm::u16vec4), sizeof(glm::u16vec4)});
+        streams.emplace_back(meshopt_Stream{geometry.weights.data(), sizeof(glm::u8vec4), sizeof(glm::u8vec4)});
     }
 
+    // Deduplicate vertices.
     std::vector<unsigned int> remap(vertex_count);
-    size_t new_vertex_count = meshopt_generateVertexRemapMulti(remap.data(), indexed ? oldMesh.geometry.indices.data() : nullptr, index_count, vertex_count, streams.data(), streams.size());
-    mesh.geometry.indices.resize(index_count); meshopt_remapIndexBuffer(mesh.geometry.indices.data(), indexed ? oldMesh.geometry.indices.data() : nullptr, index_count, remap.data());
-    mesh.geometry.positions.resize(new_vertex_count); meshopt_remapVertexBuffer(mesh.geometry.positions.data(), streams[0].data, vertex_count, streams[0].size, remap.data());
-    mesh.geometry.texCoords.resize(new_vertex_count); meshopt_remapVertexBuffer(mesh.geometry.texCoords.data(), streams[1].data, vertex_count, streams[1].size, remap.data());
-    mesh.geometry.normals  .resize(new_vertex_count); meshopt_remapVertexBuffer(mesh.geometry.normals  .data(), streams[2].data, vertex_count, streams[2].size, remap.data());
-    mesh.geometry.tangents .resize(new_vertex_count); meshopt_remapVertexBuffer(mesh.geometry.tangents .data(), streams[3].data, vertex_count, streams[3].size, remap.data());
-    if(!oldMesh.geometry.boneIDs.empty())
-    {
-        mesh.geometry.boneIDs  .resize(new_vertex_count); meshopt_remapVertexBuffer(mesh.geometry.boneIDs  .data(), streams[4].data, vertex_count, streams[4].size, remap.data());
-        mesh.geometry.weights  .resize(new_vertex_count); meshopt_remapVertexBuffer(mesh.geometry.weights  .data(), streams[5].data, vertex_count, streams[5].size, remap.data());
-    }
+    size_t new_vertex_count = meshopt_generateVertexRemapMulti(remap.data(), indexed ? geometry.indices.data() : nullptr, index_count, vertex_count, streams.data(), streams.size());
+    std::vector<unsigned int> indices(index_count);
+    meshopt_remapIndexBuffer(indices.data(), indexed ? geometry.indices.data() : nullptr, index_count, remap.data());
+    geometry.indices = std::move(indices);
+    remapStreams(geometry, remap, new_vertex_count);
 
-    if(oldMesh.geometry.indices.size() == mesh.geometry.indices.size() && oldMesh.geometry.positions.size() == mesh.geometry.positions.size())
+    if(oldIndexCount == geometry.indices.size() && oldVertexCount == geometry.positions.size())
         MODEL_LOADER_TRACE("Optimized mesh. Nothing changed.");
     else
-        MODEL_LOADER_TRACE("Optimized mesh. Had {} indices and {} vertices. Has {} indices and {} vertices", oldMesh.geometry.indices.size(), oldMesh.geometry.positions.size(), mesh.geometry.indices.size(), mesh.geometry.positions.size());
+        MODEL_LOADER_TRACE("Optimized mesh. Had {} indices and {} vertices. Has {} indices and {} vertices", oldIndexCount, oldVertexCount, geometry.indices.size(), geometry.positions.size());
+
+    // Reorder for the GPU: vertex cache, then overdraw (which keeps most of the cache efficiency), then vertex fetch.
+    constexpr unsigned ANALYZE_CACHE_SIZE = 16;
+    size_t vertexSize = getVertexSize(geometry);
+    meshopt_VertexCacheStatistics cacheBefore{};
+    meshopt_VertexFetchStatistics fetchBefore{};
+    if(options.statistics)
+    {
+        cacheBefore = meshopt_analyzeVertexCache(geometry.indices.data(), geometry.indices.size(), geometry.positions.size(), ANALYZE_CACHE_SIZE, 0, 0);
+        fetchBefore = meshopt_analyzeVertexFetch(geometry.indices.data(), geometry.indices.size(), geometry.positions.size(), vertexSize);
+    }
+
+    if(options.vertexCache)
+    {
+        meshopt_optimizeVertexCache(geometry.indices.data(), geometry.indices.data(), geometry.indices.size(), geometry.positions.size());
+        if(options.overdraw)
+            meshopt_optimizeOverdraw(geometry.indices.data(), geometry.indices.data(), geometry.indices.size(), &geometry.positions[0].x, geometry.positions.size(), sizeof(glm::vec3), options.overdrawThreshold);
+    }
+    if(options.vertexFetch)
+    {
+        std::vector<unsigned int> fetchRemap(geometry.positions.size());
+        size_t usedVertexCount = meshopt_optimizeVertexFetchRemap(fetchRemap.data(), geometry.indices.data(), geometry.indices.size(), geometry.positions.size());
+        meshopt_remapIndexBuffer(geometry.indices.data(), geometry.indices.data(), geometry.indices.size(), fetchRemap.data());
+        remapStreams(geometry, fetchRemap, usedVertexCount);
+    }
+
+    if(options.statistics)
+    {
+        auto cacheAfter = meshopt_analyzeVertexCache(geometry.indices.data(), geometry.indices.size(), geometry.positions.size(), ANALYZE_CACHE_SIZE, 0, 0);
+        auto fetchAfter = meshopt_analyzeVertexFetch(geometry.indices.data(), geometry.indices.size(), geometry.positions.size(), vertexSize);
+        MODEL_LOADER_TRACE("Vertex cache: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}. Vertex fetch: overfetch {:.3f} -> {:.3f}",
+            cacheBefore.acmr, cacheAfter.acmr, cacheBefore.atvr, cacheAfter.atvr, fetchBefore.overfetch, fetchAfter.overfetch);
+    }
+}
+template<typename T>
+static std::vector<T> gatherStream(std::vector<T> const &stream, std::vector<unsigned> const &vertices)
+{
+    std::vector<T> result;
+    if(stream.empty())
+        return result;
+    result.reserve(vertices.size());
+    for(unsigned vertex : vertices)
+        result.emplace_back(stream[vertex]);
+    return result;
+}
+/// @brief Split the geometry into parts of at most @p maxVertices vertices each.
+/// Triangles are taken in their optimized order, which keeps every part spatially coherent and its vertices in fetch order.
+static std::vector<Mesh::Geometry> splitGeometry(Mesh::Geometry &&geometry, size_t maxVertices)
+{
+    std::vector<Mesh::Geometry> parts;
+    if(geometry.positions.size() <= maxVertices)
+    {
+        parts.emplace_back(std::move(geometry));
+        return parts;
+    }
+
+    constexpr unsigned UNUSED = ~0u;
+    std::vector<unsigned> remap(geometry.positions.size(), UNUSED);
+    std::vector<unsigned> vertices; // source vertices of the current part
+    std::vector<unsigned> indices;
+    auto flush = [&]{
+        auto &part = parts.emplace_back();
+        part.positions = gatherStream(geometry.positions, vertices);
+        part.texCoords = gatherStream(geometry.texCoords, vertices);
+        part.normals   = gatherStream(geometry.normals,   vertices);
+        part.tangents  = gatherStream(geometry.tangents,  vertices);
+        part.boneIDs   = gatherStream(geometry.boneIDs,   vertices);
+        part.weights   = gatherStream(geometry.weights,   vertices);
+        part.indices = std::move(indices);
+        for(unsigned vertex : vertices)
+            remap[vertex] = UNUSED;
+        vertices.clear();
+        indices.clear();
+    };
+
+    for(size_t i = 0; i + 2 < geometry.indices.size(); i += 3)
+    {
+        unsigned const *triangle = &geometry.indices[i];
+        unsigned a = triangle[0], b = triangle[1], c = triangle[2];
+        size_t newVertices = (remap[a] == UNUSED) + (remap[b] == UNUSED && b != a) + (remap[c] == UNUSED && c != a && c != b);
+        if(vertices.size() + newVertices > maxVertices)
+            flush();
+        for(unsigned j = 0; j < 3; ++j)
+        {
+            if(remap[triangle[j]] == UNUSED)
+            {
+                remap[triangle[j]] = static_cast<unsigned>(vertices.size());
+                vertices.emplace_back(triangle[j]);
+            }
+            indices.emplace_back(remap[triangle[j]]);
+        }
+    }
+    if(!indices.empty())
+        flush();
+
+    MODEL_LOADER_TRACE("Split mesh with {} vertices into {} parts", geometry.positions.size(), parts.size());
+    return parts;
+}
+static void generateLods(Mesh::Geometry &geometry, LodOptions const &options)
+{
+    unsigned fullCount = static_cast<unsigned>(geometry.indices.size());
+    geometry.lods = {Mesh::Geometry::Lod{.indexOffset = 0, .indexCount = fullCount, .error = 0.0f}};
+    if(options.maxLevels <= 1 || fullCount / 3 <= options.minTriangles)
+        return;
+
+    float const *positions = &geometry.positions[0].x;
+    size_t vertexCount = geometry.positions.size();
+    // meshopt reports errors relative to the mesh extents.
+    float errorScale = meshopt_simplifyScale(positions, vertexCount, sizeof(glm::vec3));
+
+    // Every level is simplified from the full detail one, so its error is measured against it.
+    std::vector<unsigned> fullIndices(geometry.indices.begin(), geometry.indices.end());
+    std::vector<unsigned> lodIndices(fullCount);
+    float target = static_cast<float>(fullCount);
+    for(unsigned level = 1; level < options.maxLevels; ++level)
+    {
+        target *= options.reduction;
+        size_t targetCount = static_cast<size_t>(target) / 3 * 3;
+        if(targetCount / 3 < options.minTriangles)
+            break;
+
+        float error = 0.0f;
+        size_t count = meshopt_simplify(lodIndices.data(), fullIndices.data(), fullCount, positions, vertexCount, sizeof(glm::vec3), targetCount, options.maxError, 0, &error);
+        if(options.sloppy && count > targetCount + targetCount / 2)
+            count = meshopt_simplifySloppy(lodIndices.data(), fullIndices.data(), fullCount, positions, vertexCount, sizeof(glm::vec3), nullptr, targetCount, options.maxError, &error);
+
+        // Stop once a level doesn't get meaningfully smaller than the previous one.
+        if(count == 0 || count >= geometry.lods.back().indexCount * 9 / 10)
+            break;
+
+        meshopt_optimizeVertexCache(lodIndices.data(), lodIndices.data(), count, vertexCount);
+        geometry.lods.emplace_back(Mesh::Geometry::Lod{
+            .indexOffset = static_cast<unsigned>(geometry.indices.size()),
+            .indexCount = static_cast<unsigned>(count),
+            .error = std::max(error * errorScale, geometry.lods.back().error)
+        });
+        geometry.indices.insert(geometry.indices.end(), lodIndices.begin(), lodIndices.begin() + count);
+    }
+
+    for(size_t i = 1; i < geometry.lods.size(); ++i)
+        MODEL_LOADER_TRACE("LOD {}: {} triangles, error {}", i, geometry.lods[i].indexCount / 3, geometry.lods[i].error);
+}
+static void buildMeshlets(Mesh::Geometry &geometry, MeshletOptions const &options)
+{
+    if(!options.enabled || geometry.indices.empty())
+        return;
+
+    float const *positions = &geometry.positions[0].x;
+    size_t vertexCount = geometry.positions.size();
+    size_t indexCount = geometry.lods.empty() ? geometry.indices.size() : geometry.lods[0].indexCount;
+
+    size_t maxMeshlets = meshopt_buildMeshletsBound(indexCount, options.maxVertices, options.maxTriangles);
+    std::vector<meshopt_Meshlet> meshlets(maxMeshlets);
+    geometry.meshletVertices.resize(maxMeshlets * options.maxVertices);
+    geometry.meshletTriangles.resize(maxMeshlets * options.maxTriangles * 3);
+    meshlets.resize(meshopt_buildMeshlets(meshlets.data(), geometry.meshletVertices.data(), geometry.meshletTriangles.data(),
+        geometry.indices.data(), indexCount, positions, vertexCount, sizeof(glm::vec3), options.maxVertices, options.maxTriangles, options.coneWeight));
+    if(meshlets.empty())
+        return;
+
+    auto const &last = meshlets.back();
+    geometry.meshletVertices.resize(last.vertex_offset + last.vertex_count);
+    geometry.meshletTriangles.resize(last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3));
+
+    // Write the full detail triangles back in meshlet order, so each meshlet is a contiguous index range.
+    unsigned indexOffset = 0;
+    geometry.meshlets.clear();
+    geometry.meshlets.reserve(meshlets.size());
+    for(auto const &meshlet : meshlets)
+    {
+        meshopt_optimizeMeshlet(&geometry.meshletVertices[meshlet.vertex_offset], &geometry.meshletTriangles[meshlet.triangle_offset], meshlet.triangle_count, meshlet.vertex_count);
+        meshopt_Bounds bounds = meshopt_computeMeshletBounds(&geometry.meshletVertices[meshlet.vertex_offset], &geometry.meshletTriangles[meshlet.triangle_offset],
+            meshlet.triangle_count, positions, vertexCount, sizeof(glm::vec3));
+
+        geometry.meshlets.emplace_back(Mesh::Geometry::Meshlet{
+            .vertexOffset = meshlet.vertex_offset,
+            .triangleOffset = meshlet.triangle_offset,
+            .vertexCount = meshlet.vertex_count,
+            .triangleCount = meshlet.triangle_count,
+            .indexOffset = indexOffset,
+            .center = {bounds.center[0], bounds.center[1], bounds.center[2]},
+            .radius = bounds.radius,
+            .coneApex = {bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2]},
+            .coneCutoff = bounds.cone_cutoff,
+            .coneAxis = {bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2]},
+        });
+        for(unsigned i = 0; i < meshlet.triangle_count * 3; ++i)
+            geometry.indices[indexOffset++] = geometry.meshletVertices[meshlet.vertex_offset + geometry.meshletTriangles[meshlet.triangle_offset + i]];
+    }
+
+    MODEL_LOADER_TRACE("Built {} meshlets", geometry.meshlets.size());
+}
+static void calculateBounds(Mesh::Geometry &geometry)
+{
+    glm::vec3 min{std::numeric_limits<float>::max()};
+    glm::vec3 max{std::numeric_limits<float>::lowest()};
+    for(auto const &position : geometry.positions)
+    {
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+    geometry.bounds.center = (min + max) * 0.5f;
+    geometry.bounds.radius = 0.0f;
+    for(auto const &position : geometry.positions)
+        geometry.bounds.radius = std::max(geometry.bounds.radius, glm::distance(position, geometry.bounds.center));
 }
 static void moveMesh(Mesh::Geometry &primitives, glm::mat4 const &mat)
 {
@@ -243,14 +477,10 @@ static void extractVertexData(aiMesh const *aimesh, Mesh &mesh)
         }
     }
 }
-static void extractBoneData(aiMesh const *aimesh, Mesh &mesh, Model::Skeleton &skeleton)
+/// @brief Give every bone of the mesh an ID. Must run for all meshes before extractBoneData.
+static void registerBones(aiMesh const *aimesh, Model::Skeleton &skeleton)
 {
-    // i hate it -- april 2025
-    // it works -- october 2025
-    glm::ivec4 boneIDs{-1}; mesh.geometry.boneIDs.resize(mesh.geometry.positions.size(), boneIDs);
-    glm::vec4 weights{0}; mesh.geometry.weights.resize(mesh.geometry.positions.size(), weights);
     for(unsigned boneIndex = 0; boneIndex < aimesh->mNumBones; ++boneIndex) {
-        int boneID = -1;
         aiBone const *bone = aimesh->mBones[boneIndex];
         std::string boneName = bone->mName.C_Str();
         if(skeleton.boneMap.find(boneName) == skeleton.boneMap.end())
@@ -258,35 +488,45 @@ static void extractBoneData(aiMesh const *aimesh, Mesh &mesh, Model::Skeleton &s
             unsigned id = skeleton.boneMap.size();
             skeleton.bindTransform.emplace_back(toMat4(bone->mOffsetMatrix));
             skeleton.boneMap.try_emplace(boneName, id);
-            boneID = id;
-        } else
-        {
-            boneID = skeleton.boneMap.at(boneName);
         }
-        assert(boneID != -1);
+    }
+}
+static void extractBoneData(aiMesh const *aimesh, Mesh &mesh, Model::Skeleton const &skeleton)
+{
+    // i hate it -- april 2025
+    // it works -- october 2025
+    // The 4 strongest influences of every vertex are kept, quantizing renormalizes them
+    size_t numVertices = mesh.geometry.positions.size();
+    std::vector<glm::uvec4> boneIDs(numVertices, glm::uvec4(0));
+    std::vector<glm::vec4> weights(numVertices, glm::vec4(0.0f));
+    for(unsigned boneIndex = 0; boneIndex < aimesh->mNumBones; ++boneIndex) {
+        aiBone const *bone = aimesh->mBones[boneIndex];
+        unsigned boneID = skeleton.boneMap.at(bone->mName.C_Str());
 
         for(unsigned weightIndex = 0; weightIndex < bone->mNumWeights; ++weightIndex)
         {
             unsigned vertexID = bone->mWeights[weightIndex].mVertexId;
-            assert(vertexID < mesh.geometry.positions.size());
-            // record it in the first uninitialized slot
-            for(unsigned i = 0; i < 4; ++i)
+            float weight = bone->mWeights[weightIndex].mWeight;
+            assert(vertexID < numVertices);
+            unsigned weakest = 0;
+            for(unsigned i = 1; i < 4; ++i)
+                if(weights[vertexID][i] < weights[vertexID][weakest])
+                    weakest = i;
+            if(weight > weights[vertexID][weakest])
             {
-                if(mesh.geometry.boneIDs[vertexID][i] == -1)
-                {
-                    mesh.geometry.boneIDs[vertexID][i] = boneID;
-                    mesh.geometry.weights[vertexID][i] = bone->mWeights[weightIndex].mWeight;
-                    break;
-                }
+                boneIDs[vertexID][weakest] = boneID;
+                weights[vertexID][weakest] = weight;
             }
         }
     }
-}
-static void normalizeWeights(Mesh::Geometry &geometry)
-{
-    for(auto &weight : geometry.weights)
-        if(weight[0] + weight[1] + weight[2] + weight[3] > 1e-6f)
-            weight /= weight[0] + weight[1] + weight[2] + weight[3];
+
+    mesh.geometry.boneIDs.resize(numVertices);
+    mesh.geometry.weights.resize(numVertices);
+    for(size_t i = 0; i < numVertices; ++i)
+    {
+        mesh.geometry.boneIDs[i] = glm::u16vec4(boneIDs[i]);
+        mesh.geometry.weights[i] = quantizeBoneWeights(weights[i]);
+    }
 }
 
 struct ModelLoaderImpl
@@ -298,15 +538,22 @@ struct ModelLoaderImpl
     aiScene const *mScene = nullptr;
     Model *mModel = nullptr;
     ecs::registry *mRegistry = nullptr;
+    std::vector<Material> mMaterials; // converted scene materials, by index
+    std::vector<unsigned> mMaterialIds; // Mesh::materialId of every scene material, equal materials share it
+    std::vector<TextureLoadRequest> mTextureRequests; // textures of the materials, decoded in one batch
+    std::vector<ecs::entity *> mTextureTargets; // the material slot of every request
 
     // === === === ===
     ModelLoaderImpl(ecs::registry &reg);
     ecs::entity fromRawAssimpTexture(aiTexture const *texture);
-    void loadMaterialTexture(aiMaterial const *material, aiTextureType const type, ecs::entity &out);
-    Material convertMaterial(aiMaterial const *aimaterial, Material::Properties const &defaultProperties);
-    Mesh processMesh(aiMesh const *aimesh, glm::mat4 const &transform);
+    ecs::entity packOrm(Material::Textures const &textures);
+    void loadMaterialTexture(aiMaterial const *material, aiTextureType const type, MaterialTextureSlot slot, ecs::entity &out);
+    void convertMaterial(aiMaterial const *aimaterial, Material::Properties const &defaultProperties, Material &material);
+    void loadMaterials(std::span<std::pair<aiMesh const *, glm::mat4> const> meshes);
+    Material processMaterial(aiMesh const *aimesh);
+    std::vector<Mesh> processMesh(aiMesh const *aimesh, glm::mat4 const &transform) const;
     ecs::entity load();
-    void processNodeMeshes(aiNode const *node, glm::mat4 parentTransform = glm::mat4{1.0f});
+    void collectNodeMeshes(aiNode const *node, std::vector<std::pair<aiMesh const *, glm::mat4>> &out, glm::mat4 parentTransform = glm::mat4{1.0f});
     Animation processAnimation(aiAnimation const *animation);
     ecs::entity processLight(aiLight const *light);
 };
@@ -314,24 +561,12 @@ struct ModelLoaderImpl
 ModelLoaderImpl::ModelLoaderImpl(ecs::registry &reg)
 {
     mRegistry = &reg;
-    ecs::entity white = 0;
-    ecs::entity normal = 0;
-    ecs::entity black = 0;
-    ecs::entity tile = 0;
-
-    for(ecs::entity e_texture : mRegistry->view<Texture>())
-    {
-        auto &texture = mRegistry->get<Texture>(e_texture);
-
-        if(texture.path == "default/white")
-            white = e_texture;
-        if(texture.path == "default/normal")
-            normal = e_texture;
-        if(texture.path == "default/black")
-            black = e_texture;
-        if(texture.path == "default/tile")
-            tile = e_texture;
-    }
+    AssetCache const &cache = AssetCache::of(reg);
+    ecs::entity white = cache.find(AssetKind::texture, "default/white");
+    ecs::entity normal = cache.find(AssetKind::texture, "default/normal");
+    ecs::entity black = cache.find(AssetKind::texture, "default/black");
+    ecs::entity tile = cache.find(AssetKind::texture, "default/tile");
+    ecs::entity orm = cache.find(AssetKind::texture, "default/orm");
 
     if(!white)
         white = mRegistry->create(Texture{
@@ -388,6 +623,26 @@ ModelLoaderImpl::ModelLoaderImpl(ecs::registry &reg)
             .srgb = true,
             .path = "default/tile"
         });
+    if(!orm)
+        orm = mRegistry->create(Texture{
+            .bitmap = Bitmap<unsigned char>{
+                .pixels = {
+                    255, 255, 0 // the ambient, roughness and metallic defaults below
+                },
+                .numComponents = 3,
+                .size = {1, 1},
+            },
+            .srgb = false,
+            .path = "default/orm"
+        });
+    // Index the ones made here, the defaults are shared by every loader of the registry.
+    // They are written as RGB above and stored as RGBA like loaded textures, so they upload as they are.
+    for(ecs::entity e_texture : {white, normal, black, tile, orm})
+        if(!AssetCache::of(reg).getEntry(e_texture))
+        {
+            convertTextureToRGBA(mRegistry->get<Texture>(e_texture));
+            AssetCache::of(reg).insert(AssetKind::texture, mRegistry->get<Texture>(e_texture).path, e_texture);
+        }
 
     mDefaultMaterial = {
         .textures = {
@@ -397,6 +652,7 @@ ModelLoaderImpl::ModelLoaderImpl(ecs::registry &reg)
             .ambient      = white,
             .normal       = normal,
             .displacement = black,
+            .orm          = orm,
         },
         .properties = {
             .ambient       = {0.1f, 0.1f, 0.1f},
@@ -424,7 +680,7 @@ Material ModelLoader::getDefaultMaterial() const
 }
 ecs::entity ModelLoaderImpl::fromRawAssimpTexture(aiTexture const *texture)
 {
-    assert(texture->mHeight == 0);
+    assert(texture->mHeight != 0 && "compressed aiTextures are decoded from memory");
     unsigned const width = static_cast<unsigned>(texture->mWidth);
     unsigned const height = static_cast<unsigned>(texture->mHeight);
 
@@ -435,29 +691,42 @@ ecs::entity ModelLoaderImpl::fromRawAssimpTexture(aiTexture const *texture)
     }
 
     Texture result;
+    // Every texel is written below, the pixels are left uninitialized
     result.bitmap = Bitmap<unsigned char>{
+        .pixels = PixelBuffer<unsigned char>(static_cast<size_t>(width) * height * 4),
         .numComponents = 4,
         .size = {width, height}
     };
     // result.path = "raw resource " + stringID() + " aiTexture " + texture->mFilename.C_Str();
 
-    for (size_t i = 0; i < width * height; ++i)
-    {
-        aiTexel const &texel = texture->pcData[i];
-        glm::uvec2 pixel{static_cast<unsigned>(i % width), static_cast<unsigned>(i / width)};
-        *reinterpret_cast<glm::vec<4, unsigned char> *>(&result.bitmap.pixels[result.bitmap.getOffsetOf(pixel)]) = {
-            /* u8ToFloat */(texel.r),
-            /* u8ToFloat */(texel.g),
-            /* u8ToFloat */(texel.b),
-            /* u8ToFloat */(texel.a)
-        };
-    }
+    // aiTexels are BGRA
+    static_assert(sizeof(aiTexel) == 4);
+    swizzleBGRA(reinterpret_cast<unsigned char const *>(texture->pcData), result.bitmap.pixels.data(), static_cast<size_t>(width) * height);
+    TextureLoaderOptions const &options = mOptions.textureOptions;
+    downscaleTexture(result, getSkippedLevels(result.bitmap.size, options.maxDimension, options.maxBytes));
 
     return mRegistry->create(std::move(result));
 }
-void ModelLoaderImpl::loadMaterialTexture(aiMaterial const *material, aiTextureType const type, ecs::entity &out)
+TextureLoaderOptions getMaterialTextureOptions(TextureLoaderOptions options, MaterialTextureSlot slot)
+{
+    options.srgb = slot == MaterialTextureSlot::albedo;
+    if(slot == MaterialTextureSlot::normal)
+        options.usage = TextureUsage::normal;
+    else if(slot == MaterialTextureSlot::orm)
+        options.usage = TextureUsage::color; // three unrelated channels, BC7 keeps them apart
+    else if(slot != MaterialTextureSlot::albedo)
+        options.usage = TextureUsage::mask;
+    if(slot == MaterialTextureSlot::ambient || slot == MaterialTextureSlot::roughness || slot == MaterialTextureSlot::metallic)
+    {
+        options.generateMips = false;
+        options.compression.enabled = false;
+    }
+    return options;
+}
+// Textures decoded from files or compressed data are only queued, loadMaterials() decodes them all at once.
+void ModelLoaderImpl::loadMaterialTexture(aiMaterial const *material, aiTextureType const type, MaterialTextureSlot slot, ecs::entity &out)
 {
-    if(material->GetTextureCount(type) == 0 || out)
+    if(material->GetTextureCount(type) == 0 || out || std::find(mTextureTargets.begin(), mTextureTargets.end(), &out) != mTextureTargets.end())
         return;
 
     // load the first texture (multiple texture of the same type are not supported)
@@ -465,7 +734,7 @@ void ModelLoaderImpl::loadMaterialTexture(aiMaterial const *material, aiTextureT
     aiString str;
     if(material->GetTexture(type, 0, &str) != AI_SUCCESS)
         return;
-    bool srgb = type == aiTextureType_DIFFUSE;
+    TextureLoaderOptions options = getMaterialTextureOptions(mOptions.textureOptions, slot);
 
     aiTexture const *embedded = mScene->GetEmbeddedTexture(str.C_Str());
     if(embedded)
@@ -473,11 +742,18 @@ void ModelLoaderImpl::loadMaterialTexture(aiMaterial const *material, aiTextureT
         if(embedded->mHeight == 0)
         {
             MODEL_LOADER_TRACE("Loading embedded compressed texture \"{}\"", embedded->mFilename.C_Str());
-            out = mTextureLoader.loadFromMemory(embedded->pcData, embedded->mWidth, mOptions.textureOptions);
+            mTextureRequests.push_back({
+                .path = "loadFromMemory",
+                .data = {reinterpret_cast<unsigned char const *>(embedded->pcData), embedded->mWidth},
+                .options = options
+            });
+            mTextureTargets.push_back(&out);
         } else
         {
             MODEL_LOADER_TRACE("Loading embedded raw texture \"{}\"", embedded->mFilename.C_Str());
             out = fromRawAssimpTexture(embedded);
+            if(out)
+                processLoadedTexture(mRegistry->get<Texture>(out), options);
         }
     }
     else
@@ -485,27 +761,51 @@ void ModelLoaderImpl::loadMaterialTexture(aiMaterial const *material, aiTextureT
         std::string filepath = directory + '/' + str.C_Str();
     
         MODEL_LOADER_TRACE("Loading file texture \"{}\"", filepath);
-        out = mTextureLoader.loadFromFile(filepath, mOptions.textureOptions);
-    }
-
-    if(out)
-    {
-        auto &tex = mRegistry->get<Texture>(out);
-        tex.srgb = srgb;
+        mTextureRequests.push_back({.path = std::move(filepath), .options = options});
+        mTextureTargets.push_back(&out);
     }
 }
-Material ModelLoaderImpl::convertMaterial(aiMaterial const *aimaterial, Material::Properties const &defaultProperties)
+// glTF keeps roughness and metallic in the G and B channels of one texture (and often occlusion in R),
+// assimp hands it out as both the roughness and the metallic texture. Other formats have a grey map for each.
+ecs::entity ModelLoaderImpl::packOrm(Material::Textures const &textures)
+{
+    Material::Textures const &defaults = mDefaultMaterial.textures;
+    if(textures.ambient == defaults.ambient && textures.roughness == defaults.roughness && textures.metallic == defaults.metallic)
+        return defaults.orm;
+
+    bool combined = textures.roughness == textures.metallic;
+    auto packed = packOrmTexture(
+        {mRegistry->get<Texture>(textures.ambient), 0},
+        {mRegistry->get<Texture>(textures.roughness), combined ? 1u : 0u},
+        {mRegistry->get<Texture>(textures.metallic), combined ? 2u : 0u});
+    if(!packed)
+        return defaults.orm;
+
+    TextureLoaderOptions options = getMaterialTextureOptions(mOptions.textureOptions, MaterialTextureSlot::orm);
+    auto const &pixels = packed->bitmap.pixels;
+    uint64_t hash = TextureLoader::hashOptions(options, hashBytes(pixels.data(), pixels.size(), hashValue(packed->bitmap.size)));
+
+    // Materials sharing their textures share the packed one as well
+    AssetCache &cache = AssetCache::of(*mRegistry);
+    if(ecs::entity e_orm = cache.acquireByContent(AssetKind::texture, hash))
+        return e_orm;
+    processLoadedTexture(*packed, options);
+    ecs::entity e_orm = mRegistry->create(std::move(*packed));
+    cache.insert(AssetKind::texture, {}, e_orm, hash);
+    return e_orm;
+}
+void ModelLoaderImpl::convertMaterial(aiMaterial const *aimaterial, Material::Properties const &defaultProperties, Material &material)
 {
-    Material material;
-
     // https://github.com/assimp/assimp/issues/430
-    loadMaterialTexture(aimaterial, aiTextureType_DIFFUSE,           material.textures.albedo      );
-    loadMaterialTexture(aimaterial, aiTextureType_NORMALS,           material.textures.normal      );
-    loadMaterialTexture(aimaterial, aiTextureType_HEIGHT,            material.textures.normal      );
-    loadMaterialTexture(aimaterial, aiTextureType_DISPLACEMENT,      material.textures.displacement);
-    loadMaterialTexture(aimaterial, aiTextureType_AMBIENT_OCCLUSION, material.textures.ambient     );
-    loadMaterialTexture(aimaterial, aiTextureType_DIFFUSE_ROUGHNESS, material.textures.roughness   );
-    loadMaterialTexture(aimaterial, aiTextureType_METALNESS,         material.textures.metallic    );
+    using enum MaterialTextureSlot;
+    loadMaterialTexture(aimaterial, aiTextureType_DIFFUSE,           albedo,       material.textures.albedo      );
+    loadMaterialTexture(aimaterial, aiTextureType_NORMALS,           normal,       material.textures.normal      );
+    loadMaterialTexture(aimaterial, aiTextureType_HEIGHT,            normal,       material.textures.normal      );
+    loadMaterialTexture(aimaterial, aiTextureType_DISPLACEMENT,      displacement, material.textures.displacement);
+    loadMaterialTexture(aimaterial, aiTextureType_AMBIENT_OCCLUSION, ambient,      material.textures.ambient     );
+    loadMaterialTexture(aimaterial, aiTextureType_LIGHTMAP,          ambient,      material.textures.ambient     ); // glTF's occlusion
+    loadMaterialTexture(aimaterial, aiTextureType_DIFFUSE_ROUGHNESS, roughness,    material.textures.roughness   );
+    loadMaterialTexture(aimaterial, aiTextureType_METALNESS,         metallic,     material.textures.metallic    );
 
     material.properties = {
         .ambient       = getColor(aimaterial, defaultProperties.ambient,       AI_MATKEY_COLOR_AMBIENT),
@@ -517,66 +817,141 @@ Material ModelLoaderImpl::convertMaterial(aiMaterial const *aimaterial, Material
         .metallic      = getColor(aimaterial, defaultProperties.metallic,      AI_MATKEY_METALLIC_FACTOR),
         .ior           = getColor(aimaterial, defaultProperties.ior,           AI_MATKEY_REFRACTI)
     };
+}
+// Converts the materials @p meshes use, their textures are decoded in parallel as one batch.
+void ModelLoaderImpl::loadMaterials(std::span<std::pair<aiMesh const *, glm::mat4> const> meshes)
+{
+    std::vector<bool> used(mScene->mNumMaterials, false);
+    for(auto const &[aimesh, transform] : meshes)
+        if(aimesh->mMaterialIndex < used.size())
+            used[aimesh->mMaterialIndex] = true;
+
+    mMaterials.assign(mScene->mNumMaterials, Material{});
+    for(unsigned i = 0; i < mScene->mNumMaterials; ++i)
+        if(used[i])
+            convertMaterial(mScene->mMaterials[i], mDefaultMaterial.properties, mMaterials[i]);
+
+    MODEL_LOADER_TRACE("Decoding {} textures.", mTextureRequests.size());
+    AssetCache const &cache = AssetCache::of(*mRegistry);
+    AssetCache::Statistics before = cache.getStatistics(AssetKind::texture);
+    std::vector<ecs::entity> textures = mTextureLoader.loadBatch(mTextureRequests);
+    AssetCache::Statistics after = cache.getStatistics(AssetKind::texture);
+    for(size_t i = 0; i < textures.size(); ++i)
+    {
+        *mTextureTargets[i] = textures[i];
+        if(textures[i])
+            mModel->textureReferences.push_back(textures[i]);
+    }
+    mTextureRequests.clear();
+    mTextureTargets.clear();
 
-    return material;
+    for(auto &material : mMaterials)
+        setMissingTextures(material.textures, mDefaultMaterial.textures);
+    for(unsigned i = 0; i < mScene->mNumMaterials; ++i)
+        if(used[i])
+        {
+            mMaterials[i].textures.orm = packOrm(mMaterials[i].textures);
+            if(mMaterials[i].textures.orm != mDefaultMaterial.textures.orm)
+                mModel->textureReferences.push_back(mMaterials[i].textures.orm);
+        }
+
+    // Materials with the same textures and properties (often the case once textures are shared) get the same id
+    mMaterialIds.assign(mScene->mNumMaterials, 0);
+    std::unordered_map<uint64_t, unsigned> firstMaterials; // by hash, into mMaterials
+    unsigned numUsed = 0, numUnique = 0;
+    for(unsigned i = 0; i < mScene->mNumMaterials; ++i)
+    {
+        if(!used[i])
+            continue;
+        ++numUsed;
+        Material const &material = mMaterials[i];
+        uint64_t hash = hashValue(material.properties, hashValue(material.textures));
+        auto [first, inserted] = firstMaterials.emplace(hash, i);
+        Material const &other = mMaterials[first->second];
+        if(!inserted
+            && std::memcmp(&material.textures, &other.textures, sizeof(Material::Textures)) == 0
+            && std::memcmp(&material.properties, &other.properties, sizeof(Material::Properties)) == 0)
+        {
+            mMaterialIds[i] = mMaterialIds[first->second];
+            continue;
+        }
+        mMaterialIds[i] = numUnique++;
+    }
+    LOG_INFO("\"{}\": {} textures decoded, {} shared by path and {} by content, {} unique materials of {}", mModel->path,
+        after.loads - before.loads, after.pathHits - before.pathHits, after.contentHits - before.contentHits, numUnique, numUsed);
 }
 
-Mesh ModelLoaderImpl::processMesh(aiMesh const *aimesh, glm::mat4 const &transform)
+Material ModelLoaderImpl::processMaterial(aiMesh const *aimesh)
+{
+    if(!mScene->HasMaterials())
+        return mDefaultMaterial;
+
+    return mMaterials.at(aimesh->mMaterialIndex);
+}
+// Runs on worker threads: must not touch the registry or modify the model.
+std::vector<Mesh> ModelLoaderImpl::processMesh(aiMesh const *aimesh, glm::mat4 const &transform) const
 {
     MODEL_LOADER_TRACE("Loading mesh \"{}\"", aimesh->mName.C_Str());
     Mesh mesh;
     extractVertexData(aimesh, mesh);
 
-    if(aimesh->HasBones())
-    {
+    // Bone indices are stored in 16 bits
+    if(aimesh->HasBones() && mModel->skeleton.boneMap.size() > UINT16_MAX + 1)
+        LOG_ERROR("Mesh \"{}\" is skinned to one of {} bones, at most {} are supported. Its bones are ignored", aimesh->mName.C_Str(), mModel->skeleton.boneMap.size(), UINT16_MAX + 1);
+    else if(aimesh->HasBones())
         extractBoneData(aimesh, mesh, mModel->skeleton);
-        normalizeWeights(mesh.geometry);
-    }
-
-    if(!mScene->HasMaterials())
-    {
-        mesh.material = mDefaultMaterial;
-    }
-    else
-    {
-        aiMaterial const *aimaterial = mScene->mMaterials[aimesh->mMaterialIndex];
-        mesh.material = convertMaterial(aimaterial, mDefaultMaterial.properties);
-        setMissingTextures(mesh.material.textures, mDefaultMaterial.textures);
-    }
 
     calculateMissingPrimitives(mesh);
-    optimizeMesh(mesh);
+    optimizeMesh(mesh, mOptions.optimization);
 
     // Apply transformation only for meshes.
     // Models with bones should use the bone transformations.
     if(!aimesh->HasBones())
         moveMesh(mesh.geometry, transform);
 
-    return mesh;
+    constexpr size_t MAX_16BIT_VERTICES = 1 << 16;
+    std::vector<Mesh> parts;
+    if(mOptions.optimization.splitFor16BitIndices)
+    {
+        for(auto &geometry : splitGeometry(std::move(mesh.geometry), MAX_16BIT_VERTICES))
+            parts.emplace_back().geometry = std::move(geometry);
+    } else {
+        parts.emplace_back(std::move(mesh));
+    }
+
+    for(auto &part : parts)
+    {
+        part.geometry.indexSize = part.geometry.positions.size() <= MAX_16BIT_VERTICES ? sizeof(uint16_t) : sizeof(uint32_t);
+        part.geometry.boneIndexSize = getBoneIndexSize(part.geometry);
+        calculateBounds(part.geometry);
+        generateLods(part.geometry, mOptions.lods);
+        buildMeshlets(part.geometry, mOptions.meshlets);
+    }
+    return parts;
 }
-void ModelLoaderImpl::processNodeMeshes(aiNode const *node, glm::mat4 parentTransform)
+void ModelLoaderImpl::collectNodeMeshes(aiNode const *node, std::vector<std::pair<aiMesh const *, glm::mat4>> &out, glm::mat4 parentTransform)
 {
     MODEL_LOADER_TRACE("Processing node \"{}\"", node->mName.C_Str());
     glm::mat4 nodeTransform = parentTransform * toMat4(node->mTransformation);
     for(unsigned i = 0; i < node->mNumMeshes; ++i) {
-        mModel->meshes.emplace_back(processMesh(mScene->mMeshes[node->mMeshes[i]], nodeTransform));
+        out.emplace_back(mScene->mMeshes[node->mMeshes[i]], nodeTransform);
     }
     for(unsigned i = 0; i < node->mNumChildren; ++i) {
-        processNodeMeshes(node->mChildren[i], nodeTransform);
+        collectNodeMeshes(node->mChildren[i], out, nodeTransform);
     }
 }
 
-void processAnimationNode(Animation &result, aiAnimation const *animation, Model::Skeleton const &skeleton, aiNode const *node)
+void processAnimationNode(std::vector<SourceKeyframes> &bones, aiAnimation const *animation, Model::Skeleton const &skeleton, aiNode const *node)
 {
     std::string nodeName = node->mName.C_Str();
     aiNodeAnim const *nodeAnim = findNodeAnim(animation, nodeName);
 
     if(nodeAnim && skeleton.boneMap.find(nodeName) != skeleton.boneMap.end()) {
-        auto &keyframes = result.bones.at(skeleton.boneMap.at(nodeName));
+        auto &keyframes = bones.at(skeleton.boneMap.at(nodeName));
         for(unsigned i = 0; i < nodeAnim->mNumPositionKeys; ++i)
         {
             auto const &key = nodeAnim->mPositionKeys[i];
-            keyframes.positions.emplace_back(Animation::PositionKey{
+            keyframes.positions.emplace_back(SourceKeyframes::Key<glm::vec3>{
                 .value = toVec3(key.mValue),
                 .timeTicks = static_cast<float>(key.mTime)
             });
@@ -584,7 +959,7 @@ void processAnimationNode(Animation &result, aiAnimation const *animation, Model
         for(unsigned i = 0; i < nodeAnim->mNumRotationKeys; ++i)
         {
             auto const &key = nodeAnim->mRotationKeys[i];
-            keyframes.orientations.emplace_back(Animation::OrientationKey{
+            keyframes.orientations.emplace_back(SourceKeyframes::Key<glm::quat>{
                 .value = glm::normalize(toQuat(key.mValue)),
                 .timeTicks = static_cast<float>(key.mTime)
             });
@@ -592,7 +967,7 @@ void processAnimationNode(Animation &result, aiAnimation const *animation, Model
         for(unsigned i = 0; i < nodeAnim->mNumScalingKeys; ++i)
         {
             auto const &key = nodeAnim->mScalingKeys[i];
-            keyframes.scales.emplace_back(Animation::ScaleKey{
+            keyframes.scales.emplace_back(SourceKeyframes::Key<glm::vec3>{
                 .value = toVec3(key.mValue),
                 .timeTicks = static_cast<float>(key.mTime)
             });
@@ -600,7 +975,7 @@ void processAnimationNode(Animation &result, aiAnimation const *animation, Model
     }
 
     for(unsigned i = 0; i < node->mNumChildren; ++i) {
-        processAnimationNode(result, animation, skeleton, node->mChildren[i]);
+        processAnimationNode(bones, animation, skeleton, node->mChildren[i]);
     }
 }
 Animation ModelLoaderImpl::processAnimation(aiAnimation const *animation)
@@ -611,15 +986,25 @@ Animation ModelLoaderImpl::processAnimation(aiAnimation const *animation)
     result.durationTicks = (float) animation->mDuration;
     result.ticksPerSecond = (animation->mTicksPerSecond > 0) ? (float) animation->mTicksPerSecond : 24.0f;
     result.name = animation->mName.C_Str();
-    result.bones.resize(mModel->skeleton.boneMap.size());
+    std::vector<SourceKeyframes> bones(mModel->skeleton.boneMap.size());
 
-    processAnimationNode(result, animation, mModel->skeleton, mScene->mRootNode);
+    processAnimationNode(bones, animation, mModel->skeleton, mScene->mRootNode);
 
-    for(auto &bone : result.bones)
+    auto byTime = [](auto const &first, auto const &second){ return first.timeTicks < second.timeTicks; };
+    for(auto &bone : bones)
     {
-        std::sort(bone.positions   .begin(), bone.positions   .end(), [](Animation::PositionKey    const &first, Animation::PositionKey    const &second){ return first.timeTicks < second.timeTicks; });
-        std::sort(bone.orientations.begin(), bone.orientations.end(), [](Animation::OrientationKey const &first, Animation::OrientationKey const &second){ return first.timeTicks < second.timeTicks; });
-        std::sort(bone.scales      .begin(), bone.scales      .end(), [](Animation::ScaleKey       const &first, Animation::ScaleKey       const &second){ return first.timeTicks < second.timeTicks; });
+        std::sort(bone.positions   .begin(), bone.positions   .end(), byTime);
+        std::sort(bone.orientations.begin(), bone.orientations.end(), byTime);
+        std::sort(bone.scales      .begin(), bone.scales      .end(), byTime);
+    }
+
+    AnimationCompressionStats stats = compressAnimation(bones, mModel->skeleton, mOptions.animations, result);
+    if(mOptions.animations.statistics)
+    {
+        MODEL_LOADER_TRACE("Compressed animation \"{}\". Kept {} of {} keys, {} -> {} bytes ({:.1f}x). Max error {} ({:.4f}% of the skeleton size)",
+            result.name, stats.keptKeys, stats.sourceKeys, stats.sourceBytes, stats.compressedBytes,
+            stats.compressedBytes ? static_cast<float>(stats.sourceBytes) / stats.compressedBytes : 0.0f,
+            stats.maxError, stats.skeletonSize > 0.0f ? stats.maxError / stats.skeletonSize * 100.0f : 0.0f);
     }
 
     return result;
@@ -701,7 +1086,32 @@ ecs::entity ModelLoaderImpl::load()
     if(mScene->HasAnimations())
         MODEL_LOADER_TRACE("Loading {} animations.", mScene->mNumAnimations);
 
-    processNodeMeshes(mScene->mRootNode);
+    std::vector<std::pair<aiMesh const *, glm::mat4>> meshes;
+    collectNodeMeshes(mScene->mRootNode, meshes);
+
+    // Bone IDs are assigned up front in node order, so the mesh workers only read the bone map.
+    for(auto const &[aimesh, transform] : meshes)
+        registerBones(aimesh, mModel->skeleton);
+
+    std::vector<std::vector<Mesh>> parts(meshes.size());
+    ThreadPool::global().parallelFor(meshes.size(), [&](size_t i){
+        parts[i] = processMesh(meshes[i].first, meshes[i].second);
+    });
+
+    // Materials create texture entities, the registry is only touched from this thread.
+    if(mScene->HasMaterials())
+        loadMaterials(meshes);
+    for(size_t i = 0; i < meshes.size(); ++i)
+    {
+        Material material = processMaterial(meshes[i].first);
+        unsigned materialId = mScene->HasMaterials() ? mMaterialIds.at(meshes[i].first->mMaterialIndex) : 0;
+        for(auto &part : parts[i])
+        {
+            part.material = material;
+            part.materialId = materialId;
+            mModel->meshes.emplace_back(std::move(part));
+        }
+    }
 
     MODEL_LOADER_TRACE("Model has {} bones.", mModel->skeleton.boneMap.size());
 
@@ -738,6 +1148,38 @@ constexpr unsigned ASSIMP_FLAGS =
     aiProcess_ValidateDataStructure |
     aiProcess_LimitBoneWeights;
 
+/// @brief Hash of everything that changes the loaded data, cooked models made with other options are stale.
+static uint64_t hashOptions(ModelLoaderOptions const &options)
+{
+    uint64_t hash = hashValue(ASSIMP_FLAGS);
+    hash = hashValue(options.flipWindingOrder, hash);
+    hash = hashValue(options.flipUVs, hash);
+    hash = hashValue(options.textureOptions.flip, hash);
+    hash = hashValue(options.textureOptions.generateMips, hash);
+    hash = hashValue(options.textureOptions.premultiplyAlpha, hash);
+    hash = hashValue(options.textureOptions.maxDimension, hash);
+    hash = hashValue(options.textureOptions.maxBytes, hash);
+    hash = hashValue(options.textureOptions.compression.enabled, hash);
+    hash = hashValue(options.textureOptions.compression.quality, hash);
+    hash = hashValue(options.textureOptions.compression.keepBitmap, hash);
+    hash = hashValue(options.optimization.vertexCache, hash);
+    hash = hashValue(options.optimization.overdraw, hash);
+    hash = hashValue(options.optimization.overdrawThreshold, hash);
+    hash = hashValue(options.optimization.vertexFetch, hash);
+    hash = hashValue(options.optimization.splitFor16BitIndices, hash);
+    hash = hashValue(options.lods.maxLevels, hash);
+    hash = hashValue(options.lods.reduction, hash);
+    hash = hashValue(options.lods.maxError, hash);
+    hash = hashValue(options.lods.minTriangles, hash);
+    hash = hashValue(options.lods.sloppy, hash);
+    hash = hashValue(options.meshlets.enabled, hash);
+    hash = hashValue(options.meshlets.maxVertices, hash);
+    hash = hashValue(options.meshlets.maxTriangles, hash);
+    hash = hashValue(options.meshlets.coneWeight, hash);
+    hash = hashValue(options.animations.maxError, hash);
+    return hash;
+}
+
 ModelLoader::ModelLoader(ecs::registry &reg)
 { 
     mImpl = new ModelLoaderImpl{reg};
@@ -746,11 +1188,24 @@ ModelLoader::ModelLoader(ecs::registry &reg)
 ecs::entity ModelLoader::loadFromFile(std::string_view path, ModelLoaderOptions options)
 {
     assert(mImpl && "Invalid loader! (make sure to not use default constructor when making an actual loader)");
-    for(auto e_model : mImpl->mRegistry->view<Model>())
-        if(mImpl->mRegistry->get<Model>(e_model).path == path)
-            return e_model;
+    if(ecs::entity e_model = AssetCache::of(*mImpl->mRegistry).acquire(AssetKind::model, path))
+        return e_model;
 
     MODEL_LOADER_TRACE("---");
+    ModelCache cache{options.cacheDirectory};
+    uint64_t optionsHash = hashOptions(options);
+    if(cache.enabled())
+    {
+        auto cooked = cache.load(path, optionsHash, *mImpl->mRegistry, mImpl->mTextureLoader, options.textureOptions);
+        if(cooked)
+        {
+            MODEL_LOADER_TRACE("Loaded cooked model \"{}\" from \"{}\"", path, cache.getCookedPath(path));
+            ecs::entity e_model = mImpl->mRegistry->create(std::move(*cooked));
+            AssetCache::of(*mImpl->mRegistry).insert(AssetKind::model, path, e_model);
+            return e_model;
+        }
+    }
+
     MODEL_LOADER_TRACE("Loading model \"{}\"", path);
     Assimp::Importer importer;
     importer.SetPropertyBool(AI_CONFIG_IMPORT_FBX_PRESERVE_PIVOTS, false);
@@ -775,7 +1230,31 @@ ecs::entity ModelLoader::loadFromFile(std::string_view path, ModelLoaderOptions
     mImpl->mOptions = options;
     mImpl->mModel->skeleton.globalInverseTransform = glm::inverse(toMat4(mImpl->mScene->mRootNode->mTransformation));
 
-    return mImpl->load();
+    ecs::entity e_model = mImpl->load();
+    AssetCache::of(*mImpl->mRegistry).insert(AssetKind::model, path, e_model);
+    if(cache.enabled())
+    {
+        if(cache.store(path, optionsHash, mImpl->mRegistry->get<Model>(e_model), *mImpl->mRegistry))
+            MODEL_LOADER_TRACE("Cooked model to \"{}\"", cache.getCookedPath(path));
+        else
+            LOG_WARN("Failed to write cooked model \"{}\"", cache.getCookedPath(path));
+    }
+    return e_model;
+}
+void ModelLoader::release(ecs::entity e_model)
+{
+    assert(mImpl && "Invalid loader! (make sure to not use default constructor when making an actual loader)");
+    if(!mImpl || !mImpl->mRegistry->valid(e_model))
+        return;
+
+    // Models loaded from memory aren't cached, their only reference is the caller's
+    AssetCache &cache = AssetCache::of(*mImpl->mRegistry);
+    if(cache.getEntry(e_model) && cache.release(e_model) > 0)
+        return;
+    Model &model = mImpl->mRegistry->get<Model>(e_model);
+    for(ecs::entity e_texture : model.textureReferences)
+        cache.release(e_texture);
+    model.textureReferences.clear();
 }
 ecs::entity ModelLoader::loadFromMemory(void const *data, size_t size, ModelLoaderOptions options)
 {
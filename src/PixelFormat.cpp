@@ -0,0 +1,514 @@
+#include "PixelFormat.hpp"
+#include "Logging.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define PIXEL_FORMAT_X86
+#include <immintrin.h>
+#endif
+
+/// @brief Lookup tables between 8-bit sRGB and linear floats.
+struct SrgbTables
+{
+    static constexpr unsigned LINEAR_STEPS = 1 << 14;
+    std::array<float, 256> toLinear;
+    std::array<uint8_t, LINEAR_STEPS> fromLinear;
+
+    SrgbTables()
+    {
+        for(unsigned i = 0; i < toLinear.size(); ++i)
+        {
+            float c = i / 255.f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for(unsigned i = 0; i < LINEAR_STEPS; ++i)
+        {
+            float l = static_cast<float>(i) / (LINEAR_STEPS - 1);
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f;
+            fromLinear[i] = static_cast<uint8_t>(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+        }
+    }
+};
+
+static SrgbTables const &getSrgbTables()
+{
+    static SrgbTables tables;
+    return tables;
+}
+
+float srgbToLinear(unsigned char value)
+{
+    return getSrgbTables().toLinear[value];
+}
+unsigned char linearToSrgb(float value)
+{
+    return getSrgbTables().fromLinear[static_cast<unsigned>(std::clamp(value, 0.f, 1.f) * (SrgbTables::LINEAR_STEPS - 1) + 0.5f)];
+}
+
+/// @brief x * a / 255 rounded to nearest, without a division.
+static unsigned char mulUnorm8(unsigned x, unsigned a)
+{
+    unsigned t = x * a + 128;
+    return static_cast<unsigned char>((t + (t >> 8)) >> 8);
+}
+
+// Scalar kernels, the reference the vector ones match and what they finish rows with
+
+static void expandToRGBAScalar(unsigned char const *src, unsigned n, unsigned char *dst, size_t numPixels)
+{
+    for(size_t i = 0; i < numPixels; ++i, src += n, dst += 4)
+        switch(n)
+        {
+        case 1: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 255; break; // grey
+        case 2: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break; // grey, alpha
+        case 3: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255; break;
+        }
+}
+static void dropAlphaScalar(unsigned char const *src, unsigned char *dst, size_t numPixels)
+{
+    for(size_t i = 0; i < numPixels; ++i, src += 4, dst += 3)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+    }
+}
+static void swizzleBGRAScalar(unsigned char const *src, unsigned char *dst, size_t numPixels)
+{
+    for(size_t i = 0; i < numPixels; ++i, src += 4, dst += 4)
+    {
+        unsigned char b = src[0], g = src[1], r = src[2], a = src[3];
+        dst[0] = r;
+        dst[1] = g;
+        dst[2] = b;
+        dst[3] = a;
+    }
+}
+static void rgba8ToFloatScalar(unsigned char const *src, bool srgb, float *dst, size_t numPixels)
+{
+    auto const &tables = getSrgbTables();
+    for(size_t i = 0; i < numPixels * 4; ++i)
+        dst[i] = srgb && i % 4 != 3 ? tables.toLinear[src[i]] : src[i] * (1.f / 255.f);
+}
+static void floatToRGBA8Scalar(float const *src, bool srgb, unsigned char *dst, size_t numPixels)
+{
+    auto const &tables = getSrgbTables();
+    for(size_t i = 0; i < numPixels * 4; ++i)
+    {
+        float v = std::clamp(src[i], 0.f, 1.f);
+        if(srgb && i % 4 != 3)
+            dst[i] = tables.fromLinear[static_cast<unsigned>(v * (SrgbTables::LINEAR_STEPS - 1) + 0.5f)];
+        else
+            dst[i] = static_cast<unsigned char>(v * 255.f + 0.5f);
+    }
+}
+static void premultiplyAlphaScalar(unsigned char *pixels, size_t numPixels)
+{
+    for(size_t i = 0; i < numPixels; ++i, pixels += 4)
+        for(unsigned c = 0; c < 3; ++c)
+            pixels[c] = mulUnorm8(pixels[c], pixels[3]);
+}
+static void widenToUnorm16Scalar(unsigned char const *src, uint16_t *dst, size_t count)
+{
+    for(size_t i = 0; i < count; ++i)
+        dst[i] = static_cast<uint16_t>(src[i] * 257);
+}
+
+#ifdef PIXEL_FORMAT_X86
+// Byte shuffles of 4 pixels, -1 clears the byte
+alignas(16) static constexpr int8_t EXPAND_SHUFFLES[3][16] = {
+    {0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1}, // grey
+    {0, 0, 0, 1, 2, 2, 2, 3, 4, 4, 4, 5, 6, 6, 6, 7}, // grey, alpha
+    {0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1}, // RGB
+};
+alignas(16) static constexpr int8_t DROP_ALPHA_SHUFFLE[16] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1};
+alignas(16) static constexpr int8_t SWIZZLE_SHUFFLE[16] = {2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15};
+// The alpha word of each of two pixels widened to 16 bits, in all four words of the pixel
+alignas(16) static constexpr int8_t ALPHA_WORDS_SHUFFLE[16] = {6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15};
+
+static __m128i loadShuffle(int8_t const *shuffle)
+{
+    return _mm_load_si128(reinterpret_cast<__m128i const *>(shuffle));
+}
+
+__attribute__((target("sse4.1")))
+static void expandToRGBASSE(unsigned char const *src, unsigned n, unsigned char *dst, size_t numPixels)
+{
+    __m128i shuffle = loadShuffle(EXPAND_SHUFFLES[n - 1]);
+    __m128i alpha = _mm_set1_epi32(n == 2 ? 0 : static_cast<int>(0xFF000000u));
+    size_t i = 0;
+    // 4 pixels per iteration, the 16 byte load reaches past them
+    for(; (numPixels - i) * n >= 16; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * n));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+    }
+    expandToRGBAScalar(src + i * n, n, dst + i * 4, numPixels - i);
+}
+__attribute__((target("sse4.1")))
+static void dropAlphaSSE(unsigned char const *src, unsigned char *dst, size_t numPixels)
+{
+    __m128i shuffle = loadShuffle(DROP_ALPHA_SHUFFLE);
+    size_t i = 0;
+    // 12 bytes out per iteration, the 16 byte store is overwritten by the next one
+    for(; numPixels - i >= 6; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 3), _mm_shuffle_epi8(v, shuffle));
+    }
+    dropAlphaScalar(src + i * 4, dst + i * 3, numPixels - i);
+}
+__attribute__((target("sse4.1")))
+static void swizzleBGRASSE(unsigned char const *src, unsigned char *dst, size_t numPixels)
+{
+    __m128i shuffle = loadShuffle(SWIZZLE_SHUFFLE);
+    size_t i = 0;
+    for(; i + 4 <= numPixels; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_shuffle_epi8(v, shuffle));
+    }
+    swizzleBGRAScalar(src + i * 4, dst + i * 4, numPixels - i);
+}
+__attribute__((target("sse4.1")))
+static void rgba8ToFloatSSE(unsigned char const *src, bool srgb, float *dst, size_t numPixels)
+{
+    // Without gathers the table lookups don't vectorize
+    if(srgb)
+        return rgba8ToFloatScalar(src, srgb, dst, numPixels);
+    __m128 scale = _mm_set1_ps(1.f / 255.f);
+    size_t i = 0;
+    for(; i + 4 <= numPixels; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 4));
+        for(unsigned p = 0; p < 4; ++p, v = _mm_srli_si128(v, 4))
+            _mm_storeu_ps(dst + (i + p) * 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(v)), scale));
+    }
+    rgba8ToFloatScalar(src + i * 4, srgb, dst + i * 4, numPixels - i);
+}
+/// @brief Clamp a pixel to [0, 1] and scale it to the integer it rounds to: a table index for sRGB colors, the value for the rest.
+__attribute__((target("sse4.1")))
+static __m128i quantizePixelSSE(float const *src, __m128 scale)
+{
+    __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src), _mm_setzero_ps()), _mm_set1_ps(1.f));
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), _mm_set1_ps(0.5f)));
+}
+__attribute__((target("sse4.1")))
+static void floatToRGBA8SSE(float const *src, bool srgb, unsigned char *dst, size_t numPixels)
+{
+    size_t i = 0;
+    if(srgb)
+    {
+        // The indices are computed 4 at a time, the lookups stay scalar
+        auto const &tables = getSrgbTables();
+        __m128 scale = _mm_setr_ps(SrgbTables::LINEAR_STEPS - 1, SrgbTables::LINEAR_STEPS - 1, SrgbTables::LINEAR_STEPS - 1, 255.f);
+        alignas(16) int32_t q[4];
+        for(; i < numPixels; ++i)
+        {
+            _mm_store_si128(reinterpret_cast<__m128i *>(q), quantizePixelSSE(src + i * 4, scale));
+            dst[i * 4 + 0] = tables.fromLinear[q[0]];
+            dst[i * 4 + 1] = tables.fromLinear[q[1]];
+            dst[i * 4 + 2] = tables.fromLinear[q[2]];
+            dst[i * 4 + 3] = static_cast<unsigned char>(q[3]);
+        }
+        return;
+    }
+    __m128 scale = _mm_set1_ps(255.f);
+    for(; i + 4 <= numPixels; i += 4)
+    {
+        __m128i p01 = _mm_packus_epi32(quantizePixelSSE(src + i * 4, scale), quantizePixelSSE(src + i * 4 + 4, scale));
+        __m128i p23 = _mm_packus_epi32(quantizePixelSSE(src + i * 4 + 8, scale), quantizePixelSSE(src + i * 4 + 12, scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_packus_epi16(p01, p23));
+    }
+    floatToRGBA8Scalar(src + i * 4, srgb, dst + i * 4, numPixels - i);
+}
+/// @brief mulUnorm8 of 8 words, each by the alpha of its pixel, the alpha words themselves by 255 (unchanged).
+__attribute__((target("sse4.1")))
+static __m128i premultiplyWordsSSE(__m128i words)
+{
+    __m128i alpha = _mm_blend_epi16(_mm_shuffle_epi8(words, loadShuffle(ALPHA_WORDS_SHUFFLE)), _mm_set1_epi16(255), 0x88);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(words, alpha), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+__attribute__((target("sse4.1")))
+static void premultiplyAlphaSSE(unsigned char *pixels, size_t numPixels)
+{
+    size_t i = 0;
+    for(; i + 4 <= numPixels; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(pixels + i * 4));
+        __m128i lo = premultiplyWordsSSE(_mm_cvtepu8_epi16(v));
+        __m128i hi = premultiplyWordsSSE(_mm_unpackhi_epi8(v, _mm_setzero_si128()));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + i * 4), _mm_packus_epi16(lo, hi));
+    }
+    premultiplyAlphaScalar(pixels + i * 4, numPixels - i);
+}
+__attribute__((target("sse4.1")))
+static void widenToUnorm16SSE(unsigned char const *src, uint16_t *dst, size_t count)
+{
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+        __m128i lo = _mm_cvtepu8_epi16(v), hi = _mm_unpackhi_epi8(v, _mm_setzero_si128());
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_or_si128(lo, _mm_slli_epi16(lo, 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8), _mm_or_si128(hi, _mm_slli_epi16(hi, 8)));
+    }
+    widenToUnorm16Scalar(src + i, dst + i, count - i);
+}
+
+// AVX2 variants, twice the pixels per iteration. Byte shuffles work within 128-bit lanes, each lane gets the pixels it needs.
+
+__attribute__((target("avx2")))
+static __m256i loadShuffleAVX(int8_t const *shuffle)
+{
+    return _mm256_broadcastsi128_si256(loadShuffle(shuffle));
+}
+__attribute__((target("avx2")))
+static void expandToRGBAAVX(unsigned char const *src, unsigned n, unsigned char *dst, size_t numPixels)
+{
+    __m256i shuffle = loadShuffleAVX(EXPAND_SHUFFLES[n - 1]);
+    __m256i alpha = _mm256_set1_epi32(n == 2 ? 0 : static_cast<int>(0xFF000000u));
+    size_t i = 0;
+    // 8 pixels per iteration, the upper lane loads 16 bytes from the fifth pixel
+    for(; (numPixels - i) * n >= 4 * n + 16; i += 8)
+    {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * n));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + (i + 4) * n));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha));
+    }
+    expandToRGBASSE(src + i * n, n, dst + i * 4, numPixels - i);
+}
+__attribute__((target("avx2")))
+static void dropAlphaAVX(unsigned char const *src, unsigned char *dst, size_t numPixels)
+{
+    __m256i shuffle = loadShuffleAVX(DROP_ALPHA_SHUFFLE);
+    // Moves the 12 bytes of the upper lane next to the 12 of the lower one
+    __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    size_t i = 0;
+    // 24 bytes out per iteration, the 32 byte store is overwritten by the next one
+    for(; numPixels - i >= 11; i += 8)
+    {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i * 4)), shuffle);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 3), _mm256_permutevar8x32_epi32(v, compact));
+    }
+    dropAlphaSSE(src + i * 4, dst + i * 3, numPixels - i);
+}
+__attribute__((target("avx2")))
+static void swizzleBGRAAVX(unsigned char const *src, unsigned char *dst, size_t numPixels)
+{
+    __m256i shuffle = loadShuffleAVX(SWIZZLE_SHUFFLE);
+    size_t i = 0;
+    for(; i + 8 <= numPixels; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_shuffle_epi8(v, shuffle));
+    }
+    swizzleBGRASSE(src + i * 4, dst + i * 4, numPixels - i);
+}
+__attribute__((target("avx2")))
+static void rgba8ToFloatAVX(unsigned char const *src, bool srgb, float *dst, size_t numPixels)
+{
+    auto const &tables = getSrgbTables();
+    __m256 scale = _mm256_set1_ps(1.f / 255.f);
+    size_t i = 0;
+    // 2 pixels per iteration, sRGB colors are gathered from the table and blended with the alpha computed as for linear data
+    for(; i + 2 <= numPixels; i += 2)
+    {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(src + i * 4)));
+        __m256 linear = _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale);
+        if(srgb)
+            linear = _mm256_blend_ps(_mm256_i32gather_ps(tables.toLinear.data(), v, 4), linear, 0x88);
+        _mm256_storeu_ps(dst + i * 4, linear);
+    }
+    rgba8ToFloatScalar(src + i * 4, srgb, dst + i * 4, numPixels - i);
+}
+__attribute__((target("avx2")))
+static __m256i quantizePixelsAVX(float const *src, __m256 scale)
+{
+    __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src), _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+    return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), _mm256_set1_ps(0.5f)));
+}
+__attribute__((target("avx2")))
+static void floatToRGBA8AVX(float const *src, bool srgb, unsigned char *dst, size_t numPixels)
+{
+    size_t i = 0;
+    if(srgb)
+    {
+        auto const &tables = getSrgbTables();
+        float const steps = SrgbTables::LINEAR_STEPS - 1;
+        __m256 scale = _mm256_setr_ps(steps, steps, steps, 255.f, steps, steps, steps, 255.f);
+        alignas(32) int32_t q[8];
+        for(; i + 2 <= numPixels; i += 2)
+        {
+            _mm256_store_si256(reinterpret_cast<__m256i *>(q), quantizePixelsAVX(src + i * 4, scale));
+            for(unsigned c = 0; c < 8; ++c)
+                dst[i * 4 + c] = c % 4 == 3 ? static_cast<unsigned char>(q[c]) : tables.fromLinear[q[c]];
+        }
+        return floatToRGBA8Scalar(src + i * 4, srgb, dst + i * 4, numPixels - i);
+    }
+    __m256 scale = _mm256_set1_ps(255.f);
+    // Packing works within lanes, the permute puts the 4 dwords of pixels back in order
+    __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for(; i + 8 <= numPixels; i += 8)
+    {
+        float const *p = src + i * 4;
+        __m256i ab = _mm256_packus_epi32(quantizePixelsAVX(p, scale), quantizePixelsAVX(p + 8, scale));
+        __m256i cd = _mm256_packus_epi32(quantizePixelsAVX(p + 16, scale), quantizePixelsAVX(p + 24, scale));
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), packed);
+    }
+    floatToRGBA8SSE(src + i * 4, srgb, dst + i * 4, numPixels - i);
+}
+__attribute__((target("avx2")))
+static __m256i premultiplyWordsAVX(__m256i words)
+{
+    __m256i alpha = _mm256_blend_epi16(_mm256_shuffle_epi8(words, loadShuffleAVX(ALPHA_WORDS_SHUFFLE)), _mm256_set1_epi16(255), 0x88);
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(words, alpha), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+__attribute__((target("avx2")))
+static void premultiplyAlphaAVX(unsigned char *pixels, size_t numPixels)
+{
+    size_t i = 0;
+    for(; i + 8 <= numPixels; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(pixels + i * 4));
+        // unpack and pack interleave the same way, the pixels come back in order
+        __m256i lo = premultiplyWordsAVX(_mm256_unpacklo_epi8(v, _mm256_setzero_si256()));
+        __m256i hi = premultiplyWordsAVX(_mm256_unpackhi_epi8(v, _mm256_setzero_si256()));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(pixels + i * 4), _mm256_packus_epi16(lo, hi));
+    }
+    premultiplyAlphaSSE(pixels + i * 4, numPixels - i);
+}
+__attribute__((target("avx2")))
+static void widenToUnorm16AVX(unsigned char const *src, uint16_t *dst, size_t count)
+{
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_or_si256(v, _mm256_slli_epi16(v, 8)));
+    }
+    widenToUnorm16Scalar(src + i, dst + i, count - i);
+}
+#endif
+
+/// @brief One implementation of every kernel.
+struct PixelKernels
+{
+    void (*expandToRGBA)(unsigned char const *src, unsigned n, unsigned char *dst, size_t numPixels);
+    void (*dropAlpha)(unsigned char const *src, unsigned char *dst, size_t numPixels);
+    void (*swizzleBGRA)(unsigned char const *src, unsigned char *dst, size_t numPixels);
+    void (*rgba8ToFloat)(unsigned char const *src, bool srgb, float *dst, size_t numPixels);
+    void (*floatToRGBA8)(float const *src, bool srgb, unsigned char *dst, size_t numPixels);
+    void (*premultiplyAlpha)(unsigned char *pixels, size_t numPixels);
+    void (*widenToUnorm16)(unsigned char const *src, uint16_t *dst, size_t count);
+};
+
+/// @brief Pick the widest kernels the CPU supports.
+static PixelKernels const &getKernels()
+{
+    static PixelKernels const kernels = []{
+#ifdef PIXEL_FORMAT_X86
+        if(__builtin_cpu_supports("avx2"))
+            return PixelKernels{expandToRGBAAVX, dropAlphaAVX, swizzleBGRAAVX, rgba8ToFloatAVX, floatToRGBA8AVX, premultiplyAlphaAVX, widenToUnorm16AVX};
+        if(__builtin_cpu_supports("sse4.1"))
+            return PixelKernels{expandToRGBASSE, dropAlphaSSE, swizzleBGRASSE, rgba8ToFloatSSE, floatToRGBA8SSE, premultiplyAlphaSSE, widenToUnorm16SSE};
+#endif
+        return PixelKernels{expandToRGBAScalar, dropAlphaScalar, swizzleBGRAScalar, rgba8ToFloatScalar, floatToRGBA8Scalar, premultiplyAlphaScalar, widenToUnorm16Scalar};
+    }();
+    return kernels;
+}
+
+void expandToRGBA(unsigned char const *src, unsigned n, unsigned char *dst, size_t numPixels)
+{
+    assert(n >= 1 && n <= 4 && "pixels have 1 to 4 components");
+    if(n == 4)
+        std::memcpy(dst, src, numPixels * 4);
+    else
+        getKernels().expandToRGBA(src, n, dst, numPixels);
+}
+void dropAlpha(unsigned char const *src, unsigned char *dst, size_t numPixels)
+{
+    getKernels().dropAlpha(src, dst, numPixels);
+}
+void swizzleBGRA(unsigned char const *src, unsigned char *dst, size_t numPixels)
+{
+    getKernels().swizzleBGRA(src, dst, numPixels);
+}
+void rgba8ToFloat(unsigned char const *src, bool srgb, float *dst, size_t numPixels)
+{
+    getKernels().rgba8ToFloat(src, srgb, dst, numPixels);
+}
+void floatToRGBA8(float const *src, bool srgb, unsigned char *dst, size_t numPixels)
+{
+    getKernels().floatToRGBA8(src, srgb, dst, numPixels);
+}
+void premultiplyAlpha(unsigned char *pixels, bool srgb, size_t numPixels)
+{
+    if(!srgb)
+        return getKernels().premultiplyAlpha(pixels, numPixels);
+    // Table lookups both ways, there is nothing to vectorize
+    auto const &tables = getSrgbTables();
+    for(size_t i = 0; i < numPixels; ++i, pixels += 4)
+    {
+        float alpha = pixels[3] * (1.f / 255.f);
+        for(unsigned c = 0; c < 3; ++c)
+            pixels[c] = tables.fromLinear[static_cast<unsigned>(tables.toLinear[pixels[c]] * alpha * (SrgbTables::LINEAR_STEPS - 1) + 0.5f)];
+    }
+}
+void widenToUnorm16(unsigned char const *src, uint16_t *dst, size_t count)
+{
+    getKernels().widenToUnorm16(src, dst, count);
+}
+
+static bool isValid(Bitmap<unsigned char> const &bitmap)
+{
+    unsigned n = bitmap.numComponents;
+    if(n >= 1 && n <= 4 && bitmap.pixels.size() >= size_t(bitmap.size.x) * bitmap.size.y * n)
+        return true;
+    LOG_ERROR("Bitmap has {} bytes for {}x{} pixels of {} components!", bitmap.pixels.size(), bitmap.size.x, bitmap.size.y, n);
+    return false;
+}
+
+std::optional<Bitmap<unsigned char>> convertToRGBA(Bitmap<unsigned char> const &bitmap)
+{
+    if(!isValid(bitmap))
+        return std::nullopt;
+    size_t numPixels = size_t(bitmap.size.x) * bitmap.size.y;
+    Bitmap<unsigned char> rgba{.pixels = PixelBuffer<unsigned char>(numPixels * 4), .numComponents = 4, .size = bitmap.size};
+    expandToRGBA(bitmap.pixels.data(), bitmap.numComponents, rgba.pixels.data(), numPixels);
+    return rgba;
+}
+std::optional<Bitmap<uint16_t>> convertToUnorm16(Bitmap<unsigned char> const &bitmap)
+{
+    if(!isValid(bitmap))
+        return std::nullopt;
+    size_t count = size_t(bitmap.size.x) * bitmap.size.y * bitmap.numComponents;
+    Bitmap<uint16_t> wide{.pixels = PixelBuffer<uint16_t>(count), .numComponents = bitmap.numComponents, .size = bitmap.size};
+    widenToUnorm16(bitmap.pixels.data(), wide.pixels.data(), count);
+    return wide;
+}
+std::optional<Bitmap<float>> convertToFloat(Bitmap<unsigned char> const &bitmap, bool srgb)
+{
+    if(!isValid(bitmap))
+        return std::nullopt;
+    unsigned n = bitmap.numComponents;
+    size_t numPixels = size_t(bitmap.size.x) * bitmap.size.y;
+    Bitmap<float> wide{.pixels = PixelBuffer<float>(numPixels * n), .numComponents = n, .size = bitmap.size};
+    if(n == 4)
+    {
+        rgba8ToFloat(bitmap.pixels.data(), srgb, wide.pixels.data(), numPixels);
+        return wide;
+    }
+    // Grey is color, the second component of grey-alpha is alpha
+    for(size_t i = 0; i < numPixels * n; ++i)
+        wide.pixels[i] = srgb && (n == 3 || i % n == 0) ? srgbToLinear(bitmap.pixels[i]) : bitmap.pixels[i] * (1.f / 255.f);
+    return wide;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "Model.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Conversions between the pixel layouts of Bitmap, in rows of pixels.
+// The widest of AVX2, SSE4.1 and plain scalar code the CPU runs is picked once, every variant gives the same bytes.
+// Source and destination must not overlap unless said otherwise.
+
+/// @brief Expand @p numPixels pixels of @p n components (grey, grey-alpha, RGB or RGBA) to RGBA.
+/// Grey is replicated into R, G and B, pixels without alpha are opaque. This is how uploads and atlases read every bitmap.
+void expandToRGBA(unsigned char const *src, unsigned n, unsigned char *dst, size_t numPixels);
+/// @brief RGBA to RGB, dropping alpha.
+void dropAlpha(unsigned char const *src, unsigned char *dst, size_t numPixels);
+/// @brief Swap R and B of 4 component pixels, BGRA to RGBA and back. @p src may be @p dst.
+void swizzleBGRA(unsigned char const *src, unsigned char *dst, size_t numPixels);
+
+/// @brief RGBA8 to RGBA floats in [0, 1]. With @p srgb the color channels are linearized through a lookup table, alpha never is.
+void rgba8ToFloat(unsigned char const *src, bool srgb, float *dst, size_t numPixels);
+/// @brief RGBA floats to RGBA8, clamped and rounded. The inverse of rgba8ToFloat.
+void floatToRGBA8(float const *src, bool srgb, unsigned char *dst, size_t numPixels);
+/// @brief Multiply the color channels of RGBA8 pixels by their alpha, in place. sRGB colors are multiplied in linear space.
+void premultiplyAlpha(unsigned char *pixels, bool srgb, size_t numPixels);
+/// @brief Widen @p count 8-bit unorm values to 16 bits, 255 becomes 65535.
+void widenToUnorm16(unsigned char const *src, uint16_t *dst, size_t count);
+
+/// @brief A single sRGB encoded value to linear and back, through the tables of the kernels.
+float srgbToLinear(unsigned char value);
+unsigned char linearToSrgb(float value);
+
+/// @brief The base level of @p bitmap as RGBA8, see expandToRGBA.
+/// @return std::nullopt if the bitmap doesn't hold what its size and components say.
+std::optional<Bitmap<unsigned char>> convertToRGBA(Bitmap<unsigned char> const &bitmap);
+/// @brief The base level of @p bitmap widened to 16 bits per component.
+std::optional<Bitmap<uint16_t>> convertToUnorm16(Bitmap<unsigned char> const &bitmap);
+/// @brief The base level of @p bitmap as floats in [0, 1], with the color components linearized if @p srgb.
+std::optional<Bitmap<float>> convertToFloat(Bitmap<unsigned char> const &bitmap, bool srgb);
@@ -0,0 +1,58 @@
+#include "Serialization.hpp"
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+bool MappedFile::open(std::string_view path)
+{
+    close();
+#ifndef _WIN32
+    int fd = ::open(std::string{path}.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st{};
+    if(fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED)
+        return false;
+    mData = mapped;
+    mSize = static_cast<size_t>(st.st_size);
+    return true;
+#else
+    std::ifstream file(std::string{path}, std::ios::ate | std::ios::binary);
+    if(!file.is_open())
+        return false;
+    mFallback.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(mFallback.data(), mFallback.size());
+    if(mFallback.empty())
+        return false;
+    mData = mFallback.data();
+    mSize = mFallback.size();
+    return true;
+#endif
+}
+void MappedFile::close()
+{
+#ifndef _WIN32
+    if(mData)
+        munmap(const_cast<void *>(mData), mSize);
+#endif
+    mFallback.clear();
+    mData = nullptr;
+    mSize = 0;
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <type_traits>
+
+/// @brief 64-bit FNV-1a hash of a byte range.
+/// @param seed Pass a previous result to hash several ranges as one.
+constexpr uint64_t hashBytes(void const *data, size_t size, uint64_t seed = 0xcbf29ce484222325ull)
+{
+    auto bytes = static_cast<unsigned char const *>(data);
+    uint64_t hash = seed;
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+constexpr uint64_t hashValue(T const &value, uint64_t seed = 0xcbf29ce484222325ull)
+{
+    return hashBytes(&value, sizeof(T), seed);
+}
+
+/// @brief Read-only view of a whole file, memory-mapped where the platform allows it.
+class MappedFile
+{
+private:
+    void const *mData = nullptr;
+    size_t mSize = 0;
+    std::vector<char> mFallback; // used when mapping is not available
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+    ~MappedFile();
+
+    /// @brief Map the file at @p path. Returns false if it can't be opened.
+    bool open(std::string_view path);
+    void close();
+
+    inline bool isOpen() const { return mData != nullptr; }
+    inline std::span<char const> bytes() const { return {static_cast<char const *>(mData), mSize}; }
+};
+
+/// @brief Appends plain data to a byte buffer.
+/// Arrays are aligned to ARRAY_ALIGNMENT so a mapped reader can view them in place.
+class BinaryWriter
+{
+public:
+    static constexpr size_t ARRAY_ALIGNMENT = 16;
+    std::vector<char> buffer;
+
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    void write(T const &value)
+    {
+        auto bytes = reinterpret_cast<char const *>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    void writeArray(std::span<T const> values)
+    {
+        write<uint64_t>(values.size());
+        align(ARRAY_ALIGNMENT);
+        auto bytes = reinterpret_cast<char const *>(values.data());
+        buffer.insert(buffer.end(), bytes, bytes + values.size_bytes());
+    }
+    template<typename T>
+    void writeVector(std::vector<T> const &values) { writeArray(std::span<T const>{values}); }
+    void writeString(std::string_view str) { writeArray(std::span<char const>{str.data(), str.size()}); }
+    void align(size_t alignment) { buffer.resize((buffer.size() + alignment - 1) / alignment * alignment, 0); }
+};
+
+/// @brief Reads data written by BinaryWriter.
+/// Reading past the end doesn't throw: it sets ok to false and yields zeroes.
+class BinaryReader
+{
+private:
+    std::span<char const> mData;
+    size_t mOffset = 0;
+public:
+    bool ok = true;
+
+    explicit BinaryReader(std::span<char const> data) : mData(data) {}
+
+    inline size_t offset() const { return mOffset; }
+    inline void seek(size_t offset) { mOffset = offset; }
+
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    T read()
+    {
+        T value{};
+        if(!check(sizeof(T)))
+            return value;
+        std::memcpy(&value, mData.data() + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return value;
+    }
+    /// @brief View an array in place. The span is valid while the underlying data is.
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    std::span<T const> readArray()
+    {
+        uint64_t count = read<uint64_t>();
+        align(BinaryWriter::ARRAY_ALIGNMENT);
+        if(count > mData.size() / sizeof(T) || !check(count * sizeof(T)))
+        {
+            ok = false;
+            return {};
+        }
+        auto result = std::span<T const>{reinterpret_cast<T const *>(mData.data() + mOffset), count};
+        mOffset += count * sizeof(T);
+        return result;
+    }
+    template<typename T>
+    void readVector(std::vector<T> &out)
+    {
+        auto values = readArray<T>();
+        out.resize(values.size());
+        if(!values.empty())
+            std::memcpy(out.data(), values.data(), values.size_bytes());
+    }
+    std::string readString()
+    {
+        auto chars = readArray<char>();
+        return std::string{chars.begin(), chars.end()};
+    }
+    void align(size_t alignment) { mOffset = (mOffset + alignment - 1) / alignment * alignment; }
+private:
+    bool check(size_t size)
+    {
+        if(!ok || mOffset > mData.size() || mData.size() - mOffset < size)
+        {
+            ok = false;
+            return false;
+        }
+        return true;
+    }
+};
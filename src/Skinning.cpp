@@ -0,0 +1,144 @@
+#include "Skinning.hpp"
+#include "Logging.hpp"
+#include "ThreadPool.hpp"
+#include <glm/gtc/quaternion.hpp>
+#include <cassert>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SKINNING_X86
+#include <immintrin.h>
+#endif
+
+std::optional<SkeletonLayout> SkeletonLayout::build(Model::Skeleton const &skeleton)
+{
+    size_t numBones = skeleton.boneMap.size();
+    if(skeleton.parents.size() != numBones || skeleton.bindTransform.size() != numBones)
+    {
+        LOG_ERROR("Skeleton has {} bones, {} parents and {} bind transforms", numBones, skeleton.parents.size(), skeleton.bindTransform.size());
+        return std::nullopt;
+    }
+
+    SkeletonLayout layout;
+    layout.mParents = skeleton.parents;
+    layout.mBindTransform = skeleton.bindTransform;
+    layout.mGlobalInverseTransform = skeleton.globalInverseTransform;
+
+    // Breadth first from the roots: a bone is reached through its parent only, bones never reached are in a cycle
+    std::vector<std::vector<uint32_t>> children(numBones);
+    for(uint32_t bone = 0; bone < numBones; ++bone)
+    {
+        int parent = skeleton.parents[bone];
+        if(parent < -1 || parent >= static_cast<int>(numBones))
+        {
+            LOG_ERROR("Bone {} has parent {}, the skeleton has {} bones", bone, parent, numBones);
+            return std::nullopt;
+        }
+        if(parent == -1)
+            layout.mOrder.push_back(bone);
+        else
+            children[parent].push_back(bone);
+    }
+    for(size_t i = 0; i < layout.mOrder.size(); ++i)
+        for(uint32_t child : children[layout.mOrder[i]])
+            layout.mOrder.push_back(child);
+    if(layout.mOrder.size() != numBones)
+    {
+        LOG_ERROR("Skeleton has a cycle, {} of {} bones are under a root", layout.mOrder.size(), numBones);
+        return std::nullopt;
+    }
+    return layout;
+}
+
+/// @brief out = parent * translate(t) * basis, @p basis being rotation * scale.
+/// @p out may not be @p parent.
+static void concatLocal(glm::mat4 const &parent, glm::mat3 const &basis, glm::vec3 const &t, glm::mat4 &out)
+{
+#ifdef SKINNING_X86
+    __m128 p0 = _mm_loadu_ps(&parent[0][0]), p1 = _mm_loadu_ps(&parent[1][0]), p2 = _mm_loadu_ps(&parent[2][0]), p3 = _mm_loadu_ps(&parent[3][0]);
+    auto combine = [&](float x, float y, float z){
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(x)), _mm_mul_ps(p1, _mm_set1_ps(y))), _mm_mul_ps(p2, _mm_set1_ps(z)));
+    };
+    for(int j = 0; j < 3; ++j)
+        _mm_storeu_ps(&out[j][0], combine(basis[j][0], basis[j][1], basis[j][2]));
+    _mm_storeu_ps(&out[3][0], _mm_add_ps(combine(t.x, t.y, t.z), p3));
+#else
+    out = parent * glm::mat4(glm::vec4(basis[0], 0.0f), glm::vec4(basis[1], 0.0f), glm::vec4(basis[2], 0.0f), glm::vec4(t, 1.0f));
+#endif
+}
+
+/// @brief out = a * b, any of them may be the same matrix.
+static void multiply(glm::mat4 const &a, glm::mat4 const &b, glm::mat4 &out)
+{
+#ifdef SKINNING_X86
+    __m128 a0 = _mm_loadu_ps(&a[0][0]), a1 = _mm_loadu_ps(&a[1][0]), a2 = _mm_loadu_ps(&a[2][0]), a3 = _mm_loadu_ps(&a[3][0]);
+    for(int j = 0; j < 4; ++j)
+    {
+        // Column j of out only depends on column j of b, which is read before it is written
+        __m128 column = _mm_loadu_ps(&b[j][0]);
+        __m128 x = _mm_shuffle_ps(column, column, _MM_SHUFFLE(0, 0, 0, 0));
+        __m128 y = _mm_shuffle_ps(column, column, _MM_SHUFFLE(1, 1, 1, 1));
+        __m128 z = _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 2, 2, 2));
+        __m128 w = _mm_shuffle_ps(column, column, _MM_SHUFFLE(3, 3, 3, 3));
+        _mm_storeu_ps(&out[j][0], _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, x), _mm_mul_ps(a1, y)), _mm_add_ps(_mm_mul_ps(a2, z), _mm_mul_ps(a3, w))));
+    }
+#else
+    out = a * b;
+#endif
+}
+
+void computePalette(SkeletonLayout const &layout, std::span<BonePose const> pose, std::span<glm::mat4> palette)
+{
+    assert(pose.size() >= layout.getBoneCount() && palette.size() >= layout.getBoneCount() && "a pose and palette per bone");
+    auto parents = layout.getParents();
+    auto bindTransforms = layout.getBindTransforms();
+
+    // The palette holds globalInverseTransform * model space transform first, the global inverse is folded into the
+    // roots and from there into every child. Parents are done before their children read them.
+    for(uint32_t bone : layout.getOrder())
+    {
+        BonePose const &local = pose[bone];
+        glm::mat3 basis = glm::mat3_cast(local.orientation);
+        basis[0] *= local.scale.x;
+        basis[1] *= local.scale.y;
+        basis[2] *= local.scale.z;
+        int parent = parents[bone];
+        concatLocal(parent < 0 ? layout.getGlobalInverseTransform() : palette[parent], basis, local.position, palette[bone]);
+    }
+    // No bone reads another one anymore
+    for(size_t bone = 0; bone < layout.getBoneCount(); ++bone)
+        multiply(palette[bone], bindTransforms[bone], palette[bone]);
+}
+
+void computePalettes(SkeletonLayout const &layout, std::span<BonePose const> poses, std::span<glm::mat4> palettes)
+{
+    size_t numBones = layout.getBoneCount();
+    if(numBones == 0)
+        return;
+    assert(poses.size() % numBones == 0 && palettes.size() == poses.size() && "a pose and palette per bone of every instance");
+    size_t numInstances = poses.size() / numBones;
+    // A task per instance would spend more on the queue than on the instance
+    constexpr size_t INSTANCES_PER_TASK = 64;
+    ThreadPool::global().parallelFor((numInstances + INSTANCES_PER_TASK - 1) / INSTANCES_PER_TASK, [&](size_t task){
+        size_t last = std::min(numInstances, (task + 1) * INSTANCES_PER_TASK);
+        for(size_t i = task * INSTANCES_PER_TASK; i < last; ++i)
+            computePalette(layout, poses.subspan(i * numBones, numBones), palettes.subspan(i * numBones, numBones));
+    });
+}
+
+void skinVertices(Mesh::Geometry const &geometry, std::span<glm::mat4 const> palette, std::span<glm::vec3> positions, std::span<glm::vec3> normals)
+{
+    assert(positions.size() >= geometry.positions.size() && normals.size() >= geometry.positions.size() && "a position and normal per vertex");
+    for(size_t v = 0; v < geometry.positions.size(); ++v)
+    {
+        glm::mat4 skin(1.0f);
+        if(v < geometry.weights.size() && geometry.weights[v] != glm::u8vec4(0))
+        {
+            glm::vec4 weights = glm::vec4(geometry.weights[v]) / 255.0f;
+            glm::u16vec4 bones = geometry.boneIDs[v];
+            skin = weights.x * palette[bones.x] + weights.y * palette[bones.y] + weights.z * palette[bones.z] + weights.w * palette[bones.w];
+        }
+        positions[v] = glm::vec3(skin * glm::vec4(geometry.positions[v], 1.0f));
+        glm::vec3 normal = glm::mat3(skin) * geometry.normals[v];
+        normals[v] = glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : normal;
+    }
+}
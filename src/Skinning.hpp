@@ -0,0 +1,43 @@
+#pragma once
+#include "AnimationSampler.hpp"
+#include "Model.hpp"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+/// @brief The hierarchy of a Model::Skeleton flattened for evaluating poses.
+/// Bones are visited parents first, so one pass over them turns local transforms into model space.
+class SkeletonLayout
+{
+private:
+    std::vector<uint32_t> mOrder; // bone ids, every parent before its children
+    std::vector<int> mParents; // per bone id, -1 for roots
+    std::vector<glm::mat4> mBindTransform; // per bone id, model space to bone space
+    glm::mat4 mGlobalInverseTransform{1.0f};
+public:
+    /// @return std::nullopt if the parents of @p skeleton don't form a forest.
+    static std::optional<SkeletonLayout> build(Model::Skeleton const &skeleton);
+
+    inline size_t getBoneCount() const { return mParents.size(); }
+    inline std::span<uint32_t const> getOrder() const { return mOrder; }
+    inline std::span<int const> getParents() const { return mParents; }
+    inline std::span<glm::mat4 const> getBindTransforms() const { return mBindTransform; }
+    inline glm::mat4 const &getGlobalInverseTransform() const { return mGlobalInverseTransform; }
+};
+
+/// @brief The skinning matrices of one instance: globalInverseTransform * model space transform * bind transform per bone.
+/// @param pose The local transform of every bone, as AnimationClip::sample writes them.
+/// @param palette One matrix per bone, indexed by bone id like @p pose.
+void computePalette(SkeletonLayout const &layout, std::span<BonePose const> pose, std::span<glm::mat4> palette);
+
+/// @brief computePalette for many instances at once, spread over the global thread pool.
+/// @param poses The poses of the instances one after the other, getBoneCount() each.
+/// @param palettes The palettes of the instances in the same order.
+void computePalettes(SkeletonLayout const &layout, std::span<BonePose const> poses, std::span<glm::mat4> palettes);
+
+/// @brief What the skinning pre-pass (skinning.slang) makes of the vertices of @p geometry, computed on the CPU to check it.
+/// Reads the quantized weights like the GPU does. Vertices without influences stay where they are.
+/// @param palette One matrix per bone, as computePalette writes them.
+/// @param positions, normals One per vertex of @p geometry.
+void skinVertices(Mesh::Geometry const &geometry, std::span<glm::mat4 const> palette, std::span<glm::vec3> positions, std::span<glm::vec3> normals);
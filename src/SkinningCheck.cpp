@@ -0,0 +1,453 @@
+// Runs the skinning pre-pass (skinning.slang) headless on a compute queue and compares it with skinVertices on the CPU.
+// Needs no window, a software device like lavapipe does: VK_ICD_FILENAMES=.../lvp_icd.x86_64.json levulkan-skinning-check
+// usage: levulkan-skinning-check [shader] (default shaders-bin/skinning.slang.spv)
+#include "volk.h"
+#include "libraries/vk_enum_string_helper.h"
+#define VMA_IMPLEMENTATION
+#define VMA_STATIC_VULKAN_FUNCTIONS 0
+#define VMA_DYNAMIC_VULKAN_FUNCTIONS 0
+#define VMA_VULKAN_VERSION 1003000
+#include "vk_mem_alloc.h"
+
+#include "Logging.hpp"
+#include "Skinning.hpp"
+#include "VertexFormat.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#define CHK(x) { VkResult _result = x; if(_result != VK_SUCCESS) { LOG_ERROR("{}:{}: Failed to {}: {}.", __FILE__, __LINE__, #x, string_VkResult(_result)); return false; }}
+
+constexpr uint32_t SKINNING_GROUP_SIZE = 64; // numthreads of skinning.slang
+constexpr float POSITION_TOLERANCE = 1e-4f; // relative to the extent of the skinned mesh
+constexpr float NORMAL_TOLERANCE = 1e-4f;
+
+// Matches SkinningData in skinning.slang
+struct SkinningPushConstants
+{
+    VkDeviceAddress source;
+    VkDeviceAddress influences;
+    VkDeviceAddress palette;
+    VkDeviceAddress output;
+    uint32_t vertexCount;
+    uint32_t boneIndexSize;
+};
+
+struct ComputeContext
+{
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t queueFamily = 0;
+    VkQueue queue = VK_NULL_HANDLE;
+    VmaAllocator vma = VK_NULL_HANDLE;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+};
+
+/// @brief A buffer the host writes or reads through a persistent mapping, and the shader through its address.
+struct HostBuffer
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    void *mapped = nullptr;
+    VkDeviceAddress deviceAddress = 0;
+};
+
+/// @brief Instance, device and a compute queue, no surface. Takes the first device with Vulkan 1.3 and a compute queue.
+static bool createContext(ComputeContext &context)
+{
+    CHK(volkInitialize());
+    VkApplicationInfo appInfo{
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName = "levulkan-skinning-check",
+        .apiVersion = VK_API_VERSION_1_3
+    };
+    VkInstanceCreateInfo instanceCI{
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pApplicationInfo = &appInfo
+    };
+    CHK(vkCreateInstance(&instanceCI, nullptr, &context.instance));
+    volkLoadInstance(context.instance);
+
+    uint32_t deviceCount = 0;
+    vkEnumeratePhysicalDevices(context.instance, &deviceCount, nullptr);
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(context.instance, &deviceCount, devices.data());
+    for(VkPhysicalDevice dev : devices)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(dev, &properties);
+        if(properties.apiVersion < VK_API_VERSION_1_3)
+            continue;
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(dev, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(dev, &familyCount, families.data());
+        for(uint32_t i = 0; i < familyCount && !context.physicalDevice; ++i)
+            if(families[i].queueFlags & VK_QUEUE_COMPUTE_BIT)
+            {
+                context.physicalDevice = dev;
+                context.queueFamily = i;
+                LOG_INFO("Device: {}", properties.deviceName);
+            }
+        if(context.physicalDevice)
+            break;
+    }
+    if(!context.physicalDevice)
+    {
+        LOG_ERROR("No Vulkan 1.3 device with a compute queue!");
+        return false;
+    }
+
+    // Everything the device supports is enabled, like the renderer does
+    VkPhysicalDeviceVulkan12Features vk12Features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+    VkPhysicalDeviceVulkan13Features vk13Features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES, .pNext = &vk12Features };
+    VkPhysicalDeviceFeatures2 features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &vk13Features };
+    vkGetPhysicalDeviceFeatures2(context.physicalDevice, &features);
+    if(!vk12Features.bufferDeviceAddress || !vk13Features.synchronization2)
+    {
+        LOG_ERROR("The device lacks buffer device addresses or synchronization2!");
+        return false;
+    }
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queueCI{
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = context.queueFamily,
+        .queueCount = 1,
+        .pQueuePriorities = &priority
+    };
+    VkDeviceCreateInfo deviceCI{
+        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &features,
+        .queueCreateInfoCount = 1,
+        .pQueueCreateInfos = &queueCI
+    };
+    CHK(vkCreateDevice(context.physicalDevice, &deviceCI, nullptr, &context.device));
+    volkLoadDevice(context.device);
+    vkGetDeviceQueue(context.device, context.queueFamily, 0, &context.queue);
+
+    VmaAllocatorCreateInfo allocatorCI{
+        .flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT,
+        .physicalDevice = context.physicalDevice,
+        .device = context.device,
+        .instance = context.instance,
+        .vulkanApiVersion = VK_API_VERSION_1_3
+    };
+    VmaVulkanFunctions functions;
+    CHK(vmaImportVulkanFunctionsFromVolk(&allocatorCI, &functions));
+    allocatorCI.pVulkanFunctions = &functions;
+    CHK(vmaCreateAllocator(&allocatorCI, &context.vma));
+
+    VkCommandPoolCreateInfo poolCI{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .queueFamilyIndex = context.queueFamily
+    };
+    CHK(vkCreateCommandPool(context.device, &poolCI, nullptr, &context.commandPool));
+    return true;
+}
+static void destroyContext(ComputeContext &context)
+{
+    if(context.device)
+    {
+        vkDestroyPipeline(context.device, context.pipeline, nullptr);
+        vkDestroyPipelineLayout(context.device, context.pipelineLayout, nullptr);
+        vkDestroyCommandPool(context.device, context.commandPool, nullptr);
+        if(context.vma)
+            vmaDestroyAllocator(context.vma);
+        vkDestroyDevice(context.device, nullptr);
+    }
+    if(context.instance)
+        vkDestroyInstance(context.instance, nullptr);
+}
+
+static bool createPipeline(ComputeContext &context, std::string const &shaderPath)
+{
+    std::ifstream file(shaderPath, std::ios::ate | std::ios::binary);
+    if(!file.is_open())
+    {
+        LOG_ERROR("Failed to open file \"{}\"", shaderPath);
+        return false;
+    }
+    std::vector<char> code(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(code.data(), code.size());
+
+    VkShaderModuleCreateInfo moduleCI{
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = code.size(),
+        .pCode = reinterpret_cast<uint32_t const *>(code.data())
+    };
+    VkShaderModule shaderModule;
+    CHK(vkCreateShaderModule(context.device, &moduleCI, nullptr, &shaderModule));
+
+    VkPushConstantRange pushConstantRange{
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .size = sizeof(SkinningPushConstants)
+    };
+    VkPipelineLayoutCreateInfo pipelineLayoutCI{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+    VkComputePipelineCreateInfo pipelineCI{
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shaderModule,
+            .pName = "main"
+        }
+    };
+    VkResult result = vkCreatePipelineLayout(context.device, &pipelineLayoutCI, nullptr, &context.pipelineLayout);
+    if(result == VK_SUCCESS)
+    {
+        pipelineCI.layout = context.pipelineLayout;
+        result = vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &context.pipeline);
+    }
+    vkDestroyShaderModule(context.device, shaderModule, nullptr);
+    CHK(result);
+    return true;
+}
+
+static bool createHostBuffer(ComputeContext const &context, VkDeviceSize size, HostBuffer &buffer)
+{
+    VkBufferCreateInfo bufferCI{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+    };
+    VmaAllocationCreateInfo allocCI{
+        .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .usage = VMA_MEMORY_USAGE_AUTO
+    };
+    VmaAllocationInfo allocInfo;
+    CHK(vmaCreateBuffer(context.vma, &bufferCI, &allocCI, &buffer.buffer, &buffer.allocation, &allocInfo));
+    buffer.mapped = allocInfo.pMappedData;
+    VkBufferDeviceAddressInfo bdaInfo{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .buffer = buffer.buffer
+    };
+    buffer.deviceAddress = vkGetBufferDeviceAddress(context.device, &bdaInfo);
+    return true;
+}
+template<typename T>
+static bool createHostBuffer(ComputeContext const &context, std::vector<T> const &data, HostBuffer &buffer)
+{
+    if(!createHostBuffer(context, data.size() * sizeof(T), buffer))
+        return false;
+    std::memcpy(buffer.mapped, data.data(), data.size() * sizeof(T));
+    CHK(vmaFlushAllocation(context.vma, buffer.allocation, 0, VK_WHOLE_SIZE));
+    return true;
+}
+
+/// @brief Skin @p geometry with @p palette on the GPU.
+static bool skinOnDevice(ComputeContext const &context, Mesh::Geometry const &geometry, std::vector<glm::mat4> const &palette, std::vector<SkinnedVertex> &skinned)
+{
+    std::vector<SkinVertex> source(geometry.positions.size());
+    for(size_t v = 0; v < source.size(); ++v)
+        source[v] = SkinVertex{
+            .position = glm::vec4(geometry.positions[v], 1.0f),
+            .normal   = glm::vec4(geometry.normals[v], 0.0f)
+        };
+
+    std::array<HostBuffer, 4> buffers; // source, influences, palette, output
+    VkCommandBuffer cb = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    auto run = [&]() -> bool {
+        if(!createHostBuffer(context, source, buffers[0])
+            || !createHostBuffer(context, packBoneInfluences(geometry), buffers[1])
+            || !createHostBuffer(context, palette, buffers[2])
+            || !createHostBuffer(context, source.size() * sizeof(SkinnedVertex), buffers[3]))
+            return false;
+
+        VkCommandBufferAllocateInfo cbAI{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = context.commandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1
+        };
+        CHK(vkAllocateCommandBuffers(context.device, &cbAI, &cb));
+        VkFenceCreateInfo fenceCI{ .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        CHK(vkCreateFence(context.device, &fenceCI, nullptr, &fence));
+
+        VkCommandBufferBeginInfo beginInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+        };
+        CHK(vkBeginCommandBuffer(cb, &beginInfo));
+        vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, context.pipeline);
+        SkinningPushConstants pushConstants{
+            .source = buffers[0].deviceAddress,
+            .influences = buffers[1].deviceAddress,
+            .palette = buffers[2].deviceAddress,
+            .output = buffers[3].deviceAddress,
+            .vertexCount = static_cast<uint32_t>(source.size()),
+            .boneIndexSize = geometry.boneIndexSize
+        };
+        vkCmdPushConstants(cb, context.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPushConstants), &pushConstants);
+        vkCmdDispatch(cb, (pushConstants.vertexCount + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE, 1, 1);
+        // The submission makes the host writes visible to the shader, the other way around takes a barrier
+        VkMemoryBarrier2 outputWritten{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+            .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT
+        };
+        VkDependencyInfo dependencyInfo{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &outputWritten
+        };
+        vkCmdPipelineBarrier2(cb, &dependencyInfo);
+        CHK(vkEndCommandBuffer(cb));
+
+        VkCommandBufferSubmitInfo cbSubmitInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+            .commandBuffer = cb
+        };
+        VkSubmitInfo2 submitInfo{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .commandBufferInfoCount = 1,
+            .pCommandBufferInfos = &cbSubmitInfo
+        };
+        CHK(vkQueueSubmit2(context.queue, 1, &submitInfo, fence));
+        CHK(vkWaitForFences(context.device, 1, &fence, VK_TRUE, UINT64_MAX));
+
+        CHK(vmaInvalidateAllocation(context.vma, buffers[3].allocation, 0, VK_WHOLE_SIZE));
+        skinned.resize(source.size());
+        std::memcpy(skinned.data(), buffers[3].mapped, skinned.size() * sizeof(SkinnedVertex));
+        return true;
+    };
+    bool ok = run();
+
+    if(fence)
+        vkDestroyFence(context.device, fence, nullptr);
+    if(cb)
+        vkFreeCommandBuffers(context.device, context.commandPool, 1, &cb);
+    for(auto &buffer : buffers)
+        if(buffer.buffer)
+            vmaDestroyBuffer(context.vma, buffer.buffer, buffer.allocation);
+    return ok;
+}
+
+/// @brief A skeleton of @p numBones bones, three children per bone, each one unit above its parent and bound in its rest pose.
+static Model::Skeleton makeSkeleton(unsigned numBones)
+{
+    Model::Skeleton skeleton;
+    skeleton.globalInverseTransform = glm::mat4(1.0f);
+    std::vector<glm::mat4> rest(numBones);
+    for(unsigned bone = 0; bone < numBones; ++bone)
+    {
+        int parent = bone ? static_cast<int>((bone - 1) / 3) : -1;
+        glm::mat4 local(1.0f);
+        local[3] = glm::vec4(0.0f, bone ? 1.0f : 0.0f, 0.0f, 1.0f);
+        rest[bone] = parent < 0 ? local : rest[parent] * local;
+        skeleton.nodeTransform.push_back(local);
+        skeleton.bindTransform.push_back(glm::inverse(rest[bone]));
+        skeleton.parents.push_back(parent);
+        skeleton.boneMap.emplace("bone" + std::to_string(bone), bone);
+    }
+    return skeleton;
+}
+
+/// @brief Vertices around the skeleton with up to four influences each. Every 17th vertex has none and stays in place.
+static Mesh::Geometry makeGeometry(unsigned numVertices, unsigned numBones)
+{
+    Mesh::Geometry geometry;
+    uint32_t seed = 12345;
+    auto next = [&seed]{ seed = seed * 1664525u + 1013904223u; return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24); };
+    for(unsigned v = 0; v < numVertices; ++v)
+    {
+        glm::vec3 position(next() * 4.0f - 2.0f, next() * 8.0f, next() * 4.0f - 2.0f);
+        glm::vec3 normal = glm::normalize(glm::vec3(next() - 0.5f, next() - 0.5f, next() - 0.5f) + glm::vec3(0.0f, 0.01f, 0.0f));
+        glm::u16vec4 bones;
+        for(int i = 0; i < 4; ++i)
+            bones[i] = static_cast<uint16_t>(std::min(static_cast<unsigned>(next() * numBones), numBones - 1));
+        glm::vec4 weights = v % 17 == 0 ? glm::vec4(0.0f) : glm::vec4(next(), next() * 0.5f, next() * 0.25f, next() < 0.5f ? 0.0f : next() * 0.1f);
+        geometry.positions.push_back(position);
+        geometry.normals.push_back(normal);
+        geometry.boneIDs.push_back(bones);
+        geometry.weights.push_back(quantizeBoneWeights(weights));
+    }
+    geometry.boneIndexSize = getBoneIndexSize(geometry);
+    return geometry;
+}
+
+/// @brief Skin a mesh of @p numBones bones on both sides and compare.
+static bool checkSkinning(ComputeContext const &context, unsigned numBones, unsigned numVertices)
+{
+    Model::Skeleton skeleton = makeSkeleton(numBones);
+    auto layout = SkeletonLayout::build(skeleton);
+    if(!layout)
+        return false;
+    // Every bone bent its own way, so neighbouring palette entries differ
+    std::vector<BonePose> pose(numBones);
+    for(unsigned bone = 0; bone < numBones; ++bone)
+    {
+        float angle = 0.3f * std::sin(static_cast<float>(bone) * 0.7f);
+        glm::vec3 axis = glm::normalize(glm::vec3(std::cos(static_cast<float>(bone)), 1.0f, std::sin(static_cast<float>(bone) * 1.3f)));
+        glm::vec3 v = axis * std::sin(angle * 0.5f);
+        pose[bone].position = glm::vec3(skeleton.nodeTransform[bone][3]);
+        pose[bone].orientation = glm::quat(std::cos(angle * 0.5f), v.x, v.y, v.z);
+        pose[bone].scale = glm::vec3(1.0f + 0.05f * std::sin(static_cast<float>(bone)));
+    }
+    std::vector<glm::mat4> palette(numBones);
+    computePalette(*layout, pose, palette);
+
+    Mesh::Geometry geometry = makeGeometry(numVertices, numBones);
+    std::vector<glm::vec3> positions(numVertices), normals(numVertices);
+    skinVertices(geometry, palette, positions, normals);
+    std::vector<SkinnedVertex> skinned;
+    if(!skinOnDevice(context, geometry, palette, skinned))
+        return false;
+
+    glm::vec3 min = positions.front(), max = positions.front();
+    for(glm::vec3 const &p : positions)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+    float extent = std::max(glm::length(max - min), 1.0f);
+    float positionError = 0.0f, normalError = 0.0f;
+    size_t worst = 0;
+    for(size_t v = 0; v < positions.size(); ++v)
+    {
+        float error = glm::length(glm::vec3(skinned[v].position) - positions[v]) / extent;
+        if(error > positionError)
+        {
+            positionError = error;
+            worst = v;
+        }
+        normalError = std::max(normalError, glm::length(glm::vec3(skinned[v].normal) - normals[v]));
+    }
+    bool passed = positionError <= POSITION_TOLERANCE && normalError <= NORMAL_TOLERANCE;
+    LOG(passed ? spdlog::level::info : spdlog::level::err, "{} bones ({} byte indices), {} vertices: largest position error {} of the extent (vertex {}), largest normal error {}",
+        numBones, geometry.boneIndexSize, numVertices, positionError, worst, normalError);
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    sLogger = spdlog::stdout_color_mt("sLogger");
+    sLogger->set_level(spdlog::level::info);
+
+    std::string shaderPath = argc > 1 ? argv[1] : "shaders-bin/skinning.slang.spv";
+    ComputeContext context;
+    bool passed = createContext(context) && createPipeline(context, shaderPath);
+    // Both index sizes, vertex counts that don't fill the last group
+    if(passed)
+        passed = checkSkinning(context, 64, 10000 + 37);
+    if(passed)
+        passed = checkSkinning(context, 300, 4096 + 5);
+    if(context.device)
+        vkDeviceWaitIdle(context.device);
+    destroyContext(context);
+    LOG(passed ? spdlog::level::info : spdlog::level::err, "{}", passed ? "Skinning matches" : "Skinning check failed");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+#include "TextureAtlas.hpp"
+#include "Logging.hpp"
+#include "PixelFormat.hpp"
+#include "TextureProcessing.hpp"
+#include "libraries/stb_rect_pack.h"
+#include <algorithm>
+#include <bit>
+
+static bool canPack(Texture const &texture, TextureAtlasOptions const &options, unsigned padding)
+{
+    auto const &bitmap = texture.bitmap;
+    unsigned n = bitmap.numComponents;
+    return n >= 1 && n <= 4 && bitmap.size.x > 0 && bitmap.size.y > 0
+        && bitmap.size.x <= options.maxTextureSize && bitmap.size.y <= options.maxTextureSize
+        && bitmap.size.x + 2 * padding <= options.pageSize && bitmap.size.y + 2 * padding <= options.pageSize
+        && bitmap.pixels.size() >= size_t(bitmap.size.x) * bitmap.size.y * n;
+}
+
+TextureAtlas TextureAtlas::build(ecs::registry &reg, std::span<ecs::entity const> textures, TextureAtlasOptions const &options)
+{
+    TextureAtlas atlas;
+    unsigned const numLevels = std::clamp(options.numMipLevels, 1u, getMipLevelCount({options.pageSize, options.pageSize}));
+    // Rects are packed in cells of `cell` texels: the texels a texel of the last level covers, also the width of the gutter.
+    unsigned const cell = 1u << (numLevels - 1);
+    unsigned const pageCells = options.pageSize / cell;
+    auto toCells = [cell](unsigned texels){ return static_cast<int>((texels + 2 * cell + cell - 1) / cell); };
+
+    // sRGB and linear textures can't share an image
+    for(bool srgb : {false, true})
+    {
+        std::vector<ecs::entity> candidates;
+        for(ecs::entity e : textures)
+        {
+            if(!e || !reg.valid(e) || atlas.mRegions.contains(e) || std::find(candidates.begin(), candidates.end(), e) != candidates.end())
+                continue;
+            Texture const &texture = reg.get<Texture>(e);
+            if(texture.srgb == srgb && canPack(texture, options, cell))
+                candidates.push_back(e);
+        }
+        if(candidates.size() < 2)
+            continue;
+
+        std::vector<stbrp_rect> rects(candidates.size());
+        for(size_t i = 0; i < candidates.size(); ++i)
+        {
+            glm::uvec2 size = reg.get<Texture>(candidates[i]).bitmap.size;
+            rects[i] = stbrp_rect{.id = static_cast<int>(i), .w = toCells(size.x), .h = toCells(size.y), .x = 0, .y = 0, .was_packed = 0};
+        }
+        std::vector<stbrp_node> nodes(pageCells);
+        // Whatever doesn't fit on a page goes to the next one
+        while(!rects.empty())
+        {
+            stbrp_context context;
+            stbrp_init_target(&context, static_cast<int>(pageCells), static_cast<int>(pageCells), nodes.data(), static_cast<int>(nodes.size()));
+            stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size()));
+            auto packedEnd = std::partition(rects.begin(), rects.end(), [](stbrp_rect const &rect){ return rect.was_packed != 0; });
+            if(packedEnd == rects.begin())
+            {
+                LOG_ERROR("{} textures don't fit an atlas page of {}x{}", rects.size(), options.pageSize, options.pageSize);
+                break;
+            }
+
+            // The page is trimmed to the packed rects, rounded up to a power of two so every level halves it exactly
+            glm::uvec2 used{0};
+            for(auto it = rects.begin(); it != packedEnd; ++it)
+                used = glm::max(used, glm::uvec2(it->x + it->w, it->y + it->h) * cell);
+            glm::uvec2 size{std::bit_ceil(used.x), std::bit_ceil(used.y)};
+
+            Texture page;
+            page.srgb = srgb;
+            page.path = "atlas/page" + std::to_string(atlas.mPages.size());
+            page.bitmap = Bitmap<unsigned char>{
+                .pixels = PixelBuffer<unsigned char>(size_t(size.x) * size.y * 4),
+                .numComponents = 4,
+                .size = size
+            };
+            std::fill(page.bitmap.pixels.begin(), page.bitmap.pixels.end(), 0);
+
+            std::vector<std::pair<ecs::entity, AtlasRegion>> regions;
+            for(auto it = rects.begin(); it != packedEnd; ++it)
+            {
+                auto const &bitmap = reg.get<Texture>(candidates[it->id]).bitmap;
+                int const w = static_cast<int>(bitmap.size.x), h = static_cast<int>(bitmap.size.y), pad = static_cast<int>(cell);
+                glm::uvec2 origin = glm::uvec2(it->x, it->y) * cell + cell;
+                // The gutter wraps around, sampling across the edge of the region looks like a repeating sampler.
+                // Rows are copied in runs of consecutive source texels, expanded to RGBA the way uploads expand them.
+                for(int y = -pad; y < h + pad; ++y)
+                {
+                    unsigned char const *srcRow = &bitmap.pixels[size_t((y % h + h) % h) * w * bitmap.numComponents];
+                    for(int x = -pad; x < w + pad;)
+                    {
+                        int srcX = (x % w + w) % w;
+                        int run = std::min(w - srcX, w + pad - x);
+                        size_t dst = (size_t(origin.y + y) * size.x + origin.x + x) * 4;
+                        expandToRGBA(srcRow + size_t(srcX) * bitmap.numComponents, bitmap.numComponents, &page.bitmap.pixels[dst], run);
+                        x += run;
+                    }
+                }
+                regions.emplace_back(candidates[it->id], AtlasRegion{
+                    .offset = glm::vec2(origin) / glm::vec2(size),
+                    .scale = glm::vec2(bitmap.size) / glm::vec2(size)
+                });
+            }
+
+            // Levels past numLevels would mix neighbouring textures
+            unsigned pageLevels = std::min(numLevels, getMipLevelCount(size));
+            if(pageLevels > 1)
+            {
+                generateMipChain(page);
+                page.levels.resize(pageLevels);
+                auto const &last = page.levels.back();
+                page.bitmap.pixels.resize(last.offset + size_t(last.size.x) * last.size.y * 4);
+            }
+            page.numMipLevels = pageLevels;
+
+            LOG_INFO("Atlas page \"{}\": {}x{}, {} textures", page.path, size.x, size.y, regions.size());
+            ecs::entity ePage = reg.create(std::move(page));
+            atlas.mPages.push_back(ePage);
+            for(auto &[texture, region] : regions)
+            {
+                region.page = ePage;
+                atlas.mRegions.emplace(texture, region);
+            }
+            rects.erase(rects.begin(), packedEnd);
+        }
+    }
+    return atlas;
+}
+
+AtlasRegion TextureAtlas::getRegion(ecs::entity texture) const
+{
+    auto it = mRegions.find(texture);
+    return it == mRegions.end() ? AtlasRegion{.page = texture} : it->second;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "nicecs/ecs.hpp"
+#include "Model.hpp"
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+struct TextureAtlasOptions
+{
+    unsigned maxTextureSize = 64; /// Textures up to this size in both dimensions are packed, larger ones keep their own image.
+    unsigned pageSize = 1024; /// Largest width and height of a page, pages are trimmed to what they hold.
+    unsigned numMipLevels = 4; /// Levels of the pages. Textures are padded and aligned so none bleeds into another down to the last one.
+};
+
+/// @brief Where a texture ended up: it's sampled at offset + fract(uv) * scale on page.
+struct AtlasRegion
+{
+    ecs::entity page = INVALID_ENTITY;
+    glm::vec2 offset{0.0f};
+    glm::vec2 scale{1.0f};
+};
+
+/// @brief Small textures packed together into shared pages with stb_rect_pack, so they take one image and descriptor.
+/// Every packed texture is surrounded by a gutter that repeats it, like its own repeating sampler would, and starts on
+/// a multiple of 2^(numMipLevels - 1) texels so every level keeps one texel of it.
+class TextureAtlas
+{
+private:
+    std::vector<ecs::entity> mPages;
+    std::unordered_map<ecs::entity, AtlasRegion> mRegions;
+public:
+    /// @brief Pack the textures of @p textures that are small enough. The pages are created as Texture entities of @p reg.
+    /// sRGB and linear textures go to separate pages, textures without a bitmap (cooked block compressed ones) are left alone.
+    /// Groups of less than two textures aren't worth a page and are left alone as well.
+    static TextureAtlas build(ecs::registry &reg, std::span<ecs::entity const> textures, TextureAtlasOptions const &options = {});
+
+    /// @brief The region of @p texture, the whole texture itself if it wasn't packed.
+    AtlasRegion getRegion(ecs::entity texture) const;
+
+    inline std::span<ecs::entity const> getPages() const { return mPages; }
+    inline bool contains(ecs::entity texture) const { return mRegions.contains(texture); }
+};
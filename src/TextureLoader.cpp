@@ -1,60 +1,264 @@
 #include "Loaders.hpp"
+#include "AssetCache.hpp"
+#include "Ktx.hpp"
 #include "Logging.hpp"
+#include "Serialization.hpp"
+#include "TextureProcessing.hpp"
+#include "ThreadPool.hpp"
 #include "libraries/stb_image.h"
-#include "glm/gtc/integer.hpp"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
-TextureLoader::TextureLoader(ecs::registry &reg)
-{ 
-    mReg = &reg; 
+/// @brief A texture as it was read, before processLoadedTexture.
+struct DecodedTexture
+{
+    Texture texture;
+    uint64_t contentHash; // of the pixels (or the cooked file) and the options that change what they become
+    bool cooked; // KTX2, already in the form it's uploaded in
+};
+
+// Spent by every loader, see TextureLoader::setGlobalBudget
+static std::atomic<size_t> sGlobalBudget = 0, sGlobalBudgetUsage = 0;
+
+uint64_t TextureLoader::hashOptions(TextureLoaderOptions const &options, uint64_t seed)
+{
+    uint64_t hash = hashValue(options.flip, seed);
+    hash = hashValue(options.srgb, hash);
+    hash = hashValue(options.generateMips, hash);
+    hash = hashValue(options.premultiplyAlpha, hash);
+    hash = hashValue(options.maxDimension, hash);
+    hash = hashValue(options.maxBytes, hash);
+    hash = hashValue(options.usage, hash);
+    hash = hashValue(options.compression.enabled, hash);
+    hash = hashValue(options.compression.keepBitmap, hash);
+    return hashValue(options.compression.quality, hash);
 }
-ecs::entity TextureLoader::loadFromFile(std::string_view path, TextureLoaderOptions options)
+
+// Requests of a batch for the same file with the same options, by canonical path and options hash
+struct RequestKeyHash
+{
+    size_t operator()(std::pair<std::string, uint64_t> const &key) const { return std::hash<std::string>{}(key.first) ^ std::hash<uint64_t>{}(key.second); }
+};
+
+/// @brief Read an encoded image, or a cooked KTX2 texture as it is.
+/// Runs on worker threads: only thread local stb state is used.
+static std::optional<DecodedTexture> decodeImage(std::span<unsigned char const> data, std::string_view path, TextureLoaderOptions const &options)
 {
-    for(auto e_texture : mReg->view<Texture>())
-        if(mReg->get<Texture>(e_texture).path == path)
-            return e_texture;
+    if(isKtx2(data))
+    {
+        // Levels over the limits are left in the file
+        auto size = getKtx2Size(data);
+        unsigned skipLevels = size ? getSkippedLevels(*size, options.maxDimension, options.maxBytes) : 0;
+        auto texture = readKtx2(data, options.flip, skipLevels);
+        if(!texture)
+        {
+            LOG_ERROR("failed to load texture: \"{}\"!", path);
+            return std::nullopt;
+        }
+        texture->path = path;
+        // Uncompressed RGB and grey files are stored as written, they are sampled as RGBA
+        if(!convertTextureToRGBA(*texture))
+            return std::nullopt;
+        // Files with fewer mips than the levels to skip are filtered down the rest of the way, if they can be
+        if(unsigned left = getSkippedLevels(texture->bitmap.size, options.maxDimension, options.maxBytes))
+        {
+            if(texture->format == TextureFormat::uncompressed)
+                downscaleTexture(*texture, left);
+            else
+                LOG_WARN("\"{}\" is {}x{}, over the texture limits, and block compressed without the mips to skip to", path, texture->bitmap.size.x, texture->bitmap.size.y);
+        }
+        return DecodedTexture{.texture = std::move(*texture), .contentHash = TextureLoader::hashOptions(options, hashBytes(data.data(), data.size())), .cooked = true};
+    }
 
     int width = 0, height = 0, numChannels = 0;
-    stbi_set_flip_vertically_on_load(options.flip);
-    unsigned char *buff = stbi_load(path.data(), &width, &height, &numChannels, 4);
+    // The global flag would race with loads on other threads
+    stbi_set_flip_vertically_on_load_thread(options.flip);
+    unsigned char *buff = stbi_load_from_memory(data.data(), static_cast<int>(data.size()), &width, &height, &numChannels, 4);
     if(!buff)
     {
         LOG_ERROR("failed to load texture: \"{}\"!: {}", path, stbi_failure_reason());
-        return INVALID_ENTITY;
+        return std::nullopt;
     }
     assert(width > 0 && height > 0 && "failed to load a texture");
-    Texture texture;
+    DecodedTexture decoded{.texture = {}, .contentHash = 0, .cooked = false};
+    Texture &texture = decoded.texture;
+    // 4 components are requested whatever the file has, the decoded buffer becomes the bitmap as it is
     texture.bitmap = Bitmap<unsigned char>{
-        .pixels = std::vector<unsigned char>(buff, buff + width * height * numChannels),
-        .numComponents = static_cast<unsigned>(numChannels),
-        .size = {width, height}
+        .pixels = PixelBuffer<unsigned char>::adopt(buff, static_cast<size_t>(width) * height * 4, stbi_image_free),
+        .numComponents = 4,
+        .size = {static_cast<unsigned>(width), static_cast<unsigned>(height)}
     };
     texture.path = path;
-    texture.numMipLevels = static_cast<uint32_t>(glm::ceil(glm::log2(std::max(texture.bitmap.size.x, texture.bitmap.size.y))));
-    stbi_image_free(buff);
+    texture.numMipLevels = getMipLevelCount(texture.bitmap.size);
+    // Downscaled right away, the full resolution bitmap is freed before the next decode on this thread
+    downscaleTexture(texture, getSkippedLevels(texture.bitmap.size, options.maxDimension, options.maxBytes));
+    // Files encoded differently (or in other formats) that decode to the same pixels are the same texture
+    decoded.contentHash = TextureLoader::hashOptions(options, hashBytes(texture.bitmap.pixels.data(), texture.bitmap.pixels.size(), hashValue(texture.bitmap.size)));
+    return decoded;
+}
+static std::optional<DecodedTexture> decodeRequest(TextureLoadRequest const &request)
+{
+    if(!request.data.empty())
+        return decodeImage(request.data, request.path, request.options);
 
-    return mReg->create(std::move(texture));
+    MappedFile file;
+    if(!file.open(request.path))
+    {
+        LOG_ERROR("failed to open texture: \"{}\"!", request.path);
+        return std::nullopt;
+    }
+    std::span<unsigned char const> data{reinterpret_cast<unsigned char const *>(file.bytes().data()), file.bytes().size()};
+    return decodeImage(data, request.path, request.options);
 }
-ecs::entity TextureLoader::loadFromMemory(void const *data, size_t size, TextureLoaderOptions options)
+
+/// @brief Count @p decoded against the global budget.
+/// @return How many more levels it has to lose to fit in what is left of the budget.
+static unsigned chargeGlobalBudget(DecodedTexture const &decoded)
 {
-    int width = 0, height = 0, numChannels = 0;
-    stbi_set_flip_vertically_on_load(options.flip);
-    unsigned char *buff = stbi_load_from_memory(static_cast<unsigned char const *>(data), size, &width, &height, &numChannels, 4);
-    if(!buff)
+    size_t budget = sGlobalBudget.load();
+    glm::uvec2 size = decoded.texture.bitmap.size;
+    unsigned skipLevels = 0;
+    if(budget && !decoded.cooked)
     {
-        LOG_ERROR("failed to load texture from memory: {}", stbi_failure_reason());
-        return INVALID_ENTITY;
+        size_t used = sGlobalBudgetUsage.load();
+        size_t left = used < budget ? budget - used : 0;
+        unsigned maxSkipLevels = 0;
+        while(std::max(size.x, size.y) >> (maxSkipLevels + 1) >= TextureLoader::BUDGET_MIN_DIMENSION)
+            ++maxSkipLevels;
+        skipLevels = std::min(getSkippedLevels(size, 0, std::max<size_t>(left, 1)), maxSkipLevels);
+        size = glm::max(glm::uvec2(size.x >> skipLevels, size.y >> skipLevels), glm::uvec2(1));
+        if(size_t(size.x) * size.y * 4 > left)
+            LOG_WARN("Texture budget of {} bytes is spent, \"{}\" is loaded at {}x{} anyway", budget, decoded.texture.path, size.x, size.y);
     }
-    assert(width > 0 && height > 0 && "failed to load a texture");
-    Texture texture;
-    texture.bitmap = Bitmap<unsigned char>{
-        .pixels = std::vector<unsigned char>(buff, buff + width * height * numChannels),
-        .numComponents = static_cast<unsigned>(numChannels),
-        .size = {width, height}
-    };
-    texture.path = "loadFromMemory";
-    texture.numMipLevels = static_cast<uint32_t>(glm::ceil(glm::log2(std::max(texture.bitmap.size.x, texture.bitmap.size.y))));
-    stbi_image_free(buff);
+    sGlobalBudgetUsage += size_t(size.x) * size.y * 4;
+    return skipLevels;
+}
 
-    return mReg->create(std::move(texture));
+void TextureLoader::setGlobalBudget(size_t bytes)
+{
+    sGlobalBudget = bytes;
+    sGlobalBudgetUsage = 0;
+}
+size_t TextureLoader::getGlobalBudgetUsage()
+{
+    return sGlobalBudgetUsage.load();
 }
 
+TextureLoader::TextureLoader(ecs::registry &reg)
+{
+    mReg = &reg;
+}
+std::optional<Texture> TextureLoader::decode(TextureLoadRequest const &request)
+{
+    auto decoded = decodeRequest(request);
+    if(!decoded)
+        return std::nullopt;
+    if(!decoded->cooked)
+        processLoadedTexture(decoded->texture, request.options);
+    return std::move(decoded->texture);
+}
+ecs::entity TextureLoader::loadFromFile(std::string_view path, TextureLoaderOptions options)
+{
+    TextureLoadRequest request{.path = std::string{path}, .options = options};
+    return loadBatch({&request, 1}).front();
+}
+ecs::entity TextureLoader::loadFromMemory(void const *data, size_t size, TextureLoaderOptions options)
+{
+    TextureLoadRequest request{
+        .path = "loadFromMemory",
+        .data = {static_cast<unsigned char const *>(data), size},
+        .options = options
+    };
+    return loadBatch({&request, 1}).front();
+}
+std::vector<ecs::entity> TextureLoader::loadBatch(std::span<TextureLoadRequest const> requests)
+{
+    std::vector<ecs::entity> entities(requests.size(), INVALID_ENTITY);
+    AssetCache &cache = AssetCache::of(*mReg);
+    // Files are cached by path, memory blobs only by content. A file loaded with other options is another texture.
+    auto cachedPath = [&](size_t i){ return requests[i].data.empty() ? std::string_view{requests[i].path} : std::string_view{}; };
+    auto variant = [&](size_t i){ return hashOptions(requests[i].options, 0); };
+
+    // Cached files are done already, a file requested again in the batch waits for its first request
+    std::vector<size_t> pending;
+    std::vector<std::pair<size_t, size_t>> pathRepeats; // request, the earlier request it gets the texture of
+    std::unordered_map<std::pair<std::string, uint64_t>, size_t, RequestKeyHash> firstRequests;
+    for(size_t i = 0; i < requests.size(); ++i)
+    {
+        TextureLoadRequest const &request = requests[i];
+        if(request.data.empty())
+        {
+            if((entities[i] = cache.acquire(AssetKind::texture, request.path, variant(i))))
+                continue;
+            auto [first, inserted] = firstRequests.emplace(std::pair{AssetCache::canonicalize(request.path), variant(i)}, i);
+            if(!inserted)
+            {
+                pathRepeats.emplace_back(i, first->second);
+                continue;
+            }
+        }
+        pending.push_back(i);
+    }
+
+    // Each worker takes a request from the file to the finished texture, so only the full size bitmaps being decoded
+    // right now are in memory, never the whole batch at once.
+    // Identical contents are only processed once: the cache and earlier requests of the batch are checked by content hash.
+    // The cache is only read while the workers run, the hits are acquired on this thread afterwards.
+    enum class Outcome : uint8_t { failed, loaded, found }; // found in the cache or loaded by another request of the batch
+    std::vector<std::optional<DecodedTexture>> decoded(pending.size());
+    std::vector<Outcome> outcomes(pending.size(), Outcome::failed);
+    std::vector<uint64_t> contentHashes(pending.size(), 0);
+    std::unordered_set<uint64_t> firstContents;
+    std::mutex firstContentsMutex;
+    // The global budget is spent in request order, whatever order the decodes finish in.
+    // Workers take requests in order, so the one a worker waits for is always being worked on.
+    std::atomic<size_t> nextCharge = 0; // into pending
+    ThreadPool::global().parallelFor(pending.size(), [&](size_t i){
+        size_t request = pending[i];
+        decoded[i] = decodeRequest(requests[request]);
+        if(decoded[i])
+        {
+            contentHashes[i] = decoded[i]->contentHash;
+            outcomes[i] = Outcome::found;
+            if(!cache.findByContent(AssetKind::texture, contentHashes[i]))
+            {
+                std::lock_guard lock(firstContentsMutex);
+                if(firstContents.insert(contentHashes[i]).second)
+                    outcomes[i] = Outcome::loaded;
+            }
+            if(outcomes[i] != Outcome::loaded)
+                decoded[i].reset();
+        }
+
+        unsigned budgetLevels = 0;
+        for(size_t turn; (turn = nextCharge.load()) != i;)
+            nextCharge.wait(turn);
+        if(outcomes[i] == Outcome::loaded)
+            budgetLevels = chargeGlobalBudget(*decoded[i]);
+        nextCharge.store(i + 1);
+        nextCharge.notify_all();
+
+        // Before the mips and blocks that would come from the full size
+        if(outcomes[i] != Outcome::loaded || decoded[i]->cooked)
+            return;
+        downscaleTexture(decoded[i]->texture, budgetLevels);
+        processLoadedTexture(decoded[i]->texture, requests[request].options);
+    });
+
+    // The registry is only touched from this thread
+    for(size_t i = 0; i < pending.size(); ++i)
+        if(outcomes[i] == Outcome::loaded)
+        {
+            entities[pending[i]] = mReg->create(std::move(decoded[i]->texture));
+            cache.insert(AssetKind::texture, cachedPath(pending[i]), entities[pending[i]], contentHashes[i], variant(pending[i]));
+        }
+    for(size_t i = 0; i < pending.size(); ++i)
+        if(outcomes[i] == Outcome::found)
+            entities[pending[i]] = cache.acquireByContent(AssetKind::texture, contentHashes[i], cachedPath(pending[i]), variant(pending[i]));
+    for(auto [i, first] : pathRepeats)
+        if(entities[first])
+            entities[i] = cache.acquire(AssetKind::texture, requests[first].path, variant(first));
+    return entities;
+}
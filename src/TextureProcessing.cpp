@@ -0,0 +1,1079 @@
+#include "TextureProcessing.hpp"
+#include "Logging.hpp"
+#include "PixelFormat.hpp"
+#include "ThreadPool.hpp"
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TEXTURE_PROCESSING_X86
+#include <immintrin.h>
+#endif
+
+/// @brief Whether component @p c of a pixel with @p n components holds color (as opposed to alpha).
+static bool isColorComponent(unsigned c, unsigned n)
+{
+    return n >= 3 ? c < 3 : c == 0;
+}
+
+/// @brief Widen a row of 8-bit pixels to 4 floats per pixel, linearizing the color channels of sRGB data.
+static void decodeRow(unsigned char const *src, unsigned width, unsigned n, bool srgb, float *dst)
+{
+    if(n == 4)
+        return rgba8ToFloat(src, srgb, dst, width);
+    for(unsigned x = 0; x < width; ++x)
+        for(unsigned c = 0; c < 4; ++c)
+        {
+            if(c >= n)
+                dst[x * 4 + c] = 0.f;
+            else if(srgb && isColorComponent(c, n))
+                dst[x * 4 + c] = srgbToLinear(src[x * n + c]);
+            else
+                dst[x * 4 + c] = src[x * n + c] * (1.f / 255.f);
+        }
+}
+
+/// @brief Narrow a row of 4-float pixels back to 8 bits, the inverse of decodeRow.
+static void encodeRow(float const *src, unsigned width, unsigned n, bool srgb, unsigned char *dst)
+{
+    if(n == 4)
+        return floatToRGBA8(src, srgb, dst, width);
+    for(unsigned x = 0; x < width; ++x)
+        for(unsigned c = 0; c < n; ++c)
+        {
+            float v = std::clamp(src[x * 4 + c], 0.f, 1.f);
+            if(srgb && isColorComponent(c, n))
+                dst[x * n + c] = linearToSrgb(v);
+            else
+                dst[x * n + c] = static_cast<unsigned char>(v * 255.f + 0.5f);
+        }
+}
+
+/// @brief 2x2 box filter of two decoded source rows into one destination row.
+/// Odd source widths repeat the last column.
+using DownsampleRowFn = void (*)(float const *row0, float const *row1, unsigned srcWidth, float *dst, unsigned dstWidth);
+
+#ifdef TEXTURE_PROCESSING_X86
+static void downsampleRowSSE(float const *row0, float const *row1, unsigned srcWidth, float *dst, unsigned dstWidth)
+{
+    __m128 quarter = _mm_set1_ps(0.25f);
+    for(unsigned x = 0; x < dstWidth; ++x)
+    {
+        unsigned x0 = std::min(2 * x, srcWidth - 1) * 4, x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+        __m128 top = _mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1));
+        __m128 bottom = _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1));
+        _mm_storeu_ps(dst + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+    }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+/// @brief AVX variant, two destination pixels (four source pixels per row) per iteration.
+__attribute__((target("avx")))
+static void downsampleRowAVX(float const *row0, float const *row1, unsigned srcWidth, float *dst, unsigned dstWidth)
+{
+    __m256 quarter = _mm256_set1_ps(0.25f);
+    unsigned x = 0;
+    for(; x + 1 < dstWidth && 2 * x + 3 < srcWidth; x += 2)
+    {
+        // a holds source pixels 2x and 2x+1, b holds 2x+2 and 2x+3, both rows already summed
+        __m256 a = _mm256_add_ps(_mm256_loadu_ps(row0 + 8 * x), _mm256_loadu_ps(row1 + 8 * x));
+        __m256 b = _mm256_add_ps(_mm256_loadu_ps(row0 + 8 * x + 8), _mm256_loadu_ps(row1 + 8 * x + 8));
+        __m256 sum = _mm256_add_ps(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31));
+        _mm256_storeu_ps(dst + 4 * x, _mm256_mul_ps(sum, quarter));
+    }
+    // The clamped tail of odd widths
+    __m128 quarter128 = _mm_set1_ps(0.25f);
+    for(; x < dstWidth; ++x)
+    {
+        unsigned x0 = std::min(2 * x, srcWidth - 1) * 4, x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+        __m128 top = _mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1));
+        __m128 bottom = _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1));
+        _mm_storeu_ps(dst + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarter128));
+    }
+}
+#endif
+#else
+static void downsampleRowScalar(float const *row0, float const *row1, unsigned srcWidth, float *dst, unsigned dstWidth)
+{
+    for(unsigned x = 0; x < dstWidth; ++x)
+    {
+        unsigned x0 = std::min(2 * x, srcWidth - 1) * 4, x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+        for(unsigned c = 0; c < 4; ++c)
+            dst[x * 4 + c] = 0.25f * (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]);
+    }
+}
+#endif
+
+/// @brief Pick the widest filter the CPU supports.
+static DownsampleRowFn getDownsampleRow()
+{
+#ifdef TEXTURE_PROCESSING_X86
+#if defined(__GNUC__) || defined(__clang__)
+    static DownsampleRowFn const fn = __builtin_cpu_supports("avx") ? downsampleRowAVX : downsampleRowSSE;
+    return fn;
+#else
+    return downsampleRowSSE;
+#endif
+#else
+    return downsampleRowScalar;
+#endif
+}
+
+void generateMipChain(Texture &texture)
+{
+    auto &bitmap = texture.bitmap;
+    unsigned n = bitmap.numComponents;
+    if(n == 0 || n > 4 || bitmap.size.x == 0 || bitmap.size.y == 0 || bitmap.pixels.size() < size_t(bitmap.size.x) * bitmap.size.y * n)
+    {
+        LOG_ERROR("can't generate mipmaps for texture \"{}\": invalid bitmap", texture.path);
+        return;
+    }
+
+    // Lay all levels out back to back after the base level
+    unsigned numLevels = getMipLevelCount(bitmap.size);
+    texture.levels.clear();
+    size_t total = 0;
+    for(glm::uvec2 size = bitmap.size; texture.levels.size() < numLevels; size = glm::max(size / 2u, glm::uvec2(1)))
+    {
+        texture.levels.push_back({total, size});
+        total += size_t(size.x) * size.y * n;
+    }
+    bitmap.pixels.resize(total);
+    texture.numMipLevels = numLevels;
+
+    // Each level is filtered from the previous one, in bands of rows
+    constexpr unsigned BAND_ROWS = 16;
+    auto downsampleRow = getDownsampleRow();
+    for(unsigned level = 1; level < numLevels; ++level)
+    {
+        auto const &src = texture.levels[level - 1];
+        auto const &dst = texture.levels[level];
+        unsigned char const *srcPixels = bitmap.pixels.data() + src.offset;
+        unsigned char *dstPixels = bitmap.pixels.data() + dst.offset;
+        size_t numBands = (dst.size.y + BAND_ROWS - 1) / BAND_ROWS;
+        ThreadPool::global().parallelFor(numBands, [&](size_t band){
+            std::vector<float> row0(size_t(src.size.x) * 4), row1(size_t(src.size.x) * 4), out(size_t(dst.size.x) * 4);
+            unsigned end = std::min<unsigned>((band + 1) * BAND_ROWS, dst.size.y);
+            for(unsigned y = band * BAND_ROWS; y < end; ++y)
+            {
+                unsigned y0 = std::min(2 * y, src.size.y - 1), y1 = std::min(2 * y + 1, src.size.y - 1);
+                decodeRow(srcPixels + size_t(y0) * src.size.x * n, src.size.x, n, texture.srgb, row0.data());
+                decodeRow(srcPixels + size_t(y1) * src.size.x * n, src.size.x, n, texture.srgb, row1.data());
+                downsampleRow(row0.data(), row1.data(), src.size.x, out.data(), dst.size.x);
+                encodeRow(out.data(), dst.size.x, n, texture.srgb, dstPixels + size_t(y) * dst.size.x * n);
+            }
+        });
+    }
+}
+
+void generateMipChains(std::span<Texture *const> textures)
+{
+    ThreadPool::global().parallelFor(textures.size(), [&](size_t i){ generateMipChain(*textures[i]); });
+}
+
+unsigned getSkippedLevels(glm::uvec2 size, unsigned maxDimension, size_t maxBytes)
+{
+    unsigned skipped = 0;
+    auto fits = [&]{
+        return (maxDimension == 0 || std::max(size.x, size.y) <= maxDimension) && (maxBytes == 0 || size_t(size.x) * size.y * 4 <= maxBytes);
+    };
+    for(; !fits() && size != glm::uvec2(1); ++skipped)
+        size = glm::max(size / 2u, glm::uvec2(1));
+    return skipped;
+}
+
+// Lanczos3 stretched to a 2x reduction, L3(d / 2) / 2 at d = 0.5 to 5.5 source texels from the center of a destination texel, normalized.
+// Cuts off above the new Nyquist frequency: less aliasing than the box filter of the mips, which is enough between levels
+// but aliases when levels are skipped, while keeping more detail than a wider blur would.
+static constexpr int LANCZOS3_NUM_TAPS = 12;
+static constexpr float LANCZOS3_TAPS[LANCZOS3_NUM_TAPS] = {
+    0.00369f, 0.01506f, -0.03400f, -0.06664f, 0.13551f, 0.44638f, 0.44638f, 0.13551f, -0.06664f, -0.03400f, 0.01506f, 0.00369f
+};
+// The source texel of the first tap of destination texel x is 2x + LANCZOS3_FIRST_TAP
+static constexpr int LANCZOS3_FIRST_TAP = 1 - LANCZOS3_NUM_TAPS / 2;
+
+/// @brief Filter a row of 4-float pixels to half its width, repeating the edge texels.
+static void lanczosRow(float const *src, unsigned srcWidth, float *dst, unsigned dstWidth)
+{
+    for(unsigned x = 0; x < dstWidth; ++x)
+    {
+#ifdef TEXTURE_PROCESSING_X86
+        __m128 sum = _mm_setzero_ps();
+        for(int t = 0; t < LANCZOS3_NUM_TAPS; ++t)
+        {
+            unsigned sx = std::clamp<int>(2 * static_cast<int>(x) + LANCZOS3_FIRST_TAP + t, 0, static_cast<int>(srcWidth) - 1);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + sx * 4), _mm_set1_ps(LANCZOS3_TAPS[t])));
+        }
+        _mm_storeu_ps(dst + x * 4, sum);
+#else
+        for(unsigned c = 0; c < 4; ++c)
+        {
+            float sum = 0.f;
+            for(int t = 0; t < LANCZOS3_NUM_TAPS; ++t)
+                sum += src[std::clamp<int>(2 * static_cast<int>(x) + LANCZOS3_FIRST_TAP + t, 0, static_cast<int>(srcWidth) - 1) * 4 + c] * LANCZOS3_TAPS[t];
+            dst[x * 4 + c] = sum;
+        }
+#endif
+    }
+}
+/// @brief Weighted sum of LANCZOS3_NUM_TAPS filtered rows into one, the vertical pass of lanczosRow.
+static void lanczosColumns(std::array<float const *, LANCZOS3_NUM_TAPS> const &rows, size_t numFloats, float *dst)
+{
+    size_t i = 0;
+#ifdef TEXTURE_PROCESSING_X86
+    for(; i + 4 <= numFloats; i += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for(int t = 0; t < LANCZOS3_NUM_TAPS; ++t)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[t] + i), _mm_set1_ps(LANCZOS3_TAPS[t])));
+        _mm_storeu_ps(dst + i, sum);
+    }
+#endif
+    for(; i < numFloats; ++i)
+    {
+        float sum = 0.f;
+        for(int t = 0; t < LANCZOS3_NUM_TAPS; ++t)
+            sum += rows[t][i] * LANCZOS3_TAPS[t];
+        dst[i] = sum;
+    }
+}
+
+/// @brief Halve the base level of @p texture into @p out.
+static void halveBitmap(Texture const &texture, Bitmap<unsigned char> &out)
+{
+    auto const &src = texture.bitmap;
+    unsigned n = src.numComponents;
+    glm::uvec2 size = glm::max(src.size / 2u, glm::uvec2(1));
+    out = Bitmap<unsigned char>{.pixels = PixelBuffer<unsigned char>(size_t(size.x) * size.y * n), .numComponents = n, .size = size};
+
+    // Each band filters the source rows it needs horizontally once, into a ring of the last LANCZOS3_NUM_TAPS
+    constexpr unsigned BAND_ROWS = 16;
+    size_t numBands = (size.y + BAND_ROWS - 1) / BAND_ROWS;
+    ThreadPool::global().parallelFor(numBands, [&](size_t band){
+        size_t rowFloats = size_t(size.x) * 4;
+        std::vector<float> decoded(size_t(src.size.x) * 4), ring(rowFloats * LANCZOS3_NUM_TAPS), column(rowFloats);
+        std::array<int, LANCZOS3_NUM_TAPS> ringRows;
+        ringRows.fill(-1);
+        auto filteredRow = [&](int y){
+            y = std::clamp(y, 0, static_cast<int>(src.size.y) - 1);
+            float *row = ring.data() + size_t(y % LANCZOS3_NUM_TAPS) * rowFloats;
+            if(ringRows[y % LANCZOS3_NUM_TAPS] != y)
+            {
+                decodeRow(src.pixels.data() + size_t(y) * src.size.x * n, src.size.x, n, texture.srgb, decoded.data());
+                lanczosRow(decoded.data(), src.size.x, row, size.x);
+                ringRows[y % LANCZOS3_NUM_TAPS] = y;
+            }
+            return static_cast<float const *>(row);
+        };
+        unsigned end = std::min<unsigned>((band + 1) * BAND_ROWS, size.y);
+        for(unsigned y = band * BAND_ROWS; y < end; ++y)
+        {
+            // LANCZOS3_NUM_TAPS consecutive rows (repeated at the edges) never share a slot of the ring
+            std::array<float const *, LANCZOS3_NUM_TAPS> rows;
+            for(int t = 0; t < LANCZOS3_NUM_TAPS; ++t)
+                rows[t] = filteredRow(2 * static_cast<int>(y) + LANCZOS3_FIRST_TAP + t);
+            lanczosColumns(rows, rowFloats, column.data());
+            encodeRow(column.data(), size.x, n, texture.srgb, out.pixels.data() + size_t(y) * size.x * n);
+        }
+    });
+}
+
+void downscaleTexture(Texture &texture, unsigned numLevels)
+{
+    auto &bitmap = texture.bitmap;
+    unsigned n = bitmap.numComponents;
+    numLevels = std::min(numLevels, getMipLevelCount(bitmap.size) - 1);
+    if(numLevels == 0)
+        return;
+    if(texture.format != TextureFormat::uncompressed || n == 0 || n > 4 || bitmap.pixels.size() < size_t(bitmap.size.x) * bitmap.size.y * n)
+    {
+        LOG_ERROR("can't downscale texture \"{}\": no bitmap to filter", texture.path);
+        return;
+    }
+    glm::uvec2 fullSize = bitmap.size;
+
+    if(texture.levels.size() > numLevels)
+    {
+        // The mips are there already, the smaller ones move to the front
+        Texture::Level const &base = texture.levels[numLevels];
+        std::memmove(bitmap.pixels.data(), bitmap.pixels.data() + base.offset, bitmap.pixels.size() - base.offset);
+        size_t removed = base.offset;
+        texture.levels.erase(texture.levels.begin(), texture.levels.begin() + numLevels);
+        for(auto &level : texture.levels)
+            level.offset -= removed;
+        bitmap.pixels.resize(bitmap.pixels.size() - removed);
+        bitmap.size = texture.levels.front().size;
+    }
+    else
+    {
+        texture.levels.clear();
+        for(unsigned level = 0; level < numLevels; ++level)
+        {
+            Bitmap<unsigned char> half;
+            halveBitmap(texture, half);
+            bitmap = std::move(half);
+        }
+    }
+    texture.numMipLevels = std::min(texture.numMipLevels, getMipLevelCount(bitmap.size));
+    texture.skippedLevels += numLevels;
+    LOG_INFO("Downscaled \"{}\" from {}x{} to {}x{}", texture.path, fullSize.x, fullSize.y, bitmap.size.x, bitmap.size.y);
+}
+
+/// @brief A 4x4 block of RGBA pixels in [0, 255].
+using BlockPixels = std::array<glm::vec4, 16>;
+using BlockValues = std::array<float, 16>;
+using Quality = TextureCompressionOptions::Quality;
+
+/// @brief Read the block at @p block, repeating the last row/column for blocks hanging over the edge.
+static void fetchBlock(unsigned char const *pixels, glm::uvec2 size, unsigned n, glm::uvec2 block, BlockPixels &out)
+{
+    for(unsigned y = 0; y < 4; ++y)
+        for(unsigned x = 0; x < 4; ++x)
+        {
+            unsigned px = std::min(block.x * 4 + x, size.x - 1), py = std::min(block.y * 4 + y, size.y - 1);
+            unsigned char const *src = pixels + (static_cast<size_t>(py) * size.x + px) * n;
+            glm::vec4 &dst = out[y * 4 + x];
+            switch(n)
+            {
+            case 1: dst = glm::vec4(src[0], src[0], src[0], 255); break; // grey
+            case 2: dst = glm::vec4(src[0], src[0], src[0], src[1]); break; // grey, alpha
+            case 3: dst = glm::vec4(src[0], src[1], src[2], 255); break;
+            case 4: dst = glm::vec4(src[0], src[1], src[2], src[3]); break;
+            }
+        }
+}
+
+static BlockValues getChannel(BlockPixels const &pixels, unsigned channel)
+{
+    BlockValues values;
+    for(unsigned i = 0; i < 16; ++i)
+        values[i] = pixels[i][channel];
+    return values;
+}
+
+static float distanceSquared(glm::vec4 const &a, glm::vec4 const &b, unsigned channels)
+{
+    float sum = 0.f;
+    for(unsigned c = 0; c < channels; ++c)
+        sum += (a[c] - b[c]) * (a[c] - b[c]);
+    return sum;
+}
+
+/// @brief Pick the two endpoints of the line the first @p channels of the block are fitted to.
+/// Either the corners of the bounding box or the extent of the block along its principal axis.
+static void fitEndpoints(BlockPixels const &pixels, unsigned channels, bool principalAxis, glm::vec4 &e0, glm::vec4 &e1)
+{
+    glm::vec4 lo(255.f), hi(0.f);
+    for(auto const &p : pixels)
+        for(unsigned c = 0; c < channels; ++c)
+        {
+            lo[c] = std::min(lo[c], p[c]);
+            hi[c] = std::max(hi[c], p[c]);
+        }
+    e0 = lo;
+    e1 = hi;
+    if(!principalAxis)
+        return;
+
+    glm::vec4 mean(0.f);
+    for(auto const &p : pixels)
+        mean += p;
+    mean /= 16.f;
+    float covariance[4][4] = {};
+    for(auto const &p : pixels)
+        for(unsigned i = 0; i < channels; ++i)
+            for(unsigned j = 0; j < channels; ++j)
+                covariance[i][j] += (p[i] - mean[i]) * (p[j] - mean[j]);
+
+    // Power iteration, starting from the bounding box diagonal
+    glm::vec4 axis = hi - lo;
+    for(unsigned iteration = 0; iteration < 8; ++iteration)
+    {
+        glm::vec4 next(0.f);
+        float largest = 0.f;
+        for(unsigned i = 0; i < channels; ++i)
+        {
+            for(unsigned j = 0; j < channels; ++j)
+                next[i] += covariance[i][j] * axis[j];
+            largest = std::max(largest, std::abs(next[i]));
+        }
+        if(largest < 1e-6f)
+            return; // flat block, the bounding box is exact
+        axis = next / largest;
+    }
+    float length = std::sqrt(distanceSquared(axis, glm::vec4(0.f), channels));
+    axis /= length;
+
+    float tMin = std::numeric_limits<float>::max(), tMax = -tMin;
+    for(auto const &p : pixels)
+    {
+        float t = 0.f;
+        for(unsigned c = 0; c < channels; ++c)
+            t += (p[c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for(unsigned c = 0; c < channels; ++c)
+    {
+        e0[c] = std::clamp(mean[c] + axis[c] * tMin, 0.f, 255.f);
+        e1[c] = std::clamp(mean[c] + axis[c] * tMax, 0.f, 255.f);
+    }
+}
+
+/// @brief Least squares endpoints for pixels already assigned to the points at @p weights between them.
+/// @return false if the weights don't determine the endpoints (all pixels on one point).
+static bool refineEndpoints(BlockPixels const &pixels, unsigned channels, BlockValues const &weights, glm::vec4 &e0, glm::vec4 &e1)
+{
+    float aa = 0.f, ab = 0.f, bb = 0.f;
+    glm::vec4 ax(0.f), bx(0.f);
+    for(unsigned i = 0; i < 16; ++i)
+    {
+        float b = weights[i], a = 1.f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        ax += pixels[i] * a;
+        bx += pixels[i] * b;
+    }
+    float determinant = aa * bb - ab * ab;
+    if(std::abs(determinant) < 1e-6f)
+        return false;
+    for(unsigned c = 0; c < channels; ++c)
+    {
+        e0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.f, 255.f);
+        e1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.f, 255.f);
+    }
+    return true;
+}
+
+static unsigned getRefinementIterations(Quality quality)
+{
+    return quality == Quality::best ? 3 : 0;
+}
+
+/// @brief Writes little endian bit fields, the layout of BC7 blocks.
+struct BitWriter
+{
+    unsigned char *out;
+    unsigned position = 0;
+
+    void write(unsigned value, unsigned count)
+    {
+        for(unsigned i = 0; i < count; ++i, ++position)
+            if(value >> i & 1)
+                out[position / 8] |= 1 << position % 8;
+    }
+};
+struct BitReader
+{
+    unsigned char const *in;
+    unsigned position = 0;
+
+    unsigned read(unsigned count)
+    {
+        unsigned value = 0;
+        for(unsigned i = 0; i < count; ++i, ++position)
+            value |= (in[position / 8] >> position % 8 & 1) << i;
+        return value;
+    }
+};
+
+static uint16_t packRgb565(glm::vec4 const &c)
+{
+    auto quantize = [](float v, unsigned max){ return static_cast<unsigned>(std::clamp(v, 0.f, 255.f) * max / 255.f + 0.5f); };
+    return static_cast<uint16_t>(quantize(c.x, 31) << 11 | quantize(c.y, 63) << 5 | quantize(c.z, 31));
+}
+static glm::vec4 unpackRgb565(uint16_t v)
+{
+    unsigned r = v >> 11, g = v >> 5 & 63, b = v & 31;
+    return glm::vec4(r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2, 255);
+}
+
+static void encodeBC1(BlockPixels const &pixels, Quality quality, unsigned char *out)
+{
+    constexpr float WEIGHTS[4] = {0.f, 1.f, 1.f / 3.f, 2.f / 3.f};
+    glm::vec4 e0, e1;
+    fitEndpoints(pixels, 3, quality != Quality::fast, e0, e1);
+
+    float bestError = std::numeric_limits<float>::max();
+    uint16_t bestC0 = 0, bestC1 = 0;
+    uint32_t bestIndices = 0;
+    for(unsigned iteration = 0;; ++iteration)
+    {
+        // c0 > c1 selects the four color mode
+        uint16_t c0 = packRgb565(e0), c1 = packRgb565(e1);
+        if(c0 < c1)
+        {
+            std::swap(c0, c1);
+            std::swap(e0, e1);
+        }
+        glm::vec4 p0 = unpackRgb565(c0), p1 = unpackRgb565(c1);
+        glm::vec4 palette[4] = {p0, p1, (p0 * 2.f + p1) / 3.f, (p0 + p1 * 2.f) / 3.f};
+
+        float error = 0.f;
+        uint32_t indices = 0;
+        BlockValues weights;
+        for(unsigned i = 0; i < 16; ++i)
+        {
+            unsigned best = 0;
+            float bestDistance = distanceSquared(pixels[i], palette[0], 3);
+            for(unsigned k = 1; k < 4; ++k)
+                if(float d = distanceSquared(pixels[i], palette[k], 3); d < bestDistance)
+                {
+                    best = k;
+                    bestDistance = d;
+                }
+            error += bestDistance;
+            indices |= best << 2 * i;
+            weights[i] = WEIGHTS[best];
+        }
+        if(error < bestError)
+        {
+            bestError = error;
+            bestC0 = c0;
+            bestC1 = c1;
+            bestIndices = indices;
+        }
+        if(iteration == getRefinementIterations(quality) || !refineEndpoints(pixels, 3, weights, e0, e1))
+            break;
+    }
+
+    out[0] = bestC0 & 0xff;
+    out[1] = bestC0 >> 8;
+    out[2] = bestC1 & 0xff;
+    out[3] = bestC1 >> 8;
+    for(unsigned i = 0; i < 4; ++i)
+        out[4 + i] = bestIndices >> 8 * i & 0xff;
+}
+static void decodeBC1(unsigned char const *block, BlockPixels &out)
+{
+    uint16_t c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+    glm::vec4 p0 = unpackRgb565(c0), p1 = unpackRgb565(c1);
+    glm::vec4 palette[4] = {p0, p1};
+    if(c0 > c1)
+    {
+        palette[2] = (p0 * 2.f + p1) / 3.f;
+        palette[3] = (p0 + p1 * 2.f) / 3.f;
+    } else {
+        palette[2] = (p0 + p1) / 2.f;
+        palette[3] = glm::vec4(0.f);
+    }
+    uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | static_cast<uint32_t>(block[7]) << 24;
+    for(unsigned i = 0; i < 16; ++i)
+        out[i] = palette[indices >> 2 * i & 3];
+}
+
+static void encodeBC4(BlockValues const &values, unsigned char *out)
+{
+    auto [lo, hi] = std::minmax_element(values.begin(), values.end());
+    // a0 > a1 selects eight interpolated values, equal endpoints leave every index at 0
+    unsigned a0 = static_cast<unsigned>(*hi + 0.5f), a1 = static_cast<unsigned>(*lo + 0.5f);
+    float palette[8] = {float(a0), float(a1)};
+    for(unsigned k = 2; k < 8; ++k)
+        palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7.f;
+
+    uint64_t indices = 0;
+    for(unsigned i = 0; i < 16; ++i)
+    {
+        unsigned best = 0;
+        for(unsigned k = 1; k < 8; ++k)
+            if(std::abs(values[i] - palette[k]) < std::abs(values[i] - palette[best]))
+                best = k;
+        indices |= uint64_t(best) << 3 * i;
+    }
+    out[0] = a0;
+    out[1] = a1;
+    for(unsigned i = 0; i < 6; ++i)
+        out[2 + i] = indices >> 8 * i & 0xff;
+}
+static void decodeBC4(unsigned char const *block, BlockValues &out)
+{
+    unsigned a0 = block[0], a1 = block[1];
+    float palette[8] = {float(a0), float(a1)};
+    if(a0 > a1)
+        for(unsigned k = 2; k < 8; ++k)
+            palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+    else {
+        for(unsigned k = 2; k < 6; ++k)
+            palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+        palette[6] = 0.f;
+        palette[7] = 255.f;
+    }
+    uint64_t indices = 0;
+    for(unsigned i = 0; i < 6; ++i)
+        indices |= uint64_t(block[2 + i]) << 8 * i;
+    for(unsigned i = 0; i < 16; ++i)
+        out[i] = palette[indices >> 3 * i & 7];
+}
+
+static constexpr unsigned BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+/// @brief Quantize an endpoint to 7 bits per channel and a shared p-bit, the endpoint format of BC7 mode 6.
+static void quantizeBC7Endpoint(glm::vec4 const &e, unsigned (&q)[4], unsigned &pbit)
+{
+    float bestError = std::numeric_limits<float>::max();
+    for(unsigned p = 0; p < 2; ++p)
+    {
+        unsigned candidate[4];
+        float error = 0.f;
+        for(unsigned c = 0; c < 4; ++c)
+        {
+            candidate[c] = static_cast<unsigned>(std::clamp((e[c] - p) / 2.f + 0.5f, 0.f, 127.f));
+            float d = float(candidate[c] * 2 + p) - e[c];
+            error += d * d;
+        }
+        if(error < bestError)
+        {
+            bestError = error;
+            std::copy(std::begin(candidate), std::end(candidate), std::begin(q));
+            pbit = p;
+        }
+    }
+}
+
+/// @brief BC7 with mode 6 only: one RGBA line with 16 points per block.
+/// The other modes partition the block and need a search over the partition shapes, mode 6 alone is close for most color maps.
+static void encodeBC7(BlockPixels const &pixels, Quality quality, unsigned char *out)
+{
+    glm::vec4 e0, e1;
+    fitEndpoints(pixels, 4, quality != Quality::fast, e0, e1);
+
+    float bestError = std::numeric_limits<float>::max();
+    unsigned bestQ[2][4] = {}, bestP[2] = {}, bestIndices[16] = {};
+    for(unsigned iteration = 0;; ++iteration)
+    {
+        unsigned q[2][4], p[2];
+        quantizeBC7Endpoint(e0, q[0], p[0]);
+        quantizeBC7Endpoint(e1, q[1], p[1]);
+        glm::vec4 palette[16];
+        for(unsigned k = 0; k < 16; ++k)
+            for(unsigned c = 0; c < 4; ++c)
+            {
+                unsigned v0 = q[0][c] * 2 + p[0], v1 = q[1][c] * 2 + p[1];
+                palette[k][c] = float(((64 - BC7_WEIGHTS[k]) * v0 + BC7_WEIGHTS[k] * v1 + 32) >> 6);
+            }
+
+        float error = 0.f;
+        unsigned indices[16];
+        BlockValues weights;
+        for(unsigned i = 0; i < 16; ++i)
+        {
+            unsigned best = 0;
+            float bestDistance = distanceSquared(pixels[i], palette[0], 4);
+            for(unsigned k = 1; k < 16; ++k)
+                if(float d = distanceSquared(pixels[i], palette[k], 4); d < bestDistance)
+                {
+                    best = k;
+                    bestDistance = d;
+                }
+            error += bestDistance;
+            indices[i] = best;
+            weights[i] = BC7_WEIGHTS[best] / 64.f;
+        }
+        if(error < bestError)
+        {
+            bestError = error;
+            std::copy(&q[0][0], &q[0][0] + 8, &bestQ[0][0]);
+            std::copy(std::begin(p), std::end(p), std::begin(bestP));
+            std::copy(std::begin(indices), std::end(indices), std::begin(bestIndices));
+        }
+        if(iteration == getRefinementIterations(quality) || !refineEndpoints(pixels, 4, weights, e0, e1))
+            break;
+    }
+
+    // The most significant bit of the first index is implied 0, swap the endpoints to make it so
+    if(bestIndices[0] >= 8)
+    {
+        std::swap(bestQ[0], bestQ[1]);
+        std::swap(bestP[0], bestP[1]);
+        for(auto &index : bestIndices)
+            index = 15 - index;
+    }
+
+    std::fill(out, out + 16, 0);
+    BitWriter writer{out};
+    writer.write(1 << 6, 7);
+    for(unsigned c = 0; c < 4; ++c)
+    {
+        writer.write(bestQ[0][c], 7);
+        writer.write(bestQ[1][c], 7);
+    }
+    writer.write(bestP[0], 1);
+    writer.write(bestP[1], 1);
+    writer.write(bestIndices[0], 3);
+    for(unsigned i = 1; i < 16; ++i)
+        writer.write(bestIndices[i], 4);
+}
+/// @brief Decodes mode 6 only, the one encodeBC7 writes. Blocks in other modes decode to black.
+static void decodeBC7(unsigned char const *block, BlockPixels &out)
+{
+    BitReader reader{block};
+    if(reader.read(7) != 1 << 6)
+    {
+        out.fill(glm::vec4(0.f));
+        return;
+    }
+    unsigned q[2][4];
+    for(unsigned c = 0; c < 4; ++c)
+    {
+        q[0][c] = reader.read(7);
+        q[1][c] = reader.read(7);
+    }
+    unsigned p0 = reader.read(1), p1 = reader.read(1);
+    for(unsigned i = 0; i < 16; ++i)
+    {
+        unsigned index = reader.read(i == 0 ? 3 : 4);
+        for(unsigned c = 0; c < 4; ++c)
+        {
+            unsigned v0 = q[0][c] * 2 + p0, v1 = q[1][c] * 2 + p1;
+            out[i][c] = float(((64 - BC7_WEIGHTS[index]) * v0 + BC7_WEIGHTS[index] * v1 + 32) >> 6);
+        }
+    }
+}
+
+static void encodeBlock(TextureFormat format, BlockPixels const &pixels, Quality quality, unsigned char *out)
+{
+    switch(format)
+    {
+    case TextureFormat::bc1:
+        encodeBC1(pixels, quality, out);
+        break;
+    case TextureFormat::bc3:
+        encodeBC4(getChannel(pixels, 3), out);
+        encodeBC1(pixels, quality, out + 8);
+        break;
+    case TextureFormat::bc4:
+        encodeBC4(getChannel(pixels, 0), out);
+        break;
+    case TextureFormat::bc5:
+        encodeBC4(getChannel(pixels, 0), out);
+        encodeBC4(getChannel(pixels, 1), out + 8);
+        break;
+    case TextureFormat::bc7:
+        encodeBC7(pixels, quality, out);
+        break;
+    default:
+        break;
+    }
+}
+static void decodeBlock(TextureFormat format, unsigned char const *block, BlockPixels &out)
+{
+    BlockValues r, g;
+    out.fill(glm::vec4(0.f, 0.f, 0.f, 255.f));
+    switch(format)
+    {
+    case TextureFormat::bc1:
+        decodeBC1(block, out);
+        break;
+    case TextureFormat::bc3:
+        decodeBC1(block + 8, out);
+        decodeBC4(block, r);
+        for(unsigned i = 0; i < 16; ++i)
+            out[i].w = r[i];
+        break;
+    case TextureFormat::bc4:
+        decodeBC4(block, r);
+        for(unsigned i = 0; i < 16; ++i)
+            out[i].x = r[i];
+        break;
+    case TextureFormat::bc5:
+        decodeBC4(block, r);
+        decodeBC4(block + 8, g);
+        for(unsigned i = 0; i < 16; ++i)
+        {
+            out[i].x = r[i];
+            out[i].y = g[i];
+        }
+        break;
+    case TextureFormat::bc7:
+        decodeBC7(block, out);
+        break;
+    default:
+        break;
+    }
+}
+
+/// @brief The channels the format keeps, the rest don't count towards the PSNR.
+static unsigned getChannelCount(TextureFormat format)
+{
+    switch(format)
+    {
+    case TextureFormat::bc1: return 3;
+    case TextureFormat::bc4: return 1;
+    case TextureFormat::bc5: return 2;
+    default: return 4;
+    }
+}
+static char const *getFormatName(TextureFormat format)
+{
+    switch(format)
+    {
+    case TextureFormat::bc1: return "BC1";
+    case TextureFormat::bc3: return "BC3";
+    case TextureFormat::bc4: return "BC4";
+    case TextureFormat::bc5: return "BC5";
+    case TextureFormat::bc7: return "BC7";
+    default: return "uncompressed";
+    }
+}
+
+static TextureFormat pickFormat(Texture const &texture, TextureUsage usage, Quality quality)
+{
+    switch(usage)
+    {
+    case TextureUsage::normal:
+        return TextureFormat::bc5;
+    case TextureUsage::mask:
+        return TextureFormat::bc4;
+    default:
+        break;
+    }
+    if(quality != Quality::fast)
+        return TextureFormat::bc7;
+
+    auto const &bitmap = texture.bitmap;
+    if(bitmap.numComponents == 2 || bitmap.numComponents == 4)
+    {
+        auto base = texture.getLevel(0);
+        for(size_t i = bitmap.numComponents - 1; i < base.size(); i += bitmap.numComponents)
+            if(base[i] != 255)
+                return TextureFormat::bc3;
+    }
+    return TextureFormat::bc1;
+}
+
+bool compressTexture(Texture &texture, TextureUsage usage, TextureCompressionOptions const &options)
+{
+    auto const &bitmap = texture.bitmap;
+    unsigned n = bitmap.numComponents;
+    if(n == 0 || n > 4 || bitmap.size.x == 0 || bitmap.size.y == 0 || bitmap.pixels.size() < size_t(bitmap.size.x) * bitmap.size.y * n)
+    {
+        LOG_ERROR("can't compress texture \"{}\": invalid bitmap", texture.path);
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if(texture.levels.empty() && texture.numMipLevels > 1)
+        generateMipChain(texture);
+
+    TextureFormat format = pickFormat(texture, usage, options.quality);
+    unsigned blockSize = getBlockSize(format);
+
+    // Every row of blocks of every level is one task
+    struct BlockRow
+    {
+        unsigned level;
+        unsigned y;
+        size_t offset; // into blocks
+    };
+    std::vector<BlockRow> rows;
+    size_t total = 0;
+    for(unsigned level = 0; level < texture.getLevelCount(); ++level)
+    {
+        glm::uvec2 numBlocks = (texture.getLevelSize(level) + 3u) / 4u;
+        for(unsigned y = 0; y < numBlocks.y; ++y, total += size_t(numBlocks.x) * blockSize)
+            rows.push_back({level, y, total});
+    }
+
+    PixelBuffer<unsigned char> blocks(total);
+    ThreadPool::global().parallelFor(rows.size(), [&](size_t i){
+        auto const &row = rows[i];
+        glm::uvec2 size = texture.getLevelSize(row.level);
+        unsigned char const *pixels = texture.getLevel(row.level).data();
+        BlockPixels block;
+        for(unsigned x = 0; x < (size.x + 3) / 4; ++x)
+        {
+            fetchBlock(pixels, size, n, {x, row.y}, block);
+            encodeBlock(format, block, options.quality, blocks.data() + row.offset + size_t(x) * blockSize);
+        }
+    });
+    texture.format = format;
+    texture.blocks = std::move(blocks);
+
+    if(options.reportPsnr)
+    {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("Compressed \"{}\" ({}x{}, {} levels) to {} in {:.1f} ms: {} KiB, PSNR {:.2f} dB over all levels",
+            texture.path, bitmap.size.x, bitmap.size.y, texture.getLevelCount(), getFormatName(format), ms, texture.blocks.size() / 1024, computePsnr(texture));
+    }
+    // The level offsets go stale with the pixels, their sizes are still what the blocks are read by
+    if(!options.keepBitmap)
+        texture.bitmap.pixels = {};
+    return true;
+}
+
+double computePsnr(Texture const &texture)
+{
+    if(texture.format == TextureFormat::uncompressed)
+        return std::numeric_limits<double>::infinity();
+
+    if(texture.bitmap.pixels.empty())
+        return std::numeric_limits<double>::quiet_NaN();
+
+    unsigned channels = getChannelCount(texture.format), blockSize = getBlockSize(texture.format);
+    double sum = 0.0;
+    size_t numTexels = 0;
+    BlockPixels source, decoded;
+    for(unsigned level = 0; level < texture.getLevelCount(); ++level)
+    {
+        glm::uvec2 size = texture.getLevelSize(level);
+        auto blocks = texture.getCompressedLevel(level);
+        auto pixels = texture.getLevel(level);
+        size_t blocksPerRow = (size.x + 3) / 4;
+        for(unsigned by = 0; by < (size.y + 3) / 4; ++by)
+            for(unsigned bx = 0; bx < blocksPerRow; ++bx)
+            {
+                fetchBlock(pixels.data(), size, texture.bitmap.numComponents, {bx, by}, source);
+                decodeBlock(texture.format, blocks.data() + (by * blocksPerRow + bx) * blockSize, decoded);
+                for(unsigned i = 0; i < 16; ++i)
+                    if(bx * 4 + i % 4 < size.x && by * 4 + i / 4 < size.y)
+                        for(unsigned c = 0; c < channels; ++c)
+                            sum += (source[i][c] - decoded[i][c]) * (source[i][c] - decoded[i][c]);
+            }
+        numTexels += size_t(size.x) * size.y;
+    }
+    double mse = sum / (double(numTexels) * channels);
+    return mse == 0.0 ? std::numeric_limits<double>::infinity() : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+void decompressTexture(Texture &texture)
+{
+    if(texture.format == TextureFormat::uncompressed)
+        return;
+    unsigned blockSize = getBlockSize(texture.format);
+    std::vector<Texture::Level> levels;
+    size_t total = 0;
+    for(unsigned level = 0; level < texture.getLevelCount(); ++level)
+    {
+        glm::uvec2 size = texture.getLevelSize(level);
+        levels.push_back({total, size});
+        total += size_t(size.x) * size.y * 4;
+    }
+
+    PixelBuffer<unsigned char> pixels(total);
+    ThreadPool::global().parallelFor(levels.size(), [&](size_t level){
+        glm::uvec2 size = levels[level].size;
+        unsigned char const *blocks = texture.getCompressedLevel(static_cast<unsigned>(level)).data();
+        unsigned char *out = pixels.data() + levels[level].offset;
+        size_t blocksPerRow = (size.x + 3) / 4;
+        BlockPixels decoded;
+        for(unsigned by = 0; by < (size.y + 3) / 4; ++by)
+            for(unsigned bx = 0; bx < blocksPerRow; ++bx)
+            {
+                decodeBlock(texture.format, blocks + (by * blocksPerRow + bx) * blockSize, decoded);
+                for(unsigned i = 0; i < 16; ++i)
+                {
+                    unsigned x = bx * 4 + i % 4, y = by * 4 + i / 4;
+                    if(x < size.x && y < size.y)
+                        for(unsigned c = 0; c < 4; ++c)
+                            out[(size_t(y) * size.x + x) * 4 + c] = static_cast<unsigned char>(std::clamp(std::lround(decoded[i][c]), 0l, 255l));
+                }
+            }
+    });
+    texture.bitmap.pixels = std::move(pixels);
+    texture.bitmap.numComponents = 4;
+    if(!texture.levels.empty())
+        texture.levels = std::move(levels);
+    texture.format = TextureFormat::uncompressed;
+    texture.blocks = {};
+}
+
+bool convertTextureToRGBA(Texture &texture)
+{
+    auto &bitmap = texture.bitmap;
+    unsigned n = bitmap.numComponents;
+    if(n == 4 || texture.format != TextureFormat::uncompressed)
+        return true;
+    size_t total = 0;
+    for(unsigned level = 0; level < texture.getLevelCount(); ++level)
+    {
+        glm::uvec2 size = texture.getLevelSize(level);
+        auto pixels = texture.getLevel(level);
+        if(n == 0 || n > 4 || pixels.data() < bitmap.pixels.data() || pixels.data() + pixels.size() > bitmap.pixels.end())
+        {
+            LOG_ERROR("can't convert texture \"{}\" to RGBA: invalid bitmap", texture.path);
+            return false;
+        }
+        total += size_t(size.x) * size.y * 4;
+    }
+
+    PixelBuffer<unsigned char> rgba(total);
+    size_t offset = 0;
+    for(unsigned level = 0; level < texture.getLevelCount(); ++level)
+    {
+        glm::uvec2 size = texture.getLevelSize(level);
+        expandToRGBA(texture.getLevel(level).data(), n, rgba.data() + offset, size_t(size.x) * size.y);
+        if(!texture.levels.empty())
+            texture.levels[level].offset = offset;
+        offset += size_t(size.x) * size.y * 4;
+    }
+    bitmap.pixels = std::move(rgba);
+    bitmap.numComponents = 4;
+    return true;
+}
+
+void processLoadedTexture(Texture &texture, TextureLoaderOptions const &options)
+{
+    texture.srgb = options.srgb;
+    if(!convertTextureToRGBA(texture))
+        return;
+    if(options.premultiplyAlpha)
+        premultiplyAlpha(texture.bitmap.pixels.data(), texture.srgb, size_t(texture.bitmap.size.x) * texture.bitmap.size.y);
+    if(options.generateMips)
+        generateMipChain(texture);
+    if(options.compression.enabled)
+        compressTexture(texture, options.usage, options.compression);
+}
+
+/// @brief Channel @p channel of a texel, reading grey and grey-alpha bitmaps as if they were expanded to RGBA.
+static unsigned char readChannel(unsigned char const *texel, unsigned n, unsigned channel)
+{
+    if(channel == 3)
+        return n == 2 || n == 4 ? texel[n - 1] : 255;
+    return n <= 2 ? texel[0] : texel[channel];
+}
+
+std::optional<Texture> packOrmTexture(OrmSource occlusion, OrmSource roughness, OrmSource metallic)
+{
+    std::array<OrmSource, 3> sources{occlusion, roughness, metallic};
+    glm::uvec2 size{1, 1};
+    for(auto const &source : sources)
+    {
+        auto const &bitmap = source.texture.bitmap;
+        unsigned n = bitmap.numComponents;
+        if(n == 0 || n > 4 || source.channel > 3 || bitmap.size.x == 0 || bitmap.size.y == 0 || bitmap.pixels.size() < size_t(bitmap.size.x) * bitmap.size.y * n)
+        {
+            LOG_ERROR("can't pack \"{}\" into an ORM texture: no bitmap to read", source.texture.path);
+            return std::nullopt;
+        }
+        size = glm::max(size, bitmap.size);
+    }
+
+    Texture orm;
+    orm.srgb = false;
+    orm.path = "orm(" + occlusion.texture.path + ", " + roughness.texture.path + ", " + metallic.texture.path + ")";
+    orm.bitmap = Bitmap<unsigned char>{
+        .pixels = PixelBuffer<unsigned char>(size_t(size.x) * size.y * 4),
+        .numComponents = 4,
+        .size = size
+    };
+    orm.numMipLevels = getMipLevelCount(size);
+    // Smaller sources are stretched over the largest one, nearest texel
+    ThreadPool::global().parallelFor(size.y, [&](size_t y){
+        unsigned char *dst = orm.bitmap.pixels.data() + y * size.x * 4;
+        for(unsigned x = 0; x < size.x; ++x, dst += 4)
+        {
+            for(unsigned c = 0; c < 3; ++c)
+            {
+                auto const &bitmap = sources[c].texture.bitmap;
+                size_t sx = size_t(x) * bitmap.size.x / size.x, sy = y * bitmap.size.y / size.y;
+                dst[c] = readChannel(&bitmap.pixels[(sy * bitmap.size.x + sx) * bitmap.numComponents], bitmap.numComponents, sources[c].channel);
+            }
+            dst[3] = 255;
+        }
+    });
+    return orm;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "Loaders.hpp"
+#include "Model.hpp"
+#include <optional>
+#include <span>
+
+/// @brief Build the full mip chain of @p texture on the CPU.
+/// The levels are appended to bitmap.pixels and described by Texture::levels, level 0 is the bitmap itself.
+/// With Texture::srgb set, the color channels are filtered in linear space. Rows are filtered on the worker pool.
+void generateMipChain(Texture &texture);
+
+/// @brief generateMipChain for many textures at once, spread across the worker pool.
+void generateMipChains(std::span<Texture *const> textures);
+
+/// @brief Encode every level of @p texture into Texture::blocks, in the format @p usage and the quality pick.
+/// Textures whose mips would be made on the GPU get them on the CPU first, compressed images can't be blitted.
+/// Blocks are encoded on the worker pool. The bitmap is freed afterwards unless options.keepBitmap is set.
+/// @return false if the bitmap can't be encoded, the texture is left uncompressed.
+bool compressTexture(Texture &texture, TextureUsage usage, TextureCompressionOptions const &options);
+
+/// @brief Peak signal-to-noise ratio of the decoded levels against the bitmap, in dB. Infinite for lossless textures.
+/// Every texel of every level weighs the same. NaN once the bitmap is freed.
+double computePsnr(Texture const &texture);
+
+/// @brief Decode the blocks of every level of @p texture back into an RGBA8 bitmap and drop them, for devices that
+/// can't sample the format. Channels the format doesn't store read as the GPU would sample them, 0 and alpha 255.
+/// Levels are decoded on the worker pool.
+void decompressTexture(Texture &texture);
+
+/// @brief How many of the largest levels of a @p size texture to leave out so the rest fits @p maxDimension (in both
+/// dimensions) and @p maxBytes (of the base level as RGBA8). 0 is no limit, a 1x1 texture always fits.
+unsigned getSkippedLevels(glm::uvec2 size, unsigned maxDimension, size_t maxBytes);
+
+/// @brief Leave out the @p numLevels largest levels of @p texture, adding them to Texture::skippedLevels.
+/// CPU mips become the new base levels, without them the bitmap is halved that many times with a Lanczos3 filter
+/// (in linear space for sRGB), which keeps more detail than the box filter of the mips. Rows are filtered on the worker pool.
+void downscaleTexture(Texture &texture, unsigned numLevels);
+
+/// @brief Expand the bitmap of @p texture, every level of it, to RGBA8: the layout GPUs sample and the kernels are fastest with.
+/// Block compressed textures are left alone.
+/// @return false if the bitmap doesn't hold what its levels say.
+bool convertTextureToRGBA(Texture &texture);
+
+/// @brief Apply the steps of @p options that follow decoding to a freshly loaded texture: RGBA layout, color space, alpha, mips and compression.
+void processLoadedTexture(Texture &texture, TextureLoaderOptions const &options);
+
+/// @brief A channel of a texture to pack, see packOrmTexture.
+struct OrmSource
+{
+    Texture const &texture;
+    unsigned channel; // 0 for single channel maps, 1 (roughness) or 2 (metallic) of glTF's combined metallicRoughness
+};
+/// @brief Pack occlusion, roughness and metallic into the R, G and B channels of one linear RGBA texture, glTF's ORM layout.
+/// The texture is as large as the largest source, it is only laid out: mips and compression are left to processLoadedTexture.
+/// @return std::nullopt if a source has no bitmap to read (cooked block compressed textures).
+std::optional<Texture> packOrmTexture(OrmSource occlusion, OrmSource roughness, OrmSource metallic);
@@ -0,0 +1,122 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/// @brief A fixed set of worker threads running queued tasks.
+class ThreadPool
+{
+private:
+    std::vector<std::thread> mWorkers;
+    std::queue<std::function<void()>> mTasks;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStopping = false;
+
+    void enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard lock(mMutex);
+            mTasks.emplace(std::move(task));
+        }
+        mCondition.notify_one();
+    }
+    void work()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mMutex);
+                mCondition.wait(lock, [this]{ return mStopping || !mTasks.empty(); });
+                if(mStopping && mTasks.empty())
+                    return;
+                task = std::move(mTasks.front());
+                mTasks.pop();
+            }
+            task();
+        }
+    }
+public:
+    explicit ThreadPool(unsigned numThreads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for(unsigned i = 0; i < numThreads; ++i)
+            mWorkers.emplace_back([this]{ work(); });
+    }
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(mMutex);
+            mStopping = true;
+        }
+        mCondition.notify_all();
+        for(auto &worker : mWorkers)
+            worker.join();
+    }
+
+    /// @brief The pool shared by the loaders.
+    static ThreadPool &global()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    inline unsigned size() const { return static_cast<unsigned>(mWorkers.size()); }
+
+    /// @brief Run @p f on a worker.
+    template<typename F>
+    auto submit(F &&f) -> std::future<std::invoke_result_t<F>>
+    {
+        auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(f));
+        auto future = task->get_future();
+        enqueue([task]{ (*task)(); });
+        return future;
+    }
+
+    /// @brief Call @p f(i) for every i in [0, count) and wait for all of them.
+    /// The calling thread takes part, so this may be nested inside a task.
+    template<typename F>
+    void parallelFor(size_t count, F &&f)
+    {
+        if(count == 0)
+            return;
+
+        struct State
+        {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<State>();
+        // Helpers that start after everything is done only touch the shared state, never f.
+        auto run = [state, count, &f]{
+            for(size_t i; (i = state->next.fetch_add(1)) < count;)
+            {
+                f(i);
+                if(state->done.fetch_add(1) + 1 == count)
+                {
+                    std::lock_guard lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            }
+        };
+
+        size_t numHelpers = std::min<size_t>(count - 1, mWorkers.size());
+        for(size_t i = 0; i < numHelpers; ++i)
+            enqueue(run);
+        run();
+
+        std::unique_lock lock(state->mutex);
+        state->finished.wait(lock, [&]{ return state->done.load() == count; });
+    }
+};
@@ -0,0 +1,134 @@
+#include "VertexFormat.hpp"
+#include "meshoptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+glm::vec2 encodeOctahedral(glm::vec3 n)
+{
+    n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    glm::vec2 e{n.x, n.y};
+    if(n.z < 0.0f)
+    {
+        // fold the lower hemisphere over the diagonals
+        e = {
+            (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f)
+        };
+    }
+    return e;
+}
+glm::vec3 decodeOctahedral(glm::vec2 e)
+{
+    glm::vec3 n{e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y)};
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+static void packDirection(glm::vec3 const &v, int16_t out[2])
+{
+    glm::vec2 e = encodeOctahedral(glm::length(v) > 0.0f ? v : glm::vec3{0.0f, 0.0f, 1.0f});
+    out[0] = static_cast<int16_t>(meshopt_quantizeSnorm(e.x, 16));
+    out[1] = static_cast<int16_t>(meshopt_quantizeSnorm(e.y, 16));
+}
+
+PackedGeometry packVertices(Mesh::Geometry const &geometry)
+{
+    PackedGeometry packed;
+    if(geometry.positions.empty())
+        return packed;
+
+    glm::vec3 min = geometry.positions[0], max = geometry.positions[0];
+    for(auto const &position : geometry.positions)
+    {
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+    packed.positionOffset = min;
+    packed.positionScale = max - min;
+    // flat meshes still need a nonzero scale to divide by
+    glm::vec3 inverseScale = {
+        packed.positionScale.x > 0.0f ? 1.0f / packed.positionScale.x : 0.0f,
+        packed.positionScale.y > 0.0f ? 1.0f / packed.positionScale.y : 0.0f,
+        packed.positionScale.z > 0.0f ? 1.0f / packed.positionScale.z : 0.0f,
+    };
+
+    packed.vertices.resize(geometry.positions.size());
+    for(size_t i = 0; i < packed.vertices.size(); ++i)
+    {
+        auto &vertex = packed.vertices[i];
+        glm::vec3 position = (geometry.positions[i] - min) * inverseScale;
+        vertex.position[0] = static_cast<uint16_t>(meshopt_quantizeUnorm(position.x, 16));
+        vertex.position[1] = static_cast<uint16_t>(meshopt_quantizeUnorm(position.y, 16));
+        vertex.position[2] = static_cast<uint16_t>(meshopt_quantizeUnorm(position.z, 16));
+        vertex.position[3] = 0;
+        packDirection(i < geometry.normals.size() ? geometry.normals[i] : glm::vec3{0.0f, 0.0f, 1.0f}, vertex.normal);
+        glm::vec2 texCoord = i < geometry.texCoords.size() ? geometry.texCoords[i] : glm::vec2{0.0f};
+        vertex.texCoord[0] = meshopt_quantizeHalf(texCoord.x);
+        vertex.texCoord[1] = meshopt_quantizeHalf(texCoord.y);
+    }
+    return packed;
+}
+
+glm::u8vec4 quantizeBoneWeights(glm::vec4 weights)
+{
+    weights = glm::max(weights, glm::vec4(0.0f));
+    float total = weights.x + weights.y + weights.z + weights.w;
+    if(!(total > 0.0f))
+        return glm::u8vec4(0);
+
+    glm::u8vec4 result;
+    glm::vec4 remainders;
+    unsigned sum = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+        float scaled = weights[i] / total * 255.0f;
+        result[i] = static_cast<uint8_t>(std::min(std::floor(scaled), 255.0f));
+        remainders[i] = scaled - result[i];
+        sum += result[i];
+    }
+    // Each weight lost less than a unit, so every weight gets at most one back
+    for(; sum < 255; ++sum)
+    {
+        int largest = 0;
+        for(int i = 1; i < 4; ++i)
+            if(remainders[i] > remainders[largest])
+                largest = i;
+        ++result[largest];
+        remainders[largest] = -1.0f;
+    }
+    return result;
+}
+
+unsigned getBoneIndexSize(Mesh::Geometry const &geometry)
+{
+    if(geometry.boneIDs.empty())
+        return 0;
+    uint16_t maxIndex = 0;
+    for(auto const &ids : geometry.boneIDs)
+        maxIndex = std::max({maxIndex, ids.x, ids.y, ids.z, ids.w});
+    return maxIndex <= UINT8_MAX ? sizeof(uint8_t) : sizeof(uint16_t);
+}
+
+std::vector<uint32_t> packBoneInfluences(Mesh::Geometry const &geometry)
+{
+    std::vector<uint32_t> words;
+    if(geometry.boneIndexSize == 0)
+        return words;
+    words.reserve(geometry.boneIDs.size() * (geometry.boneIndexSize + 1));
+    for(size_t i = 0; i < geometry.boneIDs.size(); ++i)
+    {
+        glm::u16vec4 ids = geometry.boneIDs[i];
+        glm::u8vec4 weights = geometry.weights[i];
+        if(geometry.boneIndexSize == sizeof(uint8_t))
+        {
+            words.push_back(uint32_t(ids.x) | uint32_t(ids.y) << 8 | uint32_t(ids.z) << 16 | uint32_t(ids.w) << 24);
+        } else {
+            words.push_back(uint32_t(ids.x) | uint32_t(ids.y) << 16);
+            words.push_back(uint32_t(ids.z) | uint32_t(ids.w) << 16);
+        }
+        words.push_back(uint32_t(weights.x) | uint32_t(weights.y) << 8 | uint32_t(weights.z) << 16 | uint32_t(weights.w) << 24);
+    }
+    return words;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "Model.hpp"
+#include <cstdint>
+
+/// @brief A vertex as the GPU reads it with the packed layout, 16 bytes instead of the 44 of VertexLayout::Separate.
+/// No shader reads tangents yet, they are left out until one does.
+struct PackedVertex
+{
+    uint16_t position[4]; // unorm16 within the mesh bounds, w is padding
+    int16_t normal[2];    // octahedral snorm16
+    uint16_t texCoord[2]; // half float
+};
+static_assert(sizeof(PackedVertex) == 16);
+
+/// @brief Interleaved, quantized vertices of a mesh.
+/// A packed position decodes to positionOffset + position * positionScale.
+struct PackedGeometry
+{
+    std::vector<PackedVertex> vertices;
+    glm::vec3 positionOffset{0};
+    glm::vec3 positionScale{1};
+};
+
+PackedGeometry packVertices(Mesh::Geometry const &geometry);
+
+// Matches SkinVertex and SkinnedVertex in skinning.slang. Like PackedVertex they have no tangents until a shader reads them.
+struct SkinVertex
+{
+    glm::vec4 position;
+    glm::vec4 normal;
+};
+struct SkinnedVertex
+{
+    glm::vec4 position;
+    glm::vec4 normal;
+};
+
+/// @brief Bone weights as unorm8 summing to exactly 255, or all 0 if every weight is.
+/// The weights are normalized first, the units lost to rounding down go to the weights that lost the most.
+glm::u8vec4 quantizeBoneWeights(glm::vec4 weights);
+/// @brief The bytes per bone index that hold every index of @p geometry, 1 or 2. 0 without bones.
+unsigned getBoneIndexSize(Mesh::Geometry const &geometry);
+/// @brief The bone influences of a mesh as the skinning pass reads them: per vertex the indices, then the weights in one word.
+/// The indices take one word with geometry.boneIndexSize 1 (uint8) and two with 2 (uint16), so a vertex is 8 or 12 bytes.
+std::vector<uint32_t> packBoneInfluences(Mesh::Geometry const &geometry);
+
+/// @brief Octahedral encoding of a unit vector, both components in [-1, 1].
+glm::vec2 encodeOctahedral(glm::vec3 n);
+glm::vec3 decodeOctahedral(glm::vec2 e);
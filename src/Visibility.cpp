@@ -0,0 +1,73 @@
+#include "Visibility.hpp"
+#include <glm/gtc/matrix_inverse.hpp>
+#include <algorithm>
+
+static float getMaxScale(glm::mat4 const &mat)
+{
+    return std::max({glm::length(glm::vec3(mat[0])), glm::length(glm::vec3(mat[1])), glm::length(glm::vec3(mat[2]))});
+}
+
+unsigned selectLod(Mesh::Geometry const &geometry, glm::mat4 const &modelMat, Controller::Camera const &camera, float viewportHeight, float maxPixelError)
+{
+    if(geometry.lods.size() <= 1)
+        return 0;
+
+    float scale = getMaxScale(modelMat);
+    glm::vec3 center = modelMat * glm::vec4(geometry.bounds.center, 1.0f);
+    // The closest point of the bounding sphere, so the error is never underestimated.
+    float distance = std::max(glm::distance(center, camera.position) - geometry.bounds.radius * scale, camera.znear);
+    // projMat[1][1] is 1 / tan(fov / 2): a unit at distance 1 spans that many half viewports.
+    float pixelsPerUnit = camera.projMat[1][1] * 0.5f * viewportHeight / distance;
+
+    unsigned lod = 0;
+    for(unsigned i = 1; i < geometry.lods.size(); ++i)
+    {
+        if(geometry.lods[i].error * scale * pixelsPerUnit > maxPixelError)
+            break;
+        lod = i;
+    }
+    return lod;
+}
+
+Frustum makeFrustum(Controller::Camera const &camera)
+{
+    // Planes of the clip space box in world space (Gribb & Hartmann).
+    glm::mat4 m = glm::transpose(camera.projMat * camera.viewMat);
+    Frustum frustum{
+        .planes = {m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2]},
+        .position = camera.position
+    };
+    for(auto &plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+unsigned cullMeshlets(Mesh::Geometry const &geometry, glm::mat4 const &modelMat, Frustum const &frustum, bool coneCulling, std::vector<unsigned> &visible)
+{
+    float scale = getMaxScale(modelMat);
+    // The cone axis is a normal direction, under non-uniform scale it transforms like one
+    glm::mat3 normalMat = glm::inverseTranspose(glm::mat3(modelMat));
+    unsigned indexCount = 0;
+    for(unsigned i = 0; i < geometry.meshlets.size(); ++i)
+    {
+        auto const &meshlet = geometry.meshlets[i];
+
+        glm::vec3 center = modelMat * glm::vec4(meshlet.center, 1.0f);
+        float radius = meshlet.radius * scale;
+        if(std::any_of(frustum.planes.begin(), frustum.planes.end(), [&](glm::vec4 const &plane){ return glm::dot(glm::vec3(plane), center) + plane.w < -radius; }))
+            continue;
+
+        // The cone is degenerate (cutoff 1) when the triangles face too many directions.
+        if(coneCulling && meshlet.coneCutoff < 1.0f)
+        {
+            glm::vec3 apex = modelMat * glm::vec4(meshlet.coneApex, 1.0f);
+            glm::vec3 axis = glm::normalize(normalMat * meshlet.coneAxis);
+            if(glm::dot(glm::normalize(apex - frustum.position), axis) >= meshlet.coneCutoff)
+                continue;
+        }
+
+        visible.push_back(i);
+        indexCount += meshlet.triangleCount * 3;
+    }
+    return indexCount;
+}
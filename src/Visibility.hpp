@@ -0,0 +1,26 @@
+#pragma once
+#include "Model.hpp"
+#include "Controller.hpp"
+#include <array>
+#include <vector>
+
+/// @brief Pick the coarsest level of detail whose error is at most @p maxPixelError pixels on screen.
+/// @param modelMat The transform of the instance.
+/// @param viewportHeight The height of the viewport in pixels.
+/// @return An index into @p geometry.lods.
+unsigned selectLod(Mesh::Geometry const &geometry, glm::mat4 const &modelMat, Controller::Camera const &camera, float viewportHeight, float maxPixelError = 1.0f);
+
+/// @brief The view frustum and the camera position in world space, built once per frame.
+struct Frustum
+{
+    std::array<glm::vec4, 6> planes; // xyz is the inward normal, w the distance
+    glm::vec3 position;
+};
+Frustum makeFrustum(Controller::Camera const &camera);
+
+/// @brief Append the meshlets of @p geometry that may be visible to @p visible.
+/// Meshlets outside the frustum are dropped, and so are meshlets facing away from the camera if @p coneCulling is set.
+/// Don't set @p coneCulling when back faces are drawn.
+/// @param modelMat The transform of the instance.
+/// @return The number of indices of the visible meshlets.
+unsigned cullMeshlets(Mesh::Geometry const &geometry, glm::mat4 const &modelMat, Frustum const &frustum, bool coneCulling, std::vector<unsigned> &visible);
@@ -22,6 +22,13 @@
 #include "Loaders.hpp"
 #include "IO.hpp"
 #include "Controller.hpp"
+#include "Visibility.hpp"
+#include "VertexFormat.hpp"
+#include "TextureAtlas.hpp"
+#include "PixelFormat.hpp"
+#include "TextureProcessing.hpp"
+#include "AnimationSampler.hpp"
+#include "Skinning.hpp"
 
 template <typename T>
 using SparseSet = ecs::sparse_set<T>;
@@ -74,25 +81,51 @@ struct BufferAllocation
 struct VulkanMesh
 {
     ecs::entity eModel = 0;
-    size_t meshIndex;
+    // Ambient, roughness and metallic are only uploaded packed, see Material::Textures::orm
     struct Textures
     {
         ImageAllocation albedo;
-        ImageAllocation metallic;
-        ImageAllocation roughness;
-        ImageAllocation ambient;
+        ImageAllocation orm;
         ImageAllocation normal;
         ImageAllocation displacement;
     } textures;
+    // Where each texture is sampled in its image, xy offset and zw scale, see AtlasRegion
+    struct UVTransforms
+    {
+        glm::vec4 albedo{0, 0, 1, 1};
+        glm::vec4 orm{0, 0, 1, 1};
+        glm::vec4 normal{0, 0, 1, 1};
+        glm::vec4 displacement{0, 0, 1, 1};
+    } uvTransforms;
     struct Buffers
     {
+        // VertexLayout::Separate
         BufferAllocation pos;
         BufferAllocation uv;
         BufferAllocation norm;
         BufferAllocation tan;
+        // VertexLayout::Packed
+        BufferAllocation vertices;
         BufferAllocation idx;
-    } buffers;
-    size_t indexCount;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+        // Parts with bone weights only, see skinning.slang
+        BufferAllocation skinSource;
+        BufferAllocation boneInfluences; // see packBoneInfluences
+        std::vector<BufferAllocation> skinned; // per instance, written by the skinning pre-pass and drawn instead of the vertices
+    };
+    // one per mesh of the model, all drawn with the same textures
+    struct Part
+    {
+        size_t meshIndex;
+        Buffers buffers;
+        uint32_t boneIndexSize = 0;
+        // dequantization of packed positions
+        glm::vec3 positionOffset{0};
+        glm::vec3 positionScale{1};
+        size_t indexCount;
+        uint32_t vertexCount;
+    };
+    std::vector<Part> parts;
 };
 struct TextureData
 {
@@ -100,6 +133,41 @@ struct TextureData
     VkSampler sampler;
     VkImageLayout layout; 
 };
+struct StagingBuffer
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    char *mapped = nullptr;
+    VkDeviceSize used = 0;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    uint64_t timelineValue = 0; // reusable once the upload timeline reaches this
+    std::vector<BufferAllocation> oversized; // one-off buffers for uploads larger than the ring
+};
+/// @brief Uploads into device-local resources on the transfer queue.
+/// Data goes through a ring of persistently mapped staging buffers and the copies are batched into one submission per ring slot.
+/// Completion is tracked with a timeline semaphore, the graphics queue waits on it and acquires ownership of the resources.
+struct UploadManager
+{
+    static constexpr VkDeviceSize STAGING_SIZE = 32ull << 20;
+    static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+    std::array<StagingBuffer, 3> ring;
+    uint32_t current = 0;
+    bool recording = false;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
+    VkSemaphore timeline = VK_NULL_HANDLE;
+    uint64_t submittedValue = 0; // signalled by the last submission
+
+    // Ownership transfers, released on the transfer queue and acquired on the graphics queue.
+    // The acquire barriers of the current batch are moved to the pending lists on submission.
+    std::vector<VkBufferMemoryBarrier2> bufferAcquires;
+    std::vector<VkImageMemoryBarrier2> imageAcquires;
+    std::vector<VkBufferMemoryBarrier2> pendingBufferAcquires;
+    std::vector<VkImageMemoryBarrier2> pendingImageAcquires;
+    // Transfer queues can't blit, mip chains are generated on the graphics queue after the acquire.
+    std::vector<ImageAllocation> mipmaps;
+};
 struct VulkanState
 {
     QueueFamilies queueFamilies;
@@ -110,9 +178,13 @@ struct VulkanState
     VkSurfaceKHR surface;
     VkRenderPass renderPass;
     VkPipeline pipeline;
+    VkPipeline skinnedPipeline; // draws the vertices of the skinning pre-pass
+    VkPipeline skinningPipeline;
+    VkPipelineLayout skinningPipelineLayout;
     VkCommandPool commandPool;
 
     std::vector<VkDescriptorImageInfo> textureDescriptorInfos;
+    std::unordered_map<ecs::entity, ImageAllocation> textures; // by texture entity, shared textures and atlas pages are uploaded once
     VkDescriptorPool descriptorPoolTex;
     VkDescriptorSet descriptorSetTex;
     VkDescriptorSetLayout descriptorSetLayoutTex;
@@ -129,6 +201,7 @@ struct VulkanState
     } swapchain;
 
     ImageAllocation depthImage;
+    UploadManager upload;
 };
 
 static ecs::registry sReg;
@@ -137,7 +210,16 @@ static ecs::registry sReg;
 #define CHK(x) { VkResult _result = x; if(_result != VK_SUCCESS) { LOG_ERROR("{}:{}: Failed to {}: {}.", __FILE__, __LINE__, #x, string_VkResult(_result)); LOG_WARN("Aborting..."); abort(); }}
 
 constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+constexpr uint32_t NUM_INSTANCES = 3; // see ShaderUniformData::model
+constexpr uint32_t SKINNING_GROUP_SIZE = 64; // numthreads of skinning.slang
 constexpr bool ENABLE_VALIDATION_LAYERS = true;
+enum class VertexLayout
+{
+    Separate, // one full float buffer per attribute
+    Packed,   // one buffer of interleaved PackedVertex
+};
+constexpr VertexLayout VERTEX_LAYOUT = VertexLayout::Packed;
+constexpr VkCullModeFlags CULL_MODE = VK_CULL_MODE_NONE; // meshlet cone culling is only enabled with back face culling
 constexpr std::array<char const *, 0> sInstanceExtensions = {
 };
 constexpr std::array<char const *, 1> sDeviceExtensions = {
@@ -179,12 +261,12 @@ static bool init()
 static void insertImageMemoryBarrier(
     VkCommandBuffer         command_buffer,
     VkImage                 image,
-    VkAccessFlags           src_access_mask,
-    VkAccessFlags           dst_access_mask,
+    VkAccessFlags2          src_access_mask,
+    VkAccessFlags2          dst_access_mask,
     VkImageLayout           old_layout,
     VkImageLayout           new_layout,
-    VkPipelineStageFlags    src_stage_mask,
-    VkPipelineStageFlags    dst_stage_mask,
+    VkPipelineStageFlags2   src_stage_mask,
+    VkPipelineStageFlags2   dst_stage_mask,
     VkImageSubresourceRange subresource_range)
 {
     VkImageMemoryBarrier2 barrier{
@@ -209,7 +291,8 @@ static void insertImageMemoryBarrier(
 }
 static VkDeviceQueueCreateInfo makeDeviceQueueCreateInfo(uint32_t index)
 {
-    float priorities = 1.0f;
+    // must outlive vkCreateDevice
+    static constexpr float priorities = 1.0f;
     return VkDeviceQueueCreateInfo{
         .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
         .queueFamilyIndex = index,
@@ -232,29 +315,33 @@ static QueueFamilies findQueueFamilies(VkPhysicalDevice const &device, VulkanSta
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
+    // A transfer family without graphics and compute maps to the copy engines, which run alongside rendering.
+    auto getTransferScore = [](VkQueueFlags flags) {
+        if(!(flags & VK_QUEUE_TRANSFER_BIT)) return -1;
+        return (flags & VK_QUEUE_GRAPHICS_BIT ? 0 : 1) + (flags & VK_QUEUE_COMPUTE_BIT ? 0 : 1);
+    };
     for(uint32_t i = 0; i < queueFamilies.size(); ++i)
     {
         auto const &family = queueFamilies[i];
-        if(family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-        {
+        if(!indices.graphics.has_value() && family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
             indices.graphics = i;
-            addToFamilies(indices, i);
-        }
-        if(family.queueFlags & VK_QUEUE_TRANSFER_BIT)
-        {
+        if(getTransferScore(family.queueFlags) > (indices.transfer.has_value() ? getTransferScore(queueFamilies[*indices.transfer].queueFlags) : -1))
             indices.transfer = i;
-            addToFamilies(indices, i);
-        }
 
+        // Prefer presenting from the graphics family.
         VkBool32 presentSupport;
         vkGetPhysicalDeviceSurfaceSupportKHR(device, i, state.surface, &presentSupport);
-        if(presentSupport)
-        {
+        if(presentSupport && (!indices.present.has_value() || indices.graphics == i))
             indices.present = i;
-            addToFamilies(indices, i);
-        }
+    }
+    // Graphics queues can always transfer, even when the family doesn't say so.
+    if(!indices.transfer.has_value())
+        indices.transfer = indices.graphics;
 
-        if(indices.isComplete()) break;
+    for(auto family : {indices.graphics, indices.present, indices.transfer})
+    {
+        if(family.has_value() && std::find(indices.uniqueFamilies.dense().begin(), indices.uniqueFamilies.dense().end(), *family) == indices.uniqueFamilies.dense().end())
+            addToFamilies(indices, *family);
     }
 
     return indices;
@@ -532,6 +619,7 @@ static VkDevice createDevice(VkPhysicalDevice const &physicalDevice, QueueFamili
         .descriptorIndexing = true,
         .descriptorBindingVariableDescriptorCount = true,
         .runtimeDescriptorArray = true,
+        .timelineSemaphore = true,
         .bufferDeviceAddress = true
     };
     VkPhysicalDeviceVulkan13Features enabledVk13Features{
@@ -652,7 +740,7 @@ static bool createSwapchain(VulkanState &state, Window const &window)
         .oldSwapchain = VK_NULL_HANDLE
     };
 
-    if(state.queueFamilies.uniqueFamilies.size() == state.queueFamilies.count)
+    if(state.queueFamilies.graphics != state.queueFamilies.present)
     {
         LOG_TRACE("VK_SHARING_MODE_CONCURRENT");
         state.swapchain.createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
@@ -720,6 +808,395 @@ void createCommandPool(VulkanState &state)
     CHK(vkCreateCommandPool(state.device, &poolCreateInfo, ALLOCATOR_HERE, &state.commandPool));
 }
 
+static void createUploadManager(VulkanState &state)
+{
+    auto &upload = state.upload;
+    upload.queue = getQueue(state.device, state.queueFamilies.transfer.value());
+
+    VkCommandPoolCreateInfo poolCI{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = state.queueFamilies.transfer.value(),
+    };
+    CHK(vkCreateCommandPool(state.device, &poolCI, ALLOCATOR_HERE, &upload.commandPool));
+
+    VkSemaphoreTypeCreateInfo timelineCI{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0
+    };
+    VkSemaphoreCreateInfo semaphoreCI{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &timelineCI
+    };
+    CHK(vkCreateSemaphore(state.device, &semaphoreCI, ALLOCATOR_HERE, &upload.timeline));
+
+    for(auto &staging : upload.ring)
+    {
+        VkBufferCreateInfo bufferCI{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = UploadManager::STAGING_SIZE,
+            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+        };
+        VmaAllocationCreateInfo allocCI{
+            .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .usage = VMA_MEMORY_USAGE_AUTO
+        };
+        VmaAllocationInfo allocInfo;
+        CHK(vmaCreateBuffer(state.vma, &bufferCI, &allocCI, &staging.buffer, &staging.allocation, &allocInfo));
+        staging.mapped = static_cast<char *>(allocInfo.pMappedData);
+
+        VkCommandBufferAllocateInfo commandBufferAI{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = upload.commandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        CHK(vkAllocateCommandBuffers(state.device, &commandBufferAI, &staging.commandBuffer));
+    }
+    LOG_INFO("Uploading on queue family {}", state.queueFamilies.transfer.value());
+}
+static void waitForUploadValue(VulkanState &state, uint64_t value)
+{
+    VkSemaphoreWaitInfo waitInfo{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &state.upload.timeline,
+        .pValues = &value
+    };
+    CHK(vkWaitSemaphores(state.device, &waitInfo, UINT64_MAX));
+}
+static void releaseStaging(VulkanState &state, StagingBuffer &staging)
+{
+    for(auto &buffer : staging.oversized)
+        vmaDestroyBuffer(state.vma, buffer.buffer, buffer.allocation);
+    staging.oversized.clear();
+    staging.used = 0;
+}
+/// @brief Start recording into the current ring slot, waiting for its previous batch if it is still in flight.
+static StagingBuffer &beginUploads(VulkanState &state)
+{
+    auto &upload = state.upload;
+    auto &staging = upload.ring[upload.current];
+    if(upload.recording)
+        return staging;
+
+    waitForUploadValue(state, staging.timelineValue);
+    releaseStaging(state, staging);
+
+    CHK(vkResetCommandBuffer(staging.commandBuffer, 0));
+    VkCommandBufferBeginInfo beginInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    CHK(vkBeginCommandBuffer(staging.commandBuffer, &beginInfo));
+    upload.recording = true;
+    return staging;
+}
+/// @brief Submit the recorded uploads. Does nothing if there are none.
+static void flushUploads(VulkanState &state)
+{
+    auto &upload = state.upload;
+    if(!upload.recording)
+        return;
+    auto &staging = upload.ring[upload.current];
+
+    if(state.queueFamilies.transfer != state.queueFamilies.graphics)
+    {
+        // The release half of the ownership transfer mirrors the acquire: same families, layouts and ranges.
+        std::vector<VkBufferMemoryBarrier2> bufferReleases = upload.bufferAcquires;
+        for(auto &barrier : bufferReleases)
+        {
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+            barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+            barrier.dstAccessMask = VK_ACCESS_2_NONE;
+        }
+        std::vector<VkImageMemoryBarrier2> imageReleases = upload.imageAcquires;
+        for(auto &barrier : imageReleases)
+        {
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+            barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+            barrier.dstAccessMask = VK_ACCESS_2_NONE;
+        }
+        VkDependencyInfo releaseDependency{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .bufferMemoryBarrierCount = static_cast<uint32_t>(bufferReleases.size()),
+            .pBufferMemoryBarriers = bufferReleases.data(),
+            .imageMemoryBarrierCount = static_cast<uint32_t>(imageReleases.size()),
+            .pImageMemoryBarriers = imageReleases.data(),
+        };
+        vkCmdPipelineBarrier2(staging.commandBuffer, &releaseDependency);
+
+        upload.pendingBufferAcquires.insert(upload.pendingBufferAcquires.end(), upload.bufferAcquires.begin(), upload.bufferAcquires.end());
+        upload.pendingImageAcquires.insert(upload.pendingImageAcquires.end(), upload.imageAcquires.begin(), upload.imageAcquires.end());
+    } else {
+        // Same queue family: only the layout transitions are left, the semaphore wait makes the writes visible.
+        for(auto &barrier : upload.imageAcquires)
+        {
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+            barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            barrier.dstAccessMask = VK_ACCESS_2_NONE;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        }
+        VkDependencyInfo transitionDependency{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .imageMemoryBarrierCount = static_cast<uint32_t>(upload.imageAcquires.size()),
+            .pImageMemoryBarriers = upload.imageAcquires.data(),
+        };
+        vkCmdPipelineBarrier2(staging.commandBuffer, &transitionDependency);
+    }
+    upload.bufferAcquires.clear();
+    upload.imageAcquires.clear();
+
+    CHK(vkEndCommandBuffer(staging.commandBuffer));
+
+    staging.timelineValue = ++upload.submittedValue;
+    VkCommandBufferSubmitInfo commandBufferInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+        .commandBuffer = staging.commandBuffer
+    };
+    VkSemaphoreSubmitInfo signalInfo{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .semaphore = upload.timeline,
+        .value = staging.timelineValue,
+        .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT
+    };
+    VkSubmitInfo2 submitInfo{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+        .commandBufferInfoCount = 1,
+        .pCommandBufferInfos = &commandBufferInfo,
+        .signalSemaphoreInfoCount = 1,
+        .pSignalSemaphoreInfos = &signalInfo
+    };
+    CHK(vkQueueSubmit2(upload.queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    upload.current = (upload.current + 1) % upload.ring.size();
+    upload.recording = false;
+}
+struct StagingAllocation
+{
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    char *mapped;
+};
+/// @brief Reserve @p size bytes of staging memory in the current batch, submitting the batch if it is full.
+static StagingAllocation allocateStaging(VulkanState &state, VkDeviceSize size)
+{
+    auto *staging = &beginUploads(state);
+    VkDeviceSize offset = (staging->used + UploadManager::STAGING_ALIGNMENT - 1) / UploadManager::STAGING_ALIGNMENT * UploadManager::STAGING_ALIGNMENT;
+    if(size > UploadManager::STAGING_SIZE)
+    {
+        // Too large for the ring: a dedicated staging buffer, freed with the slot.
+        BufferAllocation oversized;
+        oversized.size = size;
+        VkBufferCreateInfo bufferCI{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = size,
+            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+        };
+        VmaAllocationCreateInfo allocCI{
+            .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .usage = VMA_MEMORY_USAGE_AUTO
+        };
+        VmaAllocationInfo allocInfo;
+        CHK(vmaCreateBuffer(state.vma, &bufferCI, &allocCI, &oversized.buffer, &oversized.allocation, &allocInfo));
+        oversized.mapped = allocInfo.pMappedData;
+        staging->oversized.emplace_back(oversized);
+        return {oversized.buffer, 0, static_cast<char *>(oversized.mapped)};
+    }
+    if(offset + size > UploadManager::STAGING_SIZE)
+    {
+        flushUploads(state);
+        staging = &beginUploads(state);
+        offset = 0;
+    }
+    staging->used = offset + size;
+    return {staging->buffer, offset, staging->mapped + offset};
+}
+/// @brief Copy @p size bytes into the device-local @p dst.
+/// @param dstStage, dstAccess How the graphics queue uses the buffer.
+static void uploadBuffer(VulkanState &state, VkBuffer dst, void const *data, VkDeviceSize size, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+{
+    if(size == 0)
+        return;
+    auto staging = allocateStaging(state, size);
+    std::memcpy(staging.mapped, data, size);
+
+    VkBufferCopy region{
+        .srcOffset = staging.offset,
+        .dstOffset = 0,
+        .size = size
+    };
+    vkCmdCopyBuffer(state.upload.ring[state.upload.current].commandBuffer, staging.buffer, dst, 1, &region);
+
+    if(state.queueFamilies.transfer != state.queueFamilies.graphics)
+    {
+        state.upload.bufferAcquires.emplace_back(VkBufferMemoryBarrier2{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+            .srcAccessMask = VK_ACCESS_2_NONE,
+            .dstStageMask = dstStage,
+            .dstAccessMask = dstAccess,
+            .srcQueueFamilyIndex = state.queueFamilies.transfer.value(),
+            .dstQueueFamilyIndex = state.queueFamilies.graphics.value(),
+            .buffer = dst,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE
+        });
+    }
+}
+/// @brief Copy @p regions of @p data into @p image, which ends up in @p finalLayout.
+/// The buffer offsets of @p regions are relative to @p data. The whole image is transitioned, its previous contents are discarded.
+static void uploadImage(VulkanState &state, ImageAllocation const &image, void const *data, VkDeviceSize size, std::vector<VkBufferImageCopy> regions, 
+    VkImageLayout finalLayout, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+{
+    auto staging = allocateStaging(state, size);
+    std::memcpy(staging.mapped, data, size);
+    for(auto &region : regions)
+        region.bufferOffset += staging.offset;
+
+    VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, image.numMipLevels, 0, 1};
+    auto cb = state.upload.ring[state.upload.current].commandBuffer;
+    insertImageMemoryBarrier(cb, image.image,
+        VK_ACCESS_2_NONE,
+        VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_2_NONE,
+        VK_PIPELINE_STAGE_2_COPY_BIT,
+        range
+    );
+    vkCmdCopyBufferToImage(cb, staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+    state.upload.imageAcquires.emplace_back(VkImageMemoryBarrier2{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+        .srcAccessMask = VK_ACCESS_2_NONE,
+        .dstStageMask = dstStage,
+        .dstAccessMask = dstAccess,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = finalLayout,
+        .srcQueueFamilyIndex = state.queueFamilies.transfer.value(),
+        .dstQueueFamilyIndex = state.queueFamilies.graphics.value(),
+        .image = image.image,
+        .subresourceRange = range
+    });
+}
+/// @brief Blit the mip chain of @p image from its base level.
+/// The image has to be in TRANSFER_DST_OPTIMAL, it ends up in SHADER_READ_ONLY_OPTIMAL.
+static void generateMipmaps(VkCommandBuffer cb, ImageAllocation const &image)
+{
+    for(uint32_t i = 1; i < image.numMipLevels; ++i)
+    {
+        insertImageMemoryBarrier(cb, image.image,
+            VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_ACCESS_2_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT,
+            VK_PIPELINE_STAGE_2_BLIT_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 1, 0, 1}
+        );
+        VkImageBlit2 imageBlit{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2,
+            .srcSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel   = i - 1,
+                .layerCount = 1,
+            },
+            .srcOffsets = {
+                { 0, 0, 0 },
+                { int32_t(std::max(image.size.x >> (i - 1), 1u)), int32_t(std::max(image.size.y >> (i - 1), 1u)), 1 }
+            },
+            .dstSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel   = i,
+                .layerCount = 1,
+            },
+            .dstOffsets = {
+                { 0, 0, 0 },
+                { int32_t(std::max(image.size.x >> i, 1u)), int32_t(std::max(image.size.y >> i, 1u)), 1 }
+            }
+        };
+        VkBlitImageInfo2 imageBlitInfo{
+            .sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2,
+            .srcImage = image.image,
+            .srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .dstImage = image.image,
+            .dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .regionCount = 1,
+            .pRegions = &imageBlit,
+            .filter = VK_FILTER_LINEAR
+        };
+        vkCmdBlitImage2(cb, &imageBlitInfo);
+    }
+
+    // Every level but the last one was a blit source.
+    if(image.numMipLevels > 1)
+    {
+        insertImageMemoryBarrier(cb, image.image,
+            VK_ACCESS_2_TRANSFER_READ_BIT,
+            VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_2_BLIT_BIT,
+            VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, image.numMipLevels - 1, 0, 1}
+        );
+    }
+    insertImageMemoryBarrier(cb, image.image,
+        VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT,
+        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, image.numMipLevels - 1, 1, 0, 1}
+    );
+}
+/// @brief Submit pending uploads and record the acquiring half of their ownership transfers into @p cb.
+/// Mip chains of the uploaded textures are generated in @p cb as well.
+/// @return The upload timeline value the submission of @p cb has to wait for, 0 if there is nothing to wait for.
+static uint64_t acquireUploads(VulkanState &state, VkCommandBuffer cb)
+{
+    auto &upload = state.upload;
+    flushUploads(state);
+    if(!upload.pendingBufferAcquires.empty() || !upload.pendingImageAcquires.empty())
+    {
+        VkDependencyInfo acquireDependency{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .bufferMemoryBarrierCount = static_cast<uint32_t>(upload.pendingBufferAcquires.size()),
+            .pBufferMemoryBarriers = upload.pendingBufferAcquires.data(),
+            .imageMemoryBarrierCount = static_cast<uint32_t>(upload.pendingImageAcquires.size()),
+            .pImageMemoryBarriers = upload.pendingImageAcquires.data(),
+        };
+        vkCmdPipelineBarrier2(cb, &acquireDependency);
+        upload.pendingBufferAcquires.clear();
+        upload.pendingImageAcquires.clear();
+    }
+    for(auto const &image : upload.mipmaps)
+        generateMipmaps(cb, image);
+    upload.mipmaps.clear();
+    return upload.submittedValue;
+}
+static void destroyUploadManager(VulkanState &state)
+{
+    auto &upload = state.upload;
+    flushUploads(state);
+    waitForUploadValue(state, upload.submittedValue);
+    for(auto &staging : upload.ring)
+    {
+        releaseStaging(state, staging);
+        vmaDestroyBuffer(state.vma, staging.buffer, staging.allocation);
+    }
+    vkDestroyCommandPool(state.device, upload.commandPool, ALLOCATOR_HERE);
+    vkDestroySemaphore(state.device, upload.timeline, ALLOCATOR_HERE);
+}
+
 static std::string printTexture(ecs::entity e, ecs::registry const &reg)
 {
     if(!reg.valid(e))
@@ -754,14 +1231,20 @@ static void printModelData(ecs::entity e, ecs::registry const &reg)
         LOG_INFO("-----------------");
 
         LOG_INFO("Geometry:");
-        LOG_INFO("  Triangles: {}", mesh.geometry.indices.size() / 3);
-        LOG_INFO("  Indices:   {}", mesh.geometry.indices.size());
+        LOG_INFO("  Triangles: {}", mesh.geometry.lods.at(0).indexCount / 3);
+        LOG_INFO("  Indices:   {} ({} bit)", mesh.geometry.indices.size(), mesh.geometry.indexSize * 8);
         LOG_INFO("  Positions: {}", mesh.geometry.positions.size());
         LOG_INFO("  TexCoords: {}", mesh.geometry.texCoords.size());
         LOG_INFO("  Normals:   {}", mesh.geometry.normals.size());
         LOG_INFO("  Tangents:  {}", mesh.geometry.tangents.size());
         LOG_INFO("  BoneIDs:   {}", mesh.geometry.boneIDs.size());
         LOG_INFO("  Weights:   {}", mesh.geometry.weights.size());
+        if(mesh.geometry.boneIndexSize)
+            LOG_INFO("  Bone indices: {} bit", mesh.geometry.boneIndexSize * 8);
+        for(size_t i = 1; i < mesh.geometry.lods.size(); ++i)
+            LOG_INFO("  LOD {}:     {} triangles, error {}", i, mesh.geometry.lods[i].indexCount / 3, mesh.geometry.lods[i].error);
+        if(!mesh.geometry.meshlets.empty())
+            LOG_INFO("  Meshlets:  {}", mesh.geometry.meshlets.size());
         
         LOG_INFO("Material:");
         LOG_INFO("Textures:");
@@ -771,6 +1254,7 @@ static void printModelData(ecs::entity e, ecs::registry const &reg)
         LOG_INFO("  Ambient:      {}", printTexture(mesh.material.textures.ambient, reg));
         LOG_INFO("  Normal:       {}", printTexture(mesh.material.textures.normal, reg));
         LOG_INFO("  Displacement: {}", printTexture(mesh.material.textures.displacement, reg));
+        LOG_INFO("  ORM:          {}", printTexture(mesh.material.textures.orm, reg));
         LOG_INFO("Properties:");
         LOG_INFO("  Ambient:       {}", fmt::streamed(mesh.material.properties.ambient));
         LOG_INFO("  Albedo:        {}", fmt::streamed(mesh.material.properties.albedo));
@@ -781,39 +1265,78 @@ static void printModelData(ecs::entity e, ecs::registry const &reg)
         LOG_INFO("  IOR:           {}", mesh.material.properties.ior);
     }
 }
-template<typename T>
-BufferAllocation allocateBuffer(VulkanState &state, std::vector<T> const &data)
+/// @brief Make an empty device-local buffer. Buffers that shaders access through pointers get their device address.
+static BufferAllocation createBuffer(VulkanState &state, VkDeviceSize size, VkBufferUsageFlags usage)
 {
     BufferAllocation buffer;
-    buffer.size = data.size() * sizeof(T);
+    buffer.size = size;
+    if(buffer.size == 0)
+        return {};
 
     VkBufferCreateInfo ci{
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .size = buffer.size,
-        .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        .usage = usage,
     };
     VmaAllocationCreateInfo allocCI{
-        .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-        .usage = VMA_MEMORY_USAGE_AUTO
+        .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
     };
 
     CHK(vmaCreateBuffer(state.vma, &ci, &allocCI, &buffer.buffer, &buffer.allocation, nullptr));
 
-    void *bufferPtr = nullptr;
-    CHK(vmaMapMemory(state.vma, buffer.allocation, &bufferPtr));
-    std::memcpy(bufferPtr, data.data(), buffer.size);
-    vmaUnmapMemory(state.vma, buffer.allocation);
-
-/* 
-    VkBufferDeviceAddressInfo bdaInfo{
-        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-        .buffer = buffer.buffer
-    };
-    buffer.deviceAddress = vkGetBufferDeviceAddress(state.device, &bdaInfo);
- */
+    if(usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+    {
+        VkBufferDeviceAddressInfo bdaInfo{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .buffer = buffer.buffer
+        };
+        buffer.deviceAddress = vkGetBufferDeviceAddress(state.device, &bdaInfo);
+    }
+    return buffer;
+}
+/// @brief Make a device-local buffer of @p usage, filled through the upload manager.
+/// @param dstStage, dstAccess How the graphics queue uses the buffer.
+template<typename T>
+BufferAllocation allocateBuffer(VulkanState &state, std::vector<T> const &data, VkBufferUsageFlags usage, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+{
+    BufferAllocation buffer = createBuffer(state, data.size() * sizeof(T), usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    if(buffer.size == 0)
+        return {};
 
+    uploadBuffer(state, buffer.buffer, data.data(), buffer.size, dstStage, dstAccess);
     return buffer;
 }
+/// @brief Make a device-local vertex and index buffer, filled through the upload manager.
+template<typename T>
+BufferAllocation allocateBuffer(VulkanState &state, std::vector<T> const &data)
+{
+    return allocateBuffer(state, data, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT | VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, 
+        VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT);
+}
+static std::vector<unsigned char> expandToRGBA(std::span<unsigned char const> pixels, size_t numPixels, unsigned n)
+{
+    if(n == 0 || n > 4 || pixels.size() < numPixels * n)
+    {
+        LOG_ERROR("Bitmap has {} bytes for {} pixels of {} components!", pixels.size(), numPixels, n);
+        return std::vector<unsigned char>(numPixels * 4, 0);
+    }
+    std::vector<unsigned char> result(numPixels * 4);
+    expandToRGBA(pixels.data(), n, result.data(), numPixels);
+    return result;
+}
+static VkFormat getBlockFormat(TextureFormat format, bool srgb)
+{
+    switch(format)
+    {
+    case TextureFormat::bc1: return srgb ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case TextureFormat::bc3: return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    case TextureFormat::bc4: return VK_FORMAT_BC4_UNORM_BLOCK;
+    case TextureFormat::bc5: return VK_FORMAT_BC5_UNORM_BLOCK;
+    case TextureFormat::bc7: return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    default: return VK_FORMAT_UNDEFINED;
+    }
+}
 static ImageAllocation allocateTexture(VulkanState &state, ecs::entity eTexture)
 {
     if(!sReg.valid(eTexture))
@@ -822,13 +1345,52 @@ static ImageAllocation allocateTexture(VulkanState &state, ecs::entity eTexture)
         assert(false);
         return {};
     }
+    if(auto it = state.textures.find(eTexture); it != state.textures.end())
+        return it->second;
     Texture const &texture = sReg.get<Texture>(eTexture);
-    assert(texture.bitmap.numComponents == 3);
     ImageAllocation image;
-    image.format = texture.srgb ? VK_FORMAT_R8G8B8_SRGB : VK_FORMAT_R8G8B8_UNORM;
-    image.numMipLevels = texture.numMipLevels;
-    image.numComponents = texture.bitmap.numComponents;
+    // RGBA8 is guaranteed to support blits with linear filtering, 3 component formats mostly can't even be sampled.
+    image.format = texture.srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    image.numMipLevels = std::clamp(texture.numMipLevels, 1u, getMipLevelCount(texture.bitmap.size));
+    image.numComponents = 4;
     image.size = texture.bitmap.size;
+    // Compressed textures are uploaded as their blocks if the device can sample them, decoded to RGBA8 otherwise.
+    // Conversions work on a copy, the texture in the registry stays as it was loaded.
+    std::optional<Texture> converted;
+    bool compressed = false;
+    if(texture.format != TextureFormat::uncompressed)
+    {
+        VkFormat blockFormat = getBlockFormat(texture.format, texture.srgb);
+        VkFormatProperties blockProperties;
+        vkGetPhysicalDeviceFormatProperties(state.physicalDevice, blockFormat, &blockProperties);
+        if(blockProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)
+        {
+            image.format = blockFormat;
+            compressed = true;
+        } else {
+            LOG_WARN("{} can't be sampled, \"{}\" is decoded and uploaded uncompressed!", string_VkFormat(blockFormat), texture.path);
+            converted.emplace(texture);
+            decompressTexture(*converted);
+        }
+    }
+    // Levels made on the CPU are uploaded as they are, otherwise the GPU blits them from the base level.
+    bool cpuMips = !texture.levels.empty() || texture.format != TextureFormat::uncompressed;
+    if(cpuMips)
+        image.numMipLevels = texture.getLevelCount();
+
+    constexpr VkFormatFeatureFlags BLIT_FEATURES = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(state.physicalDevice, image.format, &formatProperties);
+    // Without linear blits the chain is made on the CPU instead
+    if(!cpuMips && image.numMipLevels > 1 && (formatProperties.optimalTilingFeatures & BLIT_FEATURES) != BLIT_FEATURES)
+    {
+        LOG_WARN("{} is not blittable, the mips of \"{}\" are made on the CPU", string_VkFormat(image.format), texture.path);
+        converted.emplace(texture);
+        generateMipChain(*converted);
+        cpuMips = true;
+        image.numMipLevels = std::min(image.numMipLevels, converted->getLevelCount());
+    }
+    Texture const &levels = converted ? *converted : texture;
 
     VkImageCreateInfo imageCI{
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -843,151 +1405,55 @@ static ImageAllocation allocateTexture(VulkanState &state, ecs::entity eTexture)
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
     };
     VmaAllocationCreateInfo allocCI{
-        .usage = VMA_MEMORY_USAGE_AUTO,
+        .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
     };
     CHK(vmaCreateImage(state.vma, &imageCI, &allocCI, &image.image, &image.allocation, nullptr));
 
-    VkBuffer imgSrcBuffer{};
-    VmaAllocation imgSrcAllocation{};
-    VkBufferCreateInfo imgSrcBufferCI{
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = sizeof(texture.bitmap.pixels[0]) * texture.bitmap.pixels.size(),
-        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT
-    };
-    VmaAllocationCreateInfo imgSrcAllocCI{
-        .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-        .usage = VMA_MEMORY_USAGE_AUTO
-    };
-    CHK(vmaCreateBuffer(state.vma, &imgSrcBufferCI, &imgSrcAllocCI, &imgSrcBuffer, &imgSrcAllocation, nullptr));
-
-    void* imgSrcBufferPtr = nullptr;
-    CHK(vmaMapMemory(state.vma, imgSrcAllocation, &imgSrcBufferPtr));
-    std::memcpy(imgSrcBufferPtr, texture.bitmap.pixels.data(), sizeof(texture.bitmap.pixels[0]) * texture.bitmap.pixels.size());
-    vmaUnmapMemory(state.vma, imgSrcAllocation);
-
-    VkCommandBuffer commandBuffer;
-    VkCommandBufferAllocateInfo commandBufferAllocInfo{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = state.commandPool,
-        .commandBufferCount = 1,
-    };
-    CHK(vkAllocateCommandBuffers(state.device, &commandBufferAllocInfo, &commandBuffer));
-    VkCommandBufferBeginInfo beginInfo{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-    };
-    CHK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
-    VkBufferImageCopy bufferCopyRegion = {
-        .bufferOffset = 0,
-        .imageSubresource = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .mipLevel = 0,
-            .baseArrayLayer = 0,
-            .layerCount = 1,
-        },
-        .imageExtent = {
-            .width = image.size.x,
-            .height = image.size.y,
-            .depth = 1,
-        }
-    };
-    vkCmdCopyBufferToImage(commandBuffer, imgSrcBuffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-
-/* FIXME
-    // FIXME: validation layers screaming
-    for(uint32_t i = 1; i < image.numMipLevels; i++)
+    // Blocks and RGBA bitmaps are staged straight from the texture, other bitmaps are expanded to RGBA first.
+    bool direct = compressed || levels.bitmap.numComponents == 4;
+    std::span<unsigned char const> source = compressed ? std::span<unsigned char const>{levels.blocks} : std::span<unsigned char const>{levels.bitmap.pixels};
+    std::vector<unsigned char> expanded;
+    std::vector<VkBufferImageCopy> regions;
+    size_t uploadSize = 0;
+    for(unsigned level = 0; level < (cpuMips ? image.numMipLevels : 1); ++level)
     {
-        VkImageBlit2 imageBlit{
-            .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2,
-            .srcSubresource = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .mipLevel   = i - 1,
-                .layerCount = 1,
-            },
-            .srcOffsets = {
-                { 0, 0, 0 },
-                { int32_t(image.size.x >> (i - 1)), int32_t(image.size.y >> (i - 1)), 1 }
-            },
-            .dstSubresource = {
+        glm::uvec2 size = levels.getLevelSize(level);
+        std::span<unsigned char const> levelData = compressed ? levels.getCompressedLevel(level) : levels.getLevel(level);
+        size_t offset = expanded.size();
+        if(direct)
+            offset = static_cast<size_t>(levelData.data() - source.data());
+        else {
+            auto levelPixels = expandToRGBA(levelData, static_cast<size_t>(size.x) * size.y, levels.bitmap.numComponents);
+            expanded.insert(expanded.end(), levelPixels.begin(), levelPixels.end());
+        }
+        uploadSize = std::max(uploadSize, direct ? offset + levelData.size() : expanded.size());
+        regions.push_back({
+            .bufferOffset = offset,
+            .imageSubresource = {
                 .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .mipLevel   = i,
+                .mipLevel = level,
+                .baseArrayLayer = 0,
                 .layerCount = 1,
             },
-            .dstOffsets = {
-                { 0, 0, 0 },
-                { int32_t(image.size.x >> i), int32_t(image.size.y >> i), 1 }
+            .imageExtent = {
+                .width = size.x,
+                .height = size.y,
+                .depth = 1,
             }
-        };
-        VkBlitImageInfo2 imageBlitInfo{
-            .sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2,
-            .srcImage = image.image,
-            .srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            .dstImage = image.image,
-            .dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .regionCount = 1,
-            .pRegions = &imageBlit,
-            .filter = VK_FILTER_LINEAR
-        };
-
-        // insertImageMemoryBarrier(commandBuffer, image.image,
-        //     0,
-        //     VK_ACCESS_TRANSFER_WRITE_BIT,
-        //     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        //     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        //     VK_PIPELINE_STAGE_TRANSFER_BIT,
-        //     VK_PIPELINE_STAGE_TRANSFER_BIT,
-        //     {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1}
-        // );
-
-        vkCmdBlitImage2(commandBuffer, &imageBlitInfo);
-
-        // insertImageMemoryBarrier(commandBuffer, image.image, 
-        //     VK_ACCESS_TRANSFER_WRITE_BIT,
-        //     VK_ACCESS_TRANSFER_READ_BIT,
-        //     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        //     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        //     VK_PIPELINE_STAGE_TRANSFER_BIT,
-        //     VK_PIPELINE_STAGE_TRANSFER_BIT,
-        //     {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}
-        // );
-
-        // insertImageMemoryBarrier(commandBuffer, image.image, 
-        //     VK_ACCESS_TRANSFER_WRITE_BIT,
-        //     VK_ACCESS_TRANSFER_READ_BIT,
-        //     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        //     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        //     VK_PIPELINE_STAGE_TRANSFER_BIT,
-        //     VK_PIPELINE_STAGE_TRANSFER_BIT,
-        //     {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1}
-        // );
+        });
+    }
+    unsigned char const *uploadData = direct ? source.data() : expanded.data();
+    if(!cpuMips && image.numMipLevels > 1)
+    {
+        // The rest of the chain is blitted on the graphics queue once the base level arrives.
+        uploadImage(state, image, uploadData, uploadSize, std::move(regions),
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        state.upload.mipmaps.emplace_back(image);
+    } else {
+        uploadImage(state, image, uploadData, uploadSize, std::move(regions),
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
     }
-    insertImageMemoryBarrier(commandBuffer, image.image,
-        VK_ACCESS_TRANSFER_READ_BIT,
-        VK_ACCESS_SHADER_READ_BIT,
-        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        {VK_IMAGE_ASPECT_COLOR_BIT, 0, image.numMipLevels, 0, 1}
-    );
-
-    vkEndCommandBuffer(commandBuffer);
-
-    VkFence fence;
-    VkFenceCreateInfo fenceCI{
-        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-    };
-    vkCreateFence(state.device, &fenceCI, ALLOCATOR_HERE, &fence);
 
-    VkSubmitInfo submitInfo{
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &commandBuffer,
-    };
-    static auto queue = getQueue(state.device, state.queueFamilies.transfer);
-    vkQueueSubmit(queue, 1, &submitInfo, fence);
-    vkWaitForFences(state.device, 1, &fence, true, 0);
-*/
     VkImageViewCreateInfo texVewCI{
         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
         .image = image.image,
@@ -1012,11 +1478,10 @@ static ImageAllocation allocateTexture(VulkanState &state, ecs::entity eTexture)
     state.textureDescriptorInfos.emplace_back(VkDescriptorImageInfo{
         .sampler = image.sampler,
         .imageView = image.view,
-        .imageLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
     });
 
-    vmaDestroyBuffer(state.vma, imgSrcBuffer, imgSrcAllocation);
-
+    state.textures.emplace(eTexture, image);
     return image;
 }
 static void makeDescriptors(VulkanState &state)
@@ -1106,35 +1571,104 @@ static std::optional<VulkanMesh> loadModel(VulkanState &state, std::string_view
     }
  */
 
-    if(model.meshes.size() > 1)
-        LOG_WARN("Multi-mesh models are not yet supported! \"{}\"", path);
     if(model.meshes.size() == 0)
     {
         LOG_ERROR("Model \"{}\" has no meshes!", path);
         return std::nullopt;
     }
+    // Meshes split for 16-bit indices share the material of their source mesh.
+    for(auto const &other : model.meshes)
+    {
+        if(other.materialId != model.meshes[0].materialId)
+        {
+            LOG_WARN("Multi-material models are not yet supported, drawing every mesh with the first material! \"{}\"", path);
+            break;
+        }
+    }
 
     auto const &mesh = model.meshes.at(0);
-    return VulkanMesh{
+    // Small textures (like the 1x1 defaults) share atlas pages: one image, view, sampler and descriptor for all of them.
+    auto const &textures = mesh.material.textures;
+    std::array<ecs::entity, 4> slots{textures.albedo, textures.orm, textures.normal, textures.displacement};
+    TextureAtlas atlas = TextureAtlas::build(sReg, slots);
+    auto uvTransform = [&](ecs::entity e){
+        AtlasRegion region = atlas.getRegion(e);
+        return glm::vec4(region.offset, region.scale);
+    };
+    VulkanMesh vulkanMesh{
         .eModel = eModel,
-        .meshIndex = 0,
         .textures = {
-            .albedo       = allocateTexture(state, mesh.material.textures.albedo),
-            .metallic     = allocateTexture(state, mesh.material.textures.metallic),
-            .roughness    = allocateTexture(state, mesh.material.textures.roughness),
-            .ambient      = allocateTexture(state, mesh.material.textures.ambient),
-            .normal       = allocateTexture(state, mesh.material.textures.normal),
-            .displacement = allocateTexture(state, mesh.material.textures.displacement),
+            .albedo       = allocateTexture(state, atlas.getRegion(textures.albedo).page),
+            .orm          = allocateTexture(state, atlas.getRegion(textures.orm).page),
+            .normal       = allocateTexture(state, atlas.getRegion(textures.normal).page),
+            .displacement = allocateTexture(state, atlas.getRegion(textures.displacement).page),
         },
-        .buffers = {
-            .pos  = allocateBuffer(state, mesh.geometry.positions),
-            .uv   = allocateBuffer(state, mesh.geometry.texCoords),
-            .norm = allocateBuffer(state, mesh.geometry.normals),
-            .tan  = allocateBuffer(state, mesh.geometry.tangents),
-            .idx  = allocateBuffer(state, mesh.geometry.indices),
+        .uvTransforms = {
+            .albedo       = uvTransform(textures.albedo),
+            .orm          = uvTransform(textures.orm),
+            .normal       = uvTransform(textures.normal),
+            .displacement = uvTransform(textures.displacement),
         },
-        .indexCount = mesh.geometry.indices.size()
     };
+    LOG_INFO("\"{}\" samples {} images for its {} textures", path, state.textures.size(), slots.size());
+    size_t indexBytes = 0;
+    for(size_t i = 0; i < model.meshes.size(); ++i)
+    {
+        auto const &geometry = model.meshes[i].geometry;
+        auto &part = vulkanMesh.parts.emplace_back(VulkanMesh::Part{
+            .meshIndex = i,
+            .indexCount = geometry.indices.size(),
+            .vertexCount = static_cast<uint32_t>(geometry.positions.size())
+        });
+        if(geometry.indexSize == sizeof(uint16_t))
+        {
+            std::vector<uint16_t> indices(geometry.indices.begin(), geometry.indices.end());
+            part.buffers.idx = allocateBuffer(state, indices);
+            part.buffers.indexType = VK_INDEX_TYPE_UINT16;
+        } else {
+            part.buffers.idx = allocateBuffer(state, geometry.indices);
+            part.buffers.indexType = VK_INDEX_TYPE_UINT32;
+        }
+        indexBytes += part.buffers.idx.size;
+
+        if constexpr(VERTEX_LAYOUT == VertexLayout::Packed)
+        {
+            auto packed = packVertices(geometry);
+            part.buffers.vertices = allocateBuffer(state, packed.vertices);
+            part.positionOffset = packed.positionOffset;
+            part.positionScale = packed.positionScale;
+        } else {
+            part.buffers.pos  = allocateBuffer(state, geometry.positions);
+            part.buffers.uv   = allocateBuffer(state, geometry.texCoords);
+            part.buffers.norm = allocateBuffer(state, geometry.normals);
+            part.buffers.tan  = allocateBuffer(state, geometry.tangents);
+        }
+
+        // Meshes with bone weights are skinned by the compute pre-pass, into a vertex buffer per instance
+        if(!geometry.boneIDs.empty() && !model.skeleton.boneMap.empty())
+        {
+            std::vector<SkinVertex> skinVertices(geometry.positions.size());
+            for(size_t v = 0; v < skinVertices.size(); ++v)
+            {
+                skinVertices[v] = SkinVertex{
+                    .position = glm::vec4(geometry.positions[v], 1.0f),
+                    .normal   = glm::vec4(geometry.normals[v], 0.0f)
+                };
+            }
+            part.buffers.skinSource = allocateBuffer(state, skinVertices, 
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+            part.buffers.boneInfluences = allocateBuffer(state, packBoneInfluences(geometry),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+            part.boneIndexSize = geometry.boneIndexSize;
+            for(uint32_t instance = 0; instance < NUM_INSTANCES; ++instance)
+                part.buffers.skinned.push_back(createBuffer(state, skinVertices.size() * sizeof(SkinnedVertex), 
+                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT));
+        }
+    }
+    LOG_INFO("Uploaded {} meshes of \"{}\", {} KiB of indices", vulkanMesh.parts.size(), path, indexBytes / 1024);
+    return vulkanMesh;
 }
 template<typename T>
 static T valueOrAbort(std::optional<T> const &o)
@@ -1187,11 +1721,18 @@ static void makeDepthAttachment(VulkanState &state, VkExtent2D extent)
     CHK(vkCreateImageView(state.device, &depthViewCI, ALLOCATOR_HERE, &state.depthImage.view));
 }
 
+struct PushConstants
+{
+    VkDeviceAddress shaderData;
+    uint64_t padding;
+    glm::vec4 positionOffset;
+    glm::vec4 positionScale;
+};
 static void makePipeline(VulkanState &state, VkShaderModule shaderModule, VkExtent2D extent)
 {
     VkPushConstantRange pushConstantRange{
         .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-        .size = sizeof(VkDeviceAddress)
+        .size = sizeof(PushConstants)
     };
     VkPipelineLayoutCreateInfo pipelineLayoutCI{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -1203,20 +1744,33 @@ static void makePipeline(VulkanState &state, VkShaderModule shaderModule, VkExte
     CHK(vkCreatePipelineLayout(state.device, &pipelineLayoutCI, nullptr, &state.pipelineLayout));
 
     // Bindings
-    const std::array<VkVertexInputBindingDescription, 4> vertexInputBindings = {
-        VkVertexInputBindingDescription{ 0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX },
-        VkVertexInputBindingDescription{ 1, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX },
-        VkVertexInputBindingDescription{ 2, sizeof(glm::vec2), VK_VERTEX_INPUT_RATE_VERTEX },
-        VkVertexInputBindingDescription{ 3, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX },
-    };
-
-    // Attributes
-    const std::array<VkVertexInputAttributeDescription, 4> vertexInputAttributes = {
-        VkVertexInputAttributeDescription{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
-        VkVertexInputAttributeDescription{ 1, 1, VK_FORMAT_R32G32B32_SFLOAT, 0 },
-        VkVertexInputAttributeDescription{ 2, 2, VK_FORMAT_R32G32_SFLOAT, 0 },
-        VkVertexInputAttributeDescription{ 3, 3, VK_FORMAT_R32G32B32A32_SFLOAT, 0 },
-    };
+    std::vector<VkVertexInputBindingDescription> vertexInputBindings;
+    // Attributes, locations match VSInput and VSInputPacked in basic.slang
+    std::vector<VkVertexInputAttributeDescription> vertexInputAttributes;
+    if constexpr(VERTEX_LAYOUT == VertexLayout::Packed)
+    {
+        vertexInputBindings = {
+            VkVertexInputBindingDescription{ 0, sizeof(PackedVertex), VK_VERTEX_INPUT_RATE_VERTEX },
+        };
+        vertexInputAttributes = {
+            VkVertexInputAttributeDescription{ 0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(PackedVertex, position) },
+            VkVertexInputAttributeDescription{ 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal) },
+            VkVertexInputAttributeDescription{ 2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, texCoord) },
+        };
+    } else {
+        vertexInputBindings = {
+            VkVertexInputBindingDescription{ 0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX },
+            VkVertexInputBindingDescription{ 1, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX },
+            VkVertexInputBindingDescription{ 2, sizeof(glm::vec2), VK_VERTEX_INPUT_RATE_VERTEX },
+            VkVertexInputBindingDescription{ 3, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX },
+        };
+        vertexInputAttributes = {
+            VkVertexInputAttributeDescription{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+            VkVertexInputAttributeDescription{ 1, 1, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+            VkVertexInputAttributeDescription{ 2, 2, VK_FORMAT_R32G32_SFLOAT, 0 },
+            VkVertexInputAttributeDescription{ 3, 3, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+        };
+    }
 
     VkPipelineVertexInputStateCreateInfo vertexInputState{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
@@ -1236,7 +1790,7 @@ static void makePipeline(VulkanState &state, VkShaderModule shaderModule, VkExte
         { 
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
             .stage = VK_SHADER_STAGE_VERTEX_BIT,
-            .module = shaderModule, .pName = "main"
+            .module = shaderModule, .pName = VERTEX_LAYOUT == VertexLayout::Packed ? "mainPacked" : "main"
         },
         { 
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -1287,6 +1841,7 @@ static void makePipeline(VulkanState &state, VkShaderModule shaderModule, VkExte
     };
     VkPipelineRasterizationStateCreateInfo rasterizationState{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .cullMode = CULL_MODE,
         .lineWidth = 1.0f
     };
     VkPipelineMultisampleStateCreateInfo multisampleState{
@@ -1310,6 +1865,113 @@ static void makePipeline(VulkanState &state, VkShaderModule shaderModule, VkExte
         .layout = state.pipelineLayout
     };
     CHK(vkCreateGraphicsPipelines(state.device, VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &state.pipeline));
+
+    // Skinned parts read the vertices the skinning pre-pass wrote, and their UVs from the unskinned ones.
+    // Locations match VSInputSkinned in basic.slang.
+    vertexInputBindings = {
+        VkVertexInputBindingDescription{ 0, sizeof(SkinnedVertex), VK_VERTEX_INPUT_RATE_VERTEX },
+        VkVertexInputBindingDescription{ 1, VERTEX_LAYOUT == VertexLayout::Packed ? sizeof(PackedVertex) : sizeof(glm::vec2), VK_VERTEX_INPUT_RATE_VERTEX },
+    };
+    vertexInputAttributes = {
+        VkVertexInputAttributeDescription{ 0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SkinnedVertex, position) },
+        VkVertexInputAttributeDescription{ 1, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SkinnedVertex, normal) },
+        VERTEX_LAYOUT == VertexLayout::Packed
+            ? VkVertexInputAttributeDescription{ 2, 1, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, texCoord) }
+            : VkVertexInputAttributeDescription{ 2, 1, VK_FORMAT_R32G32_SFLOAT, 0 },
+    };
+    vertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInputBindings.size());
+    vertexInputState.pVertexBindingDescriptions = vertexInputBindings.data();
+    vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
+    vertexInputState.pVertexAttributeDescriptions = vertexInputAttributes.data();
+    shaderStages[0].pName = "mainSkinned";
+    CHK(vkCreateGraphicsPipelines(state.device, VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &state.skinnedPipeline));
+}
+// Matches SkinningData in skinning.slang
+struct SkinningPushConstants
+{
+    VkDeviceAddress source;
+    VkDeviceAddress influences;
+    VkDeviceAddress palette;
+    VkDeviceAddress output;
+    uint32_t vertexCount;
+    uint32_t boneIndexSize;
+};
+static void makeSkinningPipeline(VulkanState &state, VkShaderModule shaderModule)
+{
+    VkPushConstantRange pushConstantRange{
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .size = sizeof(SkinningPushConstants)
+    };
+    VkPipelineLayoutCreateInfo pipelineLayoutCI{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+    CHK(vkCreatePipelineLayout(state.device, &pipelineLayoutCI, nullptr, &state.skinningPipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineCI{
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shaderModule,
+            .pName = "main"
+        },
+        .layout = state.skinningPipelineLayout
+    };
+    CHK(vkCreateComputePipelines(state.device, VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &state.skinningPipeline));
+}
+/// @brief Record the skinning pre-pass: every skinned part of @p mesh is posed once per instance into its output buffers,
+/// which all passes drawing the instance read as vertices.
+/// @param palettes The skinning matrices of the instances one after the other, @p numBones each.
+static void recordSkinning(VulkanState const &state, VkCommandBuffer cb, VulkanMesh const &mesh, VkDeviceAddress palettes, uint32_t numBones)
+{
+    // The outputs are shared by the frames in flight: the draws of earlier frames have to be done reading them
+    VkMemoryBarrier2 outputsFree{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+        .srcAccessMask = 0,
+        .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+    };
+    VkDependencyInfo outputsFreeDependencyInfo{
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = &outputsFree
+    };
+    vkCmdPipelineBarrier2(cb, &outputsFreeDependencyInfo);
+
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, state.skinningPipeline);
+    for(auto const &part : mesh.parts)
+    {
+        for(uint32_t instance = 0; instance < part.buffers.skinned.size(); ++instance)
+        {
+            SkinningPushConstants pushConstants{
+                .source = part.buffers.skinSource.deviceAddress,
+                .influences = part.buffers.boneInfluences.deviceAddress,
+                .palette = palettes + instance * numBones * sizeof(glm::mat4),
+                .output = part.buffers.skinned[instance].deviceAddress,
+                .vertexCount = part.vertexCount,
+                .boneIndexSize = part.boneIndexSize
+            };
+            vkCmdPushConstants(cb, state.skinningPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPushConstants), &pushConstants);
+            vkCmdDispatch(cb, (part.vertexCount + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE, 1, 1);
+        }
+    }
+
+    VkMemoryBarrier2 outputsWritten{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+        .dstAccessMask = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT
+    };
+    VkDependencyInfo outputsWrittenDependencyInfo{
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = &outputsWritten
+    };
+    vkCmdPipelineBarrier2(cb, &outputsWrittenDependencyInfo);
 }
 static void resizeSwapchain(VulkanState &state, VkExtent2D extent)
 {
@@ -1405,6 +2067,7 @@ int main(int argc, char const **argv)
     assert(state.swapchain.images.size() == state.swapchain.images.size());
 
     createCommandPool(state);
+    createUploadManager(state);
 
     auto eMesh = sReg.create(valueOrAbort(loadModel(state, "assets/suzanne.glb", Material{
         .textures = {
@@ -1413,9 +2076,22 @@ int main(int argc, char const **argv)
     })));
     auto &mesh = sReg.get<VulkanMesh>(eMesh);
 
+    // Skinned models play their first animation, or stand in their rest pose, on every instance a little apart.
+    // Poses are evaluated here every frame, the vertices are skinned by a compute pre-pass.
+    Model const &skinnedModel = sReg.get<Model>(mesh.eModel);
+    bool hasSkinnedParts = std::ranges::any_of(mesh.parts, [](auto const &part){ return !part.buffers.skinned.empty(); });
+    std::optional<SkeletonLayout> skeletonLayout = hasSkinnedParts ? SkeletonLayout::build(skinnedModel.skeleton) : std::nullopt;
+    AnimationClip animationClip = AnimationClip::build(skinnedModel.animations.empty() ? Animation{} : skinnedModel.animations.front(), skinnedModel.skeleton);
+    uint32_t numBones = static_cast<uint32_t>(animationClip.getBoneCount());
+    std::array<AnimationCursor, NUM_INSTANCES> animationCursors;
+    std::vector<BonePose> poses(NUM_INSTANCES * numBones);
+    std::vector<glm::mat4> palettes(poses.size());
+    float animationTime = 0.0f;
+
     makeDescriptors(state);
 
     std::array<BufferAllocation, MAX_FRAMES_IN_FLIGHT> shaderDataBuffers;
+    std::array<BufferAllocation, MAX_FRAMES_IN_FLIGHT> paletteBuffers; // skinning matrices of all instances
     std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT> commandBuffers;
     std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> presentSemaphores;
     std::array<VkFence, MAX_FRAMES_IN_FLIGHT> fences;
@@ -1425,14 +2101,22 @@ int main(int argc, char const **argv)
         glm::mat4 projection;
         glm::mat4 view;
         glm::mat4 model[3];
+        glm::vec4 uvTransform[2]; // albedo and ORM
+        glm::uvec4 textureIndex; // albedo and ORM
         glm::vec3 lightPos{0.0f, -10.0f, 10.0f};
         uint32_t selected{1};
     } shaderData{};
+    shaderData.uvTransform[0] = mesh.uvTransforms.albedo;
+    shaderData.uvTransform[1] = mesh.uvTransforms.orm;
+    shaderData.textureIndex = {mesh.textures.albedo.index, mesh.textures.orm.index, 0, 0};
+    std::vector<unsigned> visibleMeshlets; // reused every frame
 
     // TODO: switch back to glsl
     auto shaderModule = createShaderModule(state.device, readFileBinary("shaders-bin/basic.slang.spv")); 
 
     makePipeline(state, shaderModule, extent);
+    auto skinningShaderModule = createShaderModule(state.device, readFileBinary("shaders-bin/skinning.slang.spv"));
+    makeSkinningPipeline(state, skinningShaderModule);
 
     for(uint i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) 
     {
@@ -1456,6 +2140,23 @@ int main(int argc, char const **argv)
         };
         shaderDataBuffer.deviceAddress = vkGetBufferDeviceAddress(state.device, &bdaInfo);
 
+        if(skeletonLayout)
+        {
+            auto &paletteBuffer = paletteBuffers[i];
+            VkBufferCreateInfo paletteBufferCI{
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = palettes.size() * sizeof(glm::mat4),
+                .usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+            };
+            CHK(vmaCreateBuffer(state.vma, &paletteBufferCI, &uBufferAllocCI, &paletteBuffer.buffer, &paletteBuffer.allocation, nullptr));
+            CHK(vmaMapMemory(state.vma, paletteBuffer.allocation, &paletteBuffer.mapped));
+            VkBufferDeviceAddressInfo paletteBdaInfo{
+                .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                .buffer = paletteBuffer.buffer
+            };
+            paletteBuffer.deviceAddress = vkGetBufferDeviceAddress(state.device, &paletteBdaInfo);
+        }
+
         VkCommandBufferAllocateInfo commandBufferAllocateInfo{
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
             .commandPool = state.commandPool,
@@ -1562,6 +2263,16 @@ int main(int argc, char const **argv)
         }
         std::memcpy(shaderDataBuffers[frameIndex].mapped, &shaderData, sizeof(ShaderUniformData));
 
+        // Palettes are computed in cached memory and copied, computePalettes reads back what it writes
+        if(skeletonLayout)
+        {
+            animationTime += deltatime;
+            for(uint32_t i = 0; i < NUM_INSTANCES; ++i)
+                animationClip.sample(animationClip.getTicks(animationTime + i * 0.5f), animationCursors[i], std::span(poses).subspan(i * numBones, numBones));
+            computePalettes(*skeletonLayout, poses, palettes);
+            std::memcpy(paletteBuffers[frameIndex].mapped, palettes.data(), palettes.size() * sizeof(glm::mat4));
+        }
+
         // Record command buffer
         auto cb = commandBuffers[frameIndex];
         CHK(vkResetCommandBuffer(cb, 0));
@@ -1572,6 +2283,12 @@ int main(int argc, char const **argv)
         };
         CHK(vkBeginCommandBuffer(cb, &cbBI));
 
+        // Uploads recorded since the last frame are submitted now and waited for on the GPU, not here.
+        uint64_t uploadValue = acquireUploads(state, cb);
+
+        if(skeletonLayout)
+            recordSkinning(state, cb, mesh, paletteBuffers[frameIndex].deviceAddress, numBones);
+
         std::array<VkImageMemoryBarrier2, 2> outputBarriers{
             VkImageMemoryBarrier2{
                 .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
@@ -1644,25 +2361,73 @@ int main(int argc, char const **argv)
         VkRect2D scissor{ .extent{ .width = mainWindow.size.x, .height = mainWindow.size.y } };
         vkCmdSetScissor(cb, 0, 1, &scissor);
 
-        vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, state.pipeline);
         VkDeviceSize vOffset{ 0 };
         vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, state.pipelineLayout, 0, 1, &state.descriptorSetTex, 0, nullptr);
-        vkCmdBindVertexBuffers(cb, 0, 1, &mesh.buffers.pos .buffer, &vOffset);
-        vkCmdBindVertexBuffers(cb, 1, 1, &mesh.buffers.uv  .buffer, &vOffset);
-        vkCmdBindVertexBuffers(cb, 2, 1, &mesh.buffers.norm.buffer, &vOffset);
-        vkCmdBindVertexBuffers(cb, 3, 1, &mesh.buffers.tan .buffer, &vOffset);
-        vkCmdBindIndexBuffer(cb, mesh.buffers.idx.buffer, 0, VK_INDEX_TYPE_UINT32);
-
-        vkCmdPushConstants(
-            cb,
-            state.pipelineLayout,
-            VK_SHADER_STAGE_VERTEX_BIT,
-            0,
-            sizeof(VkDeviceAddress),
-            &shaderDataBuffers[frameIndex].deviceAddress
-        );
+        Frustum frustum = makeFrustum(camera);
+        auto const &model = sReg.get<Model>(mesh.eModel);
+        for(auto const &part : mesh.parts)
+        {
+            // Skinned parts draw every instance from its output of the pre-pass, with the UVs of the unskinned vertices
+            bool skinnedPart = skeletonLayout && !part.buffers.skinned.empty();
+            vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, skinnedPart ? state.skinnedPipeline : state.pipeline);
+            if(skinnedPart)
+            {
+                vkCmdBindVertexBuffers(cb, 1, 1, VERTEX_LAYOUT == VertexLayout::Packed ? &part.buffers.vertices.buffer : &part.buffers.uv.buffer, &vOffset);
+            } else if constexpr(VERTEX_LAYOUT == VertexLayout::Packed) {
+                vkCmdBindVertexBuffers(cb, 0, 1, &part.buffers.vertices.buffer, &vOffset);
+            } else {
+                vkCmdBindVertexBuffers(cb, 0, 1, &part.buffers.pos .buffer, &vOffset);
+                vkCmdBindVertexBuffers(cb, 1, 1, &part.buffers.norm.buffer, &vOffset);
+                vkCmdBindVertexBuffers(cb, 2, 1, &part.buffers.uv  .buffer, &vOffset);
+                vkCmdBindVertexBuffers(cb, 3, 1, &part.buffers.tan .buffer, &vOffset);
+            }
+            vkCmdBindIndexBuffer(cb, part.buffers.idx.buffer, 0, part.buffers.indexType);
 
-        vkCmdDrawIndexed(cb, mesh.indexCount, 3, 0, 0, 0);
+            PushConstants pushConstants{
+                .shaderData = shaderDataBuffers[frameIndex].deviceAddress,
+                .padding = 0,
+                .positionOffset = glm::vec4(part.positionOffset, 0.0f),
+                .positionScale = glm::vec4(part.positionScale, 0.0f)
+            };
+            vkCmdPushConstants(
+                cb,
+                state.pipelineLayout,
+                VK_SHADER_STAGE_VERTEX_BIT,
+                0,
+                sizeof(PushConstants),
+                &pushConstants
+            );
+
+            // Every instance draws the level of detail that fits its distance.
+            // At full detail only the meshlets that survive culling are drawn, merging neighbours into one draw.
+            auto const &geometry = model.meshes.at(part.meshIndex).geometry;
+            for(uint32_t i = 0; i < NUM_INSTANCES; ++i)
+            {
+                unsigned lodIndex = selectLod(geometry, shaderData.model[i], camera, static_cast<float>(mainWindow.size.y));
+                auto const &lod = geometry.lods.at(lodIndex);
+                // Meshlet bounds and cones are of the rest pose, animated vertices can leave them
+                if(skinnedPart)
+                    vkCmdBindVertexBuffers(cb, 0, 1, &part.buffers.skinned[i].buffer, &vOffset);
+                if(skinnedPart || lodIndex != 0 || geometry.meshlets.empty())
+                {
+                    vkCmdDrawIndexed(cb, lod.indexCount, 1, lod.indexOffset, 0, i);
+                    continue;
+                }
+
+                visibleMeshlets.clear();
+                cullMeshlets(geometry, shaderData.model[i], frustum, CULL_MODE != VK_CULL_MODE_NONE, visibleMeshlets);
+                for(size_t first = 0; first < visibleMeshlets.size();)
+                {
+                    auto const &meshlet = geometry.meshlets[visibleMeshlets[first]];
+                    uint32_t indexCount = meshlet.triangleCount * 3;
+                    size_t last = first + 1;
+                    for(; last < visibleMeshlets.size() && geometry.meshlets[visibleMeshlets[last]].indexOffset == meshlet.indexOffset + indexCount; ++last)
+                        indexCount += geometry.meshlets[visibleMeshlets[last]].triangleCount * 3;
+                    vkCmdDrawIndexed(cb, indexCount, 1, meshlet.indexOffset, 0, i);
+                    first = last;
+                }
+            }
+        }
 
         vkCmdEndRendering(cb);
 
@@ -1687,18 +2452,38 @@ int main(int argc, char const **argv)
         vkEndCommandBuffer(cb);
 
         // Submit command buffer
-        VkPipelineStageFlags waitStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        VkSubmitInfo submitInfo{
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &presentSemaphores[frameIndex],
-            .pWaitDstStageMask = &waitStages,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &cb,
-            .signalSemaphoreCount = 1,
-            .pSignalSemaphores = &renderSemaphores[imageIndex],
+        std::array<VkSemaphoreSubmitInfo, 2> waitInfos{
+            VkSemaphoreSubmitInfo{
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                .semaphore = presentSemaphores[frameIndex],
+                .stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT
+            },
+            VkSemaphoreSubmitInfo{
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                .semaphore = state.upload.timeline,
+                .value = uploadValue,
+                .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT
+            }
+        };
+        VkCommandBufferSubmitInfo commandBufferInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+            .commandBuffer = cb
+        };
+        VkSemaphoreSubmitInfo signalInfo{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = renderSemaphores[imageIndex],
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT
         };
-        CHK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, fences[frameIndex]));
+        VkSubmitInfo2 submitInfo{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .waitSemaphoreInfoCount = uploadValue != 0 ? 2u : 1u,
+            .pWaitSemaphoreInfos = waitInfos.data(),
+            .commandBufferInfoCount = 1,
+            .pCommandBufferInfos = &commandBufferInfo,
+            .signalSemaphoreInfoCount = 1,
+            .pSignalSemaphoreInfos = &signalInfo
+        };
+        CHK(vkQueueSubmit2(graphicsQueue, 1, &submitInfo, fences[frameIndex]));
 
         frameIndex = (frameIndex + 1) % MAX_FRAMES_IN_FLIGHT;
         
@@ -1722,38 +2507,32 @@ int main(int argc, char const **argv)
     for(auto e : sReg.view<VulkanMesh>())
     {
         auto &mesh = sReg.get<VulkanMesh>(e);
-        vmaDestroyBuffer(state.vma, mesh.buffers.pos .buffer, mesh.buffers.pos .allocation);
-        vmaDestroyBuffer(state.vma, mesh.buffers.uv  .buffer, mesh.buffers.uv  .allocation);
-        vmaDestroyBuffer(state.vma, mesh.buffers.norm.buffer, mesh.buffers.norm.allocation);
-        vmaDestroyBuffer(state.vma, mesh.buffers.tan .buffer, mesh.buffers.tan .allocation);
-        vmaDestroyBuffer(state.vma, mesh.buffers.idx .buffer, mesh.buffers.idx .allocation);
-
-        vmaDestroyImage(state.vma, mesh.textures.albedo      .image, mesh.textures.albedo      .allocation);
-        vmaDestroyImage(state.vma, mesh.textures.metallic    .image, mesh.textures.metallic    .allocation);
-        vmaDestroyImage(state.vma, mesh.textures.roughness   .image, mesh.textures.roughness   .allocation);
-        vmaDestroyImage(state.vma, mesh.textures.ambient     .image, mesh.textures.ambient     .allocation);
-        vmaDestroyImage(state.vma, mesh.textures.normal      .image, mesh.textures.normal      .allocation);
-        vmaDestroyImage(state.vma, mesh.textures.displacement.image, mesh.textures.displacement.allocation);
-
-        vkDestroyImageView(state.device, mesh.textures.albedo      .view, ALLOCATOR_HERE);
-        vkDestroyImageView(state.device, mesh.textures.metallic    .view, ALLOCATOR_HERE);
-        vkDestroyImageView(state.device, mesh.textures.roughness   .view, ALLOCATOR_HERE);
-        vkDestroyImageView(state.device, mesh.textures.ambient     .view, ALLOCATOR_HERE);
-        vkDestroyImageView(state.device, mesh.textures.normal      .view, ALLOCATOR_HERE);
-        vkDestroyImageView(state.device, mesh.textures.displacement.view, ALLOCATOR_HERE);
-
-        vkDestroySampler(state.device, mesh.textures.albedo      .sampler, ALLOCATOR_HERE);
-        vkDestroySampler(state.device, mesh.textures.metallic    .sampler, ALLOCATOR_HERE);
-        vkDestroySampler(state.device, mesh.textures.roughness   .sampler, ALLOCATOR_HERE);
-        vkDestroySampler(state.device, mesh.textures.ambient     .sampler, ALLOCATOR_HERE);
-        vkDestroySampler(state.device, mesh.textures.normal      .sampler, ALLOCATOR_HERE);
-        vkDestroySampler(state.device, mesh.textures.displacement.sampler, ALLOCATOR_HERE);
+        for(auto &part : mesh.parts)
+        {
+            vmaDestroyBuffer(state.vma, part.buffers.pos .buffer, part.buffers.pos .allocation);
+            vmaDestroyBuffer(state.vma, part.buffers.uv  .buffer, part.buffers.uv  .allocation);
+            vmaDestroyBuffer(state.vma, part.buffers.norm.buffer, part.buffers.norm.allocation);
+            vmaDestroyBuffer(state.vma, part.buffers.tan .buffer, part.buffers.tan .allocation);
+            vmaDestroyBuffer(state.vma, part.buffers.vertices.buffer, part.buffers.vertices.allocation);
+            vmaDestroyBuffer(state.vma, part.buffers.idx .buffer, part.buffers.idx .allocation);
+            vmaDestroyBuffer(state.vma, part.buffers.skinSource.buffer, part.buffers.skinSource.allocation);
+            vmaDestroyBuffer(state.vma, part.buffers.boneInfluences.buffer, part.buffers.boneInfluences.allocation);
+            for(auto &skinned : part.buffers.skinned)
+                vmaDestroyBuffer(state.vma, skinned.buffer, skinned.allocation);
+        }
+    }
+    for(auto &[eTexture, image] : state.textures)
+    {
+        vmaDestroyImage(state.vma, image.image, image.allocation);
+        vkDestroyImageView(state.device, image.view, ALLOCATOR_HERE);
+        vkDestroySampler(state.device, image.sampler, ALLOCATOR_HERE);
     }
 
     vkDestroyImageView(state.device, state.depthImage.view, ALLOCATOR_HERE);
     vmaDestroyImage(state.vma, state.depthImage.image, state.depthImage.allocation);
 
     vkDestroyShaderModule(state.device, shaderModule, ALLOCATOR_HERE);
+    vkDestroyShaderModule(state.device, skinningShaderModule, ALLOCATOR_HERE);
 
     for(uint i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) 
     {
@@ -1761,6 +2540,11 @@ int main(int argc, char const **argv)
         vkDestroyFence(state.device, fences[i], ALLOCATOR_HERE);
         vmaUnmapMemory(state.vma, shaderDataBuffers[i].allocation);
         vmaDestroyBuffer(state.vma, shaderDataBuffers[i].buffer, shaderDataBuffers[i].allocation);
+        if(paletteBuffers[i].mapped)
+        {
+            vmaUnmapMemory(state.vma, paletteBuffers[i].allocation);
+            vmaDestroyBuffer(state.vma, paletteBuffers[i].buffer, paletteBuffers[i].allocation);
+        }
     }
 
     for(uint i = 0; i < state.swapchain.imageCount; ++i)
@@ -1769,12 +2553,16 @@ int main(int argc, char const **argv)
         vkDestroySemaphore(state.device, renderSemaphores[i], ALLOCATOR_HERE);
     }
 
+    destroyUploadManager(state);
     vkDestroyCommandPool(state.device, state.commandPool, ALLOCATOR_HERE);
 
     vkDestroyDescriptorSetLayout(state.device, state.descriptorSetLayoutTex, ALLOCATOR_HERE);
     vkDestroyDescriptorPool(state.device, state.descriptorPoolTex, ALLOCATOR_HERE);
     vkDestroyPipelineLayout(state.device, state.pipelineLayout, ALLOCATOR_HERE);
     vkDestroyPipeline(state.device, state.pipeline, ALLOCATOR_HERE);
+    vkDestroyPipeline(state.device, state.skinnedPipeline, ALLOCATOR_HERE);
+    vkDestroyPipeline(state.device, state.skinningPipeline, ALLOCATOR_HERE);
+    vkDestroyPipelineLayout(state.device, state.skinningPipelineLayout, ALLOCATOR_HERE);
     vkDestroyRenderPass(state.device, state.renderPass, ALLOCATOR_HERE);
     // vkDestroyPipelineLayout(state.device, pipelineLayout, ALLOCATOR_HERE);
     // vkDestroyShaderModule(state.device, fragShaderModule, ALLOCATOR_HERE);